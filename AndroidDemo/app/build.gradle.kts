@@ -55,6 +55,12 @@ android {
         viewBinding = true
     }
 
+    // Keep the asset stored in the APKs, so it can be mapped in place
+    // (apkMmapOneGo) or copied out with AAsset_openFileDescriptor64.
+    androidResources {
+        noCompress += "txt"
+    }
+
     assetPacks += listOf(":FileAssets")
 }
 
@@ -3,7 +3,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <numeric>
 #include <random>
@@ -16,6 +18,11 @@
 #include <android/asset_manager_jni.h>
 #include <android/log.h>
 
+#include "file-copy.h"
+#include "file-registry.h"
+#include "read-loop.h"
+#include "zip-archive.h"
+
 constexpr const char *kLogTag = "MainActivity";
 constexpr const char *kAssetFileName = "random_content.txt";
 constexpr const char *kDataDirFilePath = "/local_content.txt";
@@ -49,13 +56,37 @@ extern "C" JNIEXPORT void JNICALL Java_com_example_assetpack_MainActivity_init(
 
   if (asset) {
     size_t assetLength = AAsset_getLength(asset);
-    const void *buffer = AAsset_getBuffer(asset);
 
     __android_log_print(ANDROID_LOG_INFO, kLogTag, "Asset length is %zu",
                         assetLength);
 
     std::string outputPath = std::string(dataDir) + kDataDirFilePath;
 
+    // Stored (uncompressed) assets can be copied straight out of the APK by
+    // the kernel, without going through AAsset_getBuffer and stdio.
+    off64_t assetStart = 0;
+    off64_t assetFdLength = 0;
+    int assetFd = AAsset_openFileDescriptor64(asset, &assetStart, &assetFdLength);
+    if (assetFd >= 0) {
+      CopyMethod used = CopyMethod::kAuto;
+      int result = extract_to_file(assetFd, assetStart, assetFdLength,
+                                   outputPath.c_str(), CopyMethod::kAuto, &used);
+      close(assetFd);
+      if (result == 0) {
+        __android_log_print(ANDROID_LOG_INFO, kLogTag,
+                            "File written to %s with %s", outputPath.c_str(),
+                            copy_method_name(used));
+        AAsset_close(asset);
+        env->ReleaseStringUTFChars(jDataDir, dataDir);
+        return;
+      }
+      __android_log_print(ANDROID_LOG_WARN, kLogTag,
+                          "Kernel copy failed (%s), falling back to fwrite",
+                          strerror(errno));
+    }
+
+    const void *buffer = AAsset_getBuffer(asset);
+
     FILE *outFile = fopen(outputPath.c_str(), "wb");
 
     if (outFile) {
@@ -225,6 +256,45 @@ Java_com_example_assetpack_MainActivity_openWithMmapOneGo(JNIEnv *env, jobject,
   env->ReleaseStringUTFChars(jDataDir, dataDir);
 }
 
+// Same as openWithMmapOneGo, but the file stays open and mapped in the
+// process-wide registry between calls, so repeated loads only copy.
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_assetpack_MainActivity_registryMmapOneGo(JNIEnv *env, jobject,
+                                                          jstring jDataDir) {
+  const char *dataDir = env->GetStringUTFChars(jDataDir, nullptr);
+
+  std::string filePath = std::string(dataDir) + kDataDirFilePath;
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  FileHandle file;
+  if (FileRegistry::global().acquire(filePath.c_str(), true, &file) == -1) {
+    __android_log_print(ANDROID_LOG_ERROR, kLogTag, "Failed to map file %s: %s",
+                        filePath.c_str(), strerror(errno));
+    env->ReleaseStringUTFChars(jDataDir, dataDir);
+    return;
+  }
+
+  size_t fileSize = file.size();
+  char *buffer = new char[fileSize];
+  memcpy(buffer, file.data(), fileSize);
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> duration = end - start;
+
+  FileRegistry::Stats stats = FileRegistry::global().stats();
+  __android_log_print(ANDROID_LOG_INFO, kLogTag,
+                      "Time taken to copy buffer: %f ms (registry: %llu hits, "
+                      "%llu misses)",
+                      duration.count(),
+                      static_cast<unsigned long long>(stats.hits),
+                      static_cast<unsigned long long>(stats.misses));
+
+  delete[] buffer;
+
+  env->ReleaseStringUTFChars(jDataDir, dataDir);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_example_assetpack_MainActivity_openWithMmapMultipleGo(JNIEnv *env,
                                                                jobject,
@@ -486,11 +556,18 @@ Java_com_example_assetpack_MainActivity_openOneGo(JNIEnv *env, jobject,
     return;
   }
 
-  size_t fileSize = sb.st_size;
+  size_t fileSize;
+  if (buffer_size_for(sb.st_size, &fileSize) == -1) {
+    __android_log_print(ANDROID_LOG_ERROR, kLogTag, "File %s is too large: %s",
+                        filePath.c_str(), strerror(errno));
+    close(fd);
+    env->ReleaseStringUTFChars(jDataDir, dataDir);
+    return;
+  }
   char *buffer = new char[fileSize];
 
-  ssize_t bytesRead = read(fd, buffer, fileSize);
-  if (bytesRead != fileSize) {
+  // One read() stops at ~2GB and on signals; read_fully loops.
+  if (read_fully(fd, buffer, fileSize) == -1) {
     __android_log_print(ANDROID_LOG_ERROR, kLogTag, "Failed to read file %s",
                         filePath.c_str());
     delete[] buffer;
@@ -530,8 +607,9 @@ Java_com_example_assetpack_MainActivity_openNoStatOneGo(JNIEnv *env, jobject,
     return;
   }
 
-  off_t fileSize = lseek(fd, 0, SEEK_END);
-  if (fileSize == -1) {
+  off_t fileEnd = lseek(fd, 0, SEEK_END);
+  size_t fileSize;
+  if (fileEnd == -1 || buffer_size_for(fileEnd, &fileSize) == -1) {
     __android_log_print(ANDROID_LOG_ERROR, kLogTag,
                         "Failed to determine file size for %s",
                         filePath.c_str());
@@ -543,8 +621,7 @@ Java_com_example_assetpack_MainActivity_openNoStatOneGo(JNIEnv *env, jobject,
 
   char *buffer = new char[fileSize];
 
-  ssize_t bytesRead = read(fd, buffer, fileSize);
-  if (bytesRead != fileSize) {
+  if (read_fully(fd, buffer, fileSize) == -1) {
     __android_log_print(ANDROID_LOG_ERROR, kLogTag, "Failed to read file %s",
                         filePath.c_str());
     delete[] buffer;
@@ -565,3 +642,61 @@ Java_com_example_assetpack_MainActivity_openNoStatOneGo(JNIEnv *env, jobject,
 
   env->ReleaseStringUTFChars(jDataDir, dataDir);
 }
+
+// Same copy as openWithMmapOneGo, but mapped straight out of the APK split
+// that holds the asset, so init() never has to extract it to the data dir.
+// Works when the asset is stored uncompressed (noCompress) in the split.
+extern "C" JNIEXPORT void JNICALL
+Java_com_example_assetpack_MainActivity_apkMmapOneGo(JNIEnv *env, jobject,
+                                                     jobjectArray jApkPaths) {
+  std::string assetPath = std::string("assets/") + kAssetFileName;
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  ZipArchive archive;
+  const ZipEntry *entry = nullptr;
+  jsize apkCount = env->GetArrayLength(jApkPaths);
+  for (jsize i = 0; i < apkCount && !entry; ++i) {
+    auto jApkPath =
+        static_cast<jstring>(env->GetObjectArrayElement(jApkPaths, i));
+    const char *apkPath = env->GetStringUTFChars(jApkPath, nullptr);
+    if (archive.open(apkPath) == 0) {
+      entry = archive.find(assetPath);
+    } else {
+      __android_log_print(ANDROID_LOG_WARN, kLogTag, "Failed to read %s: %s",
+                          apkPath, strerror(errno));
+    }
+    env->ReleaseStringUTFChars(jApkPath, apkPath);
+    env->DeleteLocalRef(jApkPath);
+  }
+  if (!entry) {
+    __android_log_print(ANDROID_LOG_ERROR, kLogTag, "%s is in none of the APKs",
+                        assetPath.c_str());
+    return;
+  }
+
+  ZipSpan span;
+  if (span.map(archive, *entry) == -1) {
+    __android_log_print(ANDROID_LOG_ERROR, kLogTag, "Failed to map %s: %s",
+                        assetPath.c_str(),
+                        entry->stored() ? strerror(errno)
+                                        : "compressed in the APK");
+    return;
+  }
+
+  char *buffer = new char[span.size()];
+  memcpy(buffer, span.data(), span.size());
+
+  auto end = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> duration = end - start;
+
+  __android_log_print(ANDROID_LOG_INFO, kLogTag,
+                      "Time taken to copy buffer: %f ms (offset %lld in the "
+                      "APK, %s)",
+                      duration.count(),
+                      static_cast<long long>(entry->data_offset),
+                      entry->page_aligned() ? "page aligned"
+                                            : "not page aligned");
+
+  delete[] buffer;
+}
@@ -53,6 +53,10 @@ class MainActivity : AppCompatActivity() {
                 openWithMmapMultipleGo(dataDir, pieces)
             }
 
+            Action.REGISTRY_FILE_READ_ONE_GO -> {
+                registryMmapOneGo(dataDir)
+            }
+
             Action.STREAM_FILE_READ_ONE_GO -> {
                 ifstreamOneGo(dataDir)
             }
@@ -66,6 +70,13 @@ class MainActivity : AppCompatActivity() {
                 fopenOneGo(dataDir)
             }
 
+            Action.APK_MMAP_ONE_GO -> {
+                // Install-time asset packs arrive as split APKs.
+                val apkPaths = arrayOf(applicationInfo.sourceDir) +
+                    (applicationInfo.splitSourceDirs ?: emptyArray())
+                apkMmapOneGo(apkPaths)
+            }
+
             else -> {
                 Log.e(TAG, "Unknown action")
             }
@@ -81,9 +92,11 @@ class MainActivity : AppCompatActivity() {
     private external fun openNoStatOneGo(dataDir: String)
     private external fun openWithMmapOneGo(dataDir: String)
     private external fun openWithMmapMultipleGo(dataDir: String, n: Int)
+    private external fun registryMmapOneGo(dataDir: String)
     private external fun ifstreamOneGo(dataDir: String)
     private external fun ifstreamMultipleGo(dataDir: String, n: Int)
     private external fun fopenOneGo(dataDir: String)
+    private external fun apkMmapOneGo(apkPaths: Array<String>)
 
 
     companion object {
@@ -109,9 +122,11 @@ class MainActivity : AppCompatActivity() {
         OPEN_NO_STAT_ONE_GO,
         FILE_READ_ONE_GO,
         FILE_READ_MULTIPLE_GO,
+        REGISTRY_FILE_READ_ONE_GO,
         STREAM_FILE_READ_ONE_GO,
         STREAM_FILE_READ_MULTIPLE_GO,
-        FOPEN_ONE_GO;
+        FOPEN_ONE_GO,
+        APK_MMAP_ONE_GO;
 
         companion object {
             fun fromIntent(intent: Intent): Action? {
@@ -123,9 +138,11 @@ class MainActivity : AppCompatActivity() {
                     "com.example.assetpack.action.OPEN_NO_STAT_ONE_GO" -> OPEN_NO_STAT_ONE_GO
                     "com.example.assetpack.action.FILE_READ_ONE_GO" -> FILE_READ_ONE_GO
                     "com.example.assetpack.action.FILE_READ_MULTIPLE_GO" -> FILE_READ_MULTIPLE_GO
+                    "com.example.assetpack.action.REGISTRY_FILE_READ_ONE_GO" -> REGISTRY_FILE_READ_ONE_GO
                     "com.example.assetpack.action.STREAM_FILE_READ_ONE_GO" -> STREAM_FILE_READ_ONE_GO
                     "com.example.assetpack.action.STREAM_FILE_READ_MULTIPLE_GO" -> STREAM_FILE_READ_MULTIPLE_GO
                     "com.example.assetpack.action.FOPEN_ONE_GO" -> FOPEN_ONE_GO
+                    "com.example.assetpack.action.APK_MMAP_ONE_GO" -> APK_MMAP_ONE_GO
                     else -> null
                 }
             }
@@ -12,11 +12,31 @@
 #include <sys/stat.h>
 #import <unistd.h>
 
+#import <algorithm>
+#import <cerrno>
 #import <chrono>
 #include <fstream>
 
 #import <Foundation/Foundation.h>
 
+// Reads `size` bytes in requests of at most 1MB, like read_fully in
+// cpp-project/src/read-loop.cpp: one read() stops at INT_MAX bytes and can
+// come back short or with EINTR.
+static bool readFully(int fd, char *buffer, size_t size) {
+  constexpr size_t kRequest = 1 << 20;
+  size_t done = 0;
+  while (done < size) {
+    ssize_t n = read(fd, buffer + done, std::min(kRequest, size - done));
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    if (n == 0) return false;
+    done += n;
+  }
+  return true;
+}
+
 void openFile(const char *filePath) {
   auto startTime = std::chrono::high_resolution_clock::now();
 
@@ -38,8 +58,7 @@ void openFile(const char *filePath) {
   size_t fileSize = sb.st_size;
   char *buffer = new char[fileSize];
 
-  ssize_t bytesRead = read(fd, buffer, fileSize);
-  if (bytesRead != fileSize) {
+  if (!readFully(fd, buffer, fileSize)) {
     delete[] buffer;
     close(fd);
     return;
@@ -76,8 +95,7 @@ void openFileWithLseek(const char *filePath) {
 
   char *buffer = new char[fileSize];
 
-  ssize_t bytesRead = read(fd, buffer, fileSize);
-  if (bytesRead != fileSize) {
+  if (!readFully(fd, buffer, fileSize)) {
     delete[] buffer;
     close(fd);
     return;
@@ -104,14 +122,18 @@ void openFileWithFopen(const char *filePath) {
     NSLog(@"File opened successfully");
   }
 
-  fseek(file, 0, SEEK_END);
-  long fileSize = ftell(file);
-  fseek(file, 0, SEEK_SET);
+  fseeko(file, 0, SEEK_END);
+  off_t fileSize = ftello(file);
+  if (fileSize == -1) {
+    fclose(file);
+    return;
+  }
+  fseeko(file, 0, SEEK_SET);
 
   char *buffer = new char[fileSize];
 
   size_t bytesRead = fread(buffer, 1, fileSize, file);
-  if (bytesRead != fileSize) {
+  if (bytesRead != static_cast<size_t>(fileSize)) {
     delete[] buffer;
     fclose(file);
     return;
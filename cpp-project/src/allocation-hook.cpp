@@ -0,0 +1,61 @@
+// Replaces the global operator new and delete to feed allocation_counts().
+// Link this file into an executable (not the library, where it would change
+// every user's allocator) to get allocation counts there.
+
+#include <stdlib.h>
+
+#include <cstddef>
+#include <new>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "memory-usage.h"
+
+namespace {
+
+size_t usable_size(void* pointer) {
+#if defined(__APPLE__)
+  return malloc_size(pointer);
+#else
+  return malloc_usable_size(pointer);
+#endif
+}
+
+void* allocate(size_t size) {
+  void* pointer = malloc(size == 0 ? 1 : size);
+  if (pointer) detail::record_allocation(size, usable_size(pointer));
+  return pointer;
+}
+
+void deallocate(void* pointer) {
+  if (!pointer) return;
+  detail::record_free(usable_size(pointer));
+  free(pointer);
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  void* pointer = allocate(size);
+  if (!pointer) throw std::bad_alloc();
+  return pointer;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return allocate(size);
+}
+
+void operator delete(void* pointer) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer) noexcept { deallocate(pointer); }
+void operator delete(void* pointer, size_t) noexcept { deallocate(pointer); }
+void operator delete[](void* pointer, size_t) noexcept { deallocate(pointer); }
@@ -0,0 +1,289 @@
+#include "asset-manager.h"
+
+#ifndef __ANDROID__
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef FILEREAD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "read-loop.h"
+#include "zip-archive.h"
+
+namespace {
+
+constexpr const char* kAssetPrefix = "assets/";
+
+#ifdef FILEREAD_HAVE_ZLIB
+// Streaming raw inflate of one entry, reading the compressed bytes with
+// pread so several assets can share the archive fd.
+class Inflater {
+ public:
+  Inflater(int fd, off_t offset, size_t compressed_size)
+      : fd_(fd), offset_(offset), compressed_size_(compressed_size) {}
+  ~Inflater() {
+    if (initialized_) inflateEnd(&stream_);
+  }
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  // Uncompressed bytes produced so far.
+  off_t position() const { return produced_; }
+
+  // Starts over from the beginning of the entry.
+  int reset() {
+    if (initialized_) inflateEnd(&stream_);
+    stream_ = z_stream();
+    initialized_ = inflateInit2(&stream_, -MAX_WBITS) == Z_OK;
+    consumed_ = 0;
+    produced_ = 0;
+    if (!initialized_) {
+      errno = ENOMEM;
+      return -1;
+    }
+    return 0;
+  }
+
+  // Inflates exactly `size` bytes into `dest`, or discards them when
+  // `dest` is null. Returns 0 on success, -1 with errno set.
+  int read(char* dest, size_t size) {
+    if (!initialized_ && reset() == -1) return -1;
+    char discard[16384];
+    while (size > 0) {
+      if (stream_.avail_in == 0 && consumed_ < compressed_size_) {
+        size_t chunk = std::min(input_.size(), compressed_size_ - consumed_);
+        if (pread_fully(fd_, reinterpret_cast<char*>(input_.data()), chunk,
+                        offset_ + consumed_) == -1) {
+          return -1;
+        }
+        consumed_ += chunk;
+        stream_.next_in = input_.data();
+        stream_.avail_in = chunk;
+      }
+      size_t want = std::min<size_t>(size, dest ? UINT_MAX : sizeof(discard));
+      stream_.next_out = reinterpret_cast<Bytef*>(dest ? dest : discard);
+      stream_.avail_out = want;
+      int result = inflate(&stream_, Z_NO_FLUSH);
+      size_t got = want - stream_.avail_out;
+      if (result != Z_OK && result != Z_STREAM_END) {
+        errno = EIO;
+        return -1;
+      }
+      if (got == 0 && (result == Z_STREAM_END ||
+                       (stream_.avail_in == 0 &&
+                        consumed_ == compressed_size_))) {
+        // The entry ended before its recorded size.
+        errno = EIO;
+        return -1;
+      }
+      if (dest) dest += got;
+      size -= got;
+      produced_ += got;
+    }
+    return 0;
+  }
+
+ private:
+  const int fd_;
+  const off_t offset_;
+  const size_t compressed_size_;
+  z_stream stream_ = z_stream();
+  bool initialized_ = false;
+  std::vector<unsigned char> input_ = std::vector<unsigned char>(1 << 16);
+  size_t consumed_ = 0;
+  off_t produced_ = 0;
+};
+#endif  // FILEREAD_HAVE_ZLIB
+
+}  // namespace
+
+struct AAssetManager {
+  ZipArchive archive;
+};
+
+struct AAsset {
+  // The manager's archive and the asset's entry in it.
+  const ZipArchive* archive = nullptr;
+  const ZipEntry* entry = nullptr;
+  int fd = -1;
+  off_t offset = 0;
+  size_t compressed_size = 0;
+  size_t length = 0;
+  off_t position = 0;
+
+  // Stored entries: the asset, mapped from the archive.
+  ZipSpan span;
+  const char* data = nullptr;
+
+  // Deflated entries: the whole asset once getBuffer asked for it, and the
+  // inflater reads go through otherwise.
+  std::unique_ptr<char[]> inflated;
+#ifdef FILEREAD_HAVE_ZLIB
+  std::unique_ptr<Inflater> inflater;
+#endif
+};
+
+AAssetManager* asset_manager_open(const char* apk_path) {
+  auto mgr = std::make_unique<AAssetManager>();
+  if (mgr->archive.open(apk_path) == -1) return nullptr;
+  return mgr.release();
+}
+
+void asset_manager_close(AAssetManager* mgr) { delete mgr; }
+
+AAsset* AAssetManager_open(AAssetManager* mgr, const char* filename,
+                           int mode) {
+  const ZipEntry* entry =
+      mgr->archive.find(std::string(kAssetPrefix) + filename);
+  if (!entry) {
+    errno = ENOENT;
+    return nullptr;
+  }
+  bool supported = entry->stored();
+#ifdef FILEREAD_HAVE_ZLIB
+  supported = supported || entry->method == kZipDeflated;
+#endif
+  if (!supported) {
+    errno = ENOTSUP;
+    return nullptr;
+  }
+
+  auto asset = std::make_unique<AAsset>();
+  asset->archive = &mgr->archive;
+  asset->entry = entry;
+  asset->fd = mgr->archive.fd();
+  asset->offset = entry->data_offset;
+  asset->compressed_size = entry->compressed_size;
+  asset->length = entry->size;
+
+  if (entry->stored()) {
+    if (asset->span.map(mgr->archive, *entry) == -1) return nullptr;
+    asset->data = asset->span.data();
+    // The same hints the platform gives its asset mappings.
+    if (mode == AASSET_MODE_RANDOM) {
+      asset->span.advise(MADV_RANDOM);
+    } else if (mode == AASSET_MODE_STREAMING) {
+      asset->span.advise(MADV_SEQUENTIAL);
+    }
+  }
+#ifdef FILEREAD_HAVE_ZLIB
+  else {
+    asset->inflater = std::make_unique<Inflater>(
+        asset->fd, asset->offset, asset->compressed_size);
+  }
+#endif
+  return asset.release();
+}
+
+void AAsset_close(AAsset* asset) {
+  delete asset;
+}
+
+off_t AAsset_getLength(AAsset* asset) { return asset->length; }
+
+off64_t AAsset_getLength64(AAsset* asset) { return asset->length; }
+
+off_t AAsset_getRemainingLength(AAsset* asset) {
+  return asset->length - asset->position;
+}
+
+off64_t AAsset_getRemainingLength64(AAsset* asset) {
+  return asset->length - asset->position;
+}
+
+const void* AAsset_getBuffer(AAsset* asset) {
+  if (asset->data) return asset->data;
+#ifdef FILEREAD_HAVE_ZLIB
+  std::unique_ptr<char[]> buffer(new (std::nothrow) char[asset->length]);
+  if (!buffer) return nullptr;
+  // A separate inflater, so a read in progress keeps its place.
+  Inflater inflater(asset->fd, asset->offset, asset->compressed_size);
+  if (inflater.read(buffer.get(), asset->length) == -1) return nullptr;
+  asset->inflated = std::move(buffer);
+  asset->data = asset->inflated.get();
+  return asset->data;
+#else
+  return nullptr;
+#endif
+}
+
+int AAsset_read(AAsset* asset, void* buf, size_t count) {
+  size_t remaining = asset->length - asset->position;
+  size_t size =
+      std::min({count, remaining, static_cast<size_t>(INT_MAX)});
+  if (size == 0) return 0;
+  if (asset->data) {
+    memcpy(buf, asset->data + asset->position, size);
+    asset->position += size;
+    return size;
+  }
+#ifdef FILEREAD_HAVE_ZLIB
+  Inflater& inflater = *asset->inflater;
+  if (inflater.position() > asset->position && inflater.reset() == -1) {
+    return -1;
+  }
+  if (inflater.read(nullptr, asset->position - inflater.position()) == -1 ||
+      inflater.read(static_cast<char*>(buf), size) == -1) {
+    return -1;
+  }
+  asset->position += size;
+  return size;
+#else
+  return -1;
+#endif
+}
+
+off64_t AAsset_seek64(AAsset* asset, off64_t offset, int whence) {
+  off64_t base;
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = asset->position;
+      break;
+    case SEEK_END:
+      base = asset->length;
+      break;
+    default:
+      errno = EINVAL;
+      return -1;
+  }
+  off64_t position = base + offset;
+  if (position < 0 || position > static_cast<off64_t>(asset->length)) {
+    errno = EINVAL;
+    return -1;
+  }
+  // Deflated entries catch up (or start over) on the next read.
+  asset->position = position;
+  return position;
+}
+
+off_t AAsset_seek(AAsset* asset, off_t offset, int whence) {
+  return AAsset_seek64(asset, offset, whence);
+}
+
+int AAsset_openFileDescriptor64(AAsset* asset, off64_t* outStart,
+                                off64_t* outLength) {
+  off_t start;
+  off_t length;
+  int fd = asset->archive->open_range(*asset->entry, &start, &length);
+  if (fd == -1) return -1;
+  *outStart = start;
+  *outLength = length;
+  return fd;
+}
+
+int AAsset_isAllocated(AAsset* asset) { return asset->inflated != nullptr; }
+
+#endif  // __ANDROID__
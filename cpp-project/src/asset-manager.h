@@ -0,0 +1,68 @@
+// Linux stand-in for the part of the NDK's AAssetManager API that the
+// Android app uses, backed by a real zip/APK, so the asset strategies can be
+// benchmarked next to the file strategies off-device (the archive is read
+// with ZipArchive, see zip-archive.h). On Android the real
+// <android/asset_manager.h> is used instead.
+//
+// Like the platform, assets are the archive's "assets/" entries, named
+// without that prefix. Stored entries are mapped (getBuffer, read and seek
+// all work on the mapping, with a MADV_RANDOM/MADV_SEQUENTIAL hint for the
+// RANDOM/STREAMING modes) and can be handed out as fd+offset ranges;
+// deflated entries are inflated, all at once for getBuffer and as they are
+// read otherwise, which needs zlib (FILEREAD_HAVE_ZLIB). Seeking backwards
+// in a deflated entry starts the inflate over, as on Android.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+#ifdef __ANDROID__
+#include <android/asset_manager.h>
+#else
+
+struct AAssetManager;
+struct AAsset;
+
+enum {
+  AASSET_MODE_UNKNOWN = 0,
+  AASSET_MODE_RANDOM = 1,
+  AASSET_MODE_STREAMING = 2,
+  AASSET_MODE_BUFFER = 3,
+};
+
+// Returns nullptr with errno set when there is no such asset (ENOENT), it
+// uses a compression method that can't be read here (ENOTSUP), or the
+// archive can't be read.
+AAsset* AAssetManager_open(AAssetManager* mgr, const char* filename, int mode);
+void AAsset_close(AAsset* asset);
+
+off_t AAsset_getLength(AAsset* asset);
+off64_t AAsset_getLength64(AAsset* asset);
+off_t AAsset_getRemainingLength(AAsset* asset);
+off64_t AAsset_getRemainingLength64(AAsset* asset);
+
+// The whole (uncompressed) asset, or nullptr. Valid until AAsset_close.
+const void* AAsset_getBuffer(AAsset* asset);
+// Reads up to `count` bytes at the current position. Returns the number of
+// bytes read, 0 at the end, or a negative value on error.
+int AAsset_read(AAsset* asset, void* buf, size_t count);
+// lseek semantics. Returns the new position, or -1.
+off_t AAsset_seek(AAsset* asset, off_t offset, int whence);
+off64_t AAsset_seek64(AAsset* asset, off64_t offset, int whence);
+
+// For stored entries, a new fd on the archive plus the range of the asset
+// in it; the caller closes the fd. Returns -1 for compressed entries.
+int AAsset_openFileDescriptor64(AAsset* asset, off64_t* outStart,
+                                off64_t* outLength);
+// 1 when getBuffer's data was allocated (inflated) rather than mapped.
+int AAsset_isAllocated(AAsset* asset);
+
+// Not in the NDK: the Java side hands native code its AssetManager. Opens
+// the archive at `apk_path`, or returns nullptr with errno set.
+AAssetManager* asset_manager_open(const char* apk_path);
+// Assets opened from `mgr` must be closed first.
+void asset_manager_close(AAssetManager* mgr);
+
+#endif  // __ANDROID__
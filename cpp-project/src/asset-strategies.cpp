@@ -0,0 +1,313 @@
+// assetGetBufferOneGo and assetGetBufferMultipleGo follow native-lib.cpp;
+// the others are the streaming, random and fd ways into the same asset,
+// and apkMmapOneGo maps it from the APK without the asset manager.
+
+#include "asset-strategies.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "asset-manager.h"
+#include "chunk-planner.h"
+#include "phase-timing.h"
+#include "read-loop.h"
+#include "zip-archive.h"
+
+namespace {
+
+// On the phone the AssetManager (and the APK's central directory) is open
+// long before a strategy runs, so each archive is opened once per process
+// here too and kept.
+AAssetManager* asset_manager_for(const char* path) {
+  static std::mutex mutex;
+  static std::map<std::string, AAssetManager*> managers;
+  std::lock_guard<std::mutex> lock(mutex);
+  AAssetManager*& mgr = managers[path];
+  if (!mgr) mgr = asset_manager_open(path);
+  return mgr;
+}
+
+// Opens kAssetFileName in `mode`, reporting failures like the file
+// strategies do.
+AAsset* open_asset(const char* path, int mode) {
+  AAssetManager* mgr = asset_manager_for(path);
+  AAsset* asset = mgr ? AAssetManager_open(mgr, kAssetFileName, mode) : nullptr;
+  if (!asset) {
+    perror("Error opening asset");
+    return nullptr;
+  }
+  phase_end(Phase::kOpen);
+  return asset;
+}
+
+// AAsset_read until `size` bytes are in. Returns 0, or -1 when the asset
+// ended or failed first.
+int asset_read_fully(AAsset* asset, char* dest, size_t size) {
+  while (size > 0) {
+    int n = AAsset_read(asset, dest, std::min(size, kDefaultReadRequest));
+    if (n <= 0) {
+      if (n == 0) errno = EIO;
+      return -1;
+    }
+    dest += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// Sizes `out` for the asset. Returns the length, or -1 after reporting.
+ssize_t allocate_for_asset(AAsset* asset, FileBuffer* out) {
+  size_t length;
+  if (buffer_size_for(AAsset_getLength64(asset), &length) == -1) {
+    perror("Error getting asset size");
+    return -1;
+  }
+  phase_end(Phase::kSize);
+  if (allocate_output(out, length) == -1) {
+    perror("Error allocating output");
+    return -1;
+  }
+  return length;
+}
+
+// Calls `copy(offset, size)` for the fixed plan's `n` pieces in shuffled
+// order, then reports each piece to `ready`.
+template <typename Copy>
+bool for_each_piece(size_t length, int n, FileBuffer* out,
+                    const ChunkReady& ready, Copy copy) {
+  std::vector<ChunkRequest> chunks =
+      chunk_requests(make_fixed_planner(n)->plan(nullptr, length),
+                     create_random_read_sequence(n), out->data());
+  phase_end(Phase::kOther);
+  for (const ChunkRequest& chunk : chunks) {
+    if (!copy(chunk.offset, chunk.size)) return false;
+    phase_end(Phase::kRead);
+    if (ready) ready(chunk.dest, chunk.size);
+    phase_end(Phase::kCallback);
+  }
+  return true;
+}
+
+bool asset_get_buffer_one_go(const char* path, int, FileBuffer* out,
+                             const ChunkReady& ready) {
+  AAsset* asset = open_asset(path, AASSET_MODE_BUFFER);
+  if (!asset) return false;
+  ssize_t length = allocate_for_asset(asset, out);
+  const void* buffer = length == -1 ? nullptr : AAsset_getBuffer(asset);
+  if (!buffer) {
+    if (length != -1) perror("Error getting asset buffer");
+    AAsset_close(asset);
+    return false;
+  }
+  phase_end(Phase::kMap);
+
+  memcpy(out->data(), buffer, length);
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), length);
+  phase_end(Phase::kCallback);
+
+  AAsset_close(asset);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool asset_get_buffer_multiple_go(const char* path, int n, FileBuffer* out,
+                                  const ChunkReady& ready) {
+  AAsset* asset = open_asset(path, AASSET_MODE_BUFFER);
+  if (!asset) return false;
+  ssize_t length = allocate_for_asset(asset, out);
+  const char* buffer = length == -1
+                           ? nullptr
+                           : static_cast<const char*>(AAsset_getBuffer(asset));
+  if (!buffer) {
+    if (length != -1) perror("Error getting asset buffer");
+    AAsset_close(asset);
+    return false;
+  }
+  phase_end(Phase::kMap);
+
+  for_each_piece(length, n, out, ready, [out, buffer](size_t offset,
+                                                      size_t size) {
+    memcpy(out->data() + offset, buffer + offset, size);
+    return true;
+  });
+
+  AAsset_close(asset);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+// AAsset_read front to back, as a decoder consuming the asset would.
+bool asset_streaming_one_go(const char* path, int, FileBuffer* out,
+                            const ChunkReady& ready) {
+  AAsset* asset = open_asset(path, AASSET_MODE_STREAMING);
+  if (!asset) return false;
+  ssize_t length = allocate_for_asset(asset, out);
+  if (length == -1) {
+    AAsset_close(asset);
+    return false;
+  }
+
+  if (asset_read_fully(asset, out->data(), length) == -1) {
+    perror("Error reading asset");
+    AAsset_close(asset);
+    return false;
+  }
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), length);
+  phase_end(Phase::kCallback);
+
+  AAsset_close(asset);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+// AAsset_seek + AAsset_read per shuffled piece.
+bool asset_random_multiple_go(const char* path, int n, FileBuffer* out,
+                              const ChunkReady& ready) {
+  AAsset* asset = open_asset(path, AASSET_MODE_RANDOM);
+  if (!asset) return false;
+  ssize_t length = allocate_for_asset(asset, out);
+  if (length == -1) {
+    AAsset_close(asset);
+    return false;
+  }
+
+  bool ok = for_each_piece(length, n, out, ready, [out, asset](size_t offset,
+                                                               size_t size) {
+    return AAsset_seek64(asset, offset, SEEK_SET) != -1 &&
+           asset_read_fully(asset, out->data() + offset, size) == 0;
+  });
+  if (!ok) perror("Error reading asset");
+
+  AAsset_close(asset);
+  phase_end(Phase::kClose);
+  return ok;
+}
+
+// The asset's range of the APK via AAsset_openFileDescriptor64, then plain
+// preads: one for the whole asset, or one per shuffled piece.
+bool with_asset_fd(const char* path, int n, FileBuffer* out,
+                   const ChunkReady& ready, bool pieces) {
+  AAsset* asset = open_asset(path, AASSET_MODE_UNKNOWN);
+  if (!asset) return false;
+  off64_t start = 0;
+  off64_t asset_length = 0;
+  int fd = AAsset_openFileDescriptor64(asset, &start, &asset_length);
+  int saved_errno = errno;
+  AAsset_close(asset);
+  if (fd == -1) {
+    // ENOTSUP for compressed assets, which have no range of their own in
+    // the APK.
+    errno = saved_errno;
+    perror("Error opening asset descriptor");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  size_t length;
+  if (buffer_size_for(asset_length, &length) == -1 ||
+      allocate_output(out, length) == -1) {
+    perror("Error allocating output");
+    close(fd);
+    return false;
+  }
+
+  bool ok;
+  if (pieces) {
+    ok = for_each_piece(length, n, out, ready, [out, fd, start](size_t offset,
+                                                                size_t size) {
+      return pread_fully(fd, out->data() + offset, size, start + offset) == 0;
+    });
+  } else {
+    ok = pread_fully(fd, out->data(), length, start) == 0;
+    phase_end(Phase::kRead);
+    if (ok && ready) ready(out->data(), length);
+    phase_end(Phase::kCallback);
+  }
+  if (!ok) perror("Error reading asset");
+
+  close(fd);
+  phase_end(Phase::kClose);
+  return ok;
+}
+
+bool asset_fd_one_go(const char* path, int n, FileBuffer* out,
+                     const ChunkReady& ready) {
+  return with_asset_fd(path, n, out, ready, false);
+}
+
+bool asset_fd_multiple_go(const char* path, int n, FileBuffer* out,
+                          const ChunkReady& ready) {
+  return with_asset_fd(path, n, out, ready, true);
+}
+
+// The asset mapped straight out of the APK through ZipArchive, without
+// AAssetManager and without init()'s extraction: openWithMmapOneGo on a
+// range of the archive.
+bool apk_mmap_one_go(const char* path, int, FileBuffer* out,
+                     const ChunkReady& ready) {
+  static std::mutex mutex;
+  static std::map<std::string, std::unique_ptr<ZipArchive>> archives;
+  const ZipArchive* archive;
+  {
+    // Opened once per process, like the asset manager above.
+    std::lock_guard<std::mutex> lock(mutex);
+    std::unique_ptr<ZipArchive>& cached = archives[path];
+    if (!cached) {
+      auto opened = std::make_unique<ZipArchive>();
+      if (opened->open(path) == -1) {
+        perror("Error opening APK");
+        return false;
+      }
+      cached = std::move(opened);
+    }
+    archive = cached.get();
+  }
+  const ZipEntry* entry =
+      archive->find(std::string("assets/") + kAssetFileName);
+  ZipSpan span;
+  if (!entry) errno = ENOENT;
+  if (!entry || span.map(*archive, *entry) == -1) {
+    perror("Error mapping asset");
+    return false;
+  }
+  phase_end(Phase::kMap);
+
+  if (allocate_output(out, span.size()) == -1) {
+    perror("Error allocating output");
+    return false;
+  }
+  memcpy(out->data(), span.data(), span.size());
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), span.size());
+  phase_end(Phase::kCallback);
+
+  span.unmap();
+  phase_end(Phase::kClose);
+  return true;
+}
+
+}  // namespace
+
+const std::vector<ReadStrategy>& asset_strategies() {
+  static const std::vector<ReadStrategy> kStrategies = {
+      {"assetGetBufferOneGo", false, asset_get_buffer_one_go},
+      {"assetGetBufferMultipleGo", true, asset_get_buffer_multiple_go},
+      {"assetStreamingOneGo", false, asset_streaming_one_go},
+      {"assetRandomMultipleGo", true, asset_random_multiple_go},
+      {"assetFdOneGo", false, asset_fd_one_go},
+      {"assetFdMultipleGo", true, asset_fd_multiple_go},
+      {"apkMmapOneGo", false, apk_mmap_one_go},
+  };
+  return kStrategies;
+}
@@ -0,0 +1,17 @@
+// The Android app's AAssetManager strategies, run against the Linux
+// stand-in in asset-manager.h.
+
+#pragma once
+
+#include <vector>
+
+#include "read-strategies.h"
+
+// The asset native-lib.cpp reads; `read-file asset` packs the file under
+// test into an APK under this name.
+constexpr const char* kAssetFileName = "random_content.txt";
+
+// Each strategy reads the asset kAssetFileName out of the APK at `path`
+// instead of a plain file, so they slot into the same ReadStrategy harness
+// as the file strategies.
+const std::vector<ReadStrategy>& asset_strategies();
@@ -0,0 +1,128 @@
+#include "async-file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "read-loop.h"
+
+namespace {
+
+// Reads smaller than this aren't worth splitting across threads.
+constexpr size_t kMinSliceSize = 8 << 20;
+// Cancellation is checked between reads of this size.
+constexpr size_t kStepSize = 1 << 20;
+
+}  // namespace
+
+ReadOperation::ReadOperation(ThreadPool* pool, int fd, off_t offset,
+                             size_t length, CancellationToken token)
+    : pool_(pool),
+      fd_(fd),
+      offset_(offset),
+      length_(length),
+      token_(std::move(token)) {}
+
+bool ReadOperation::await_ready() const noexcept {
+  return length_ == 0 || token_.cancelled();
+}
+
+bool ReadOperation::await_suspend(std::coroutine_handle<> awaiting) {
+  awaiting_ = awaiting;
+  if (result_.buffer.allocate(length_) == -1) {
+    result_.error = errno;
+    return false;
+  }
+
+  size_t slices = std::min(pool_->size(),
+                           (length_ + kMinSliceSize - 1) / kMinSliceSize);
+  if (slices == 0) slices = 1;
+  size_t slice_size = (length_ + slices - 1) / slices;
+  pending_ = slices;
+
+  // The last slice to finish resumes the coroutine, which destroys this
+  // operation; so everything needed for posting is copied to locals first
+  // and `this` isn't touched after the final post().
+  ThreadPool* pool = pool_;
+  off_t offset = offset_;
+  char* dest = result_.buffer.data();
+  size_t remaining = length_;
+  for (size_t i = 0; i < slices; ++i) {
+    size_t n = std::min(slice_size, remaining);
+    remaining -= n;
+    pool->post([this, offset, dest, n] { read_slice(offset, dest, n); });
+    offset += n;
+    dest += n;
+  }
+  return true;
+}
+
+AsyncReadResult ReadOperation::await_resume() {
+  if (length_ > 0 && !result_.buffer.data() && result_.error == 0) {
+    // await_ready() skipped the read because the token was already set.
+    result_.error = ECANCELED;
+  }
+  return std::move(result_);
+}
+
+void ReadOperation::read_slice(off_t offset, char* dest, size_t length) {
+  size_t done = 0;
+  while (done < length && error_.load(std::memory_order_relaxed) == 0) {
+    if (token_.cancelled()) {
+      int expected = 0;
+      error_.compare_exchange_strong(expected, ECANCELED);
+      break;
+    }
+    size_t step = std::min(kStepSize, length - done);
+    if (pread_fully(fd_, dest + done, step, offset + done, step) == -1) {
+      int expected = 0;
+      error_.compare_exchange_strong(expected, errno);
+      break;
+    }
+    done += step;
+  }
+  finish_slice();
+}
+
+void ReadOperation::finish_slice() {
+  if (pending_.fetch_sub(1) != 1) return;
+  result_.error = error_.load();
+  awaiting_.resume();
+}
+
+AsyncFileReader::~AsyncFileReader() {
+  if (fd_ != -1) close(fd_);
+}
+
+int AsyncFileReader::open(const char* path) {
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+
+  struct stat sb;
+  size_t size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &size) == -1) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  if (fd_ != -1) close(fd_);
+  fd_ = fd;
+  size_ = size;
+  return 0;
+}
+
+ReadOperation AsyncFileReader::read(off_t offset, size_t length,
+                                    CancellationToken token) {
+  size_t start = std::min(static_cast<size_t>(offset), size_);
+  length = std::min(length, size_ - start);
+  return ReadOperation(pool_, fd_, start, length, std::move(token));
+}
+
+ReadOperation AsyncFileReader::read_all(CancellationToken token) {
+  return read(0, size_, std::move(token));
+}
@@ -0,0 +1,351 @@
+// Coroutine-based async file reads. A read is posted to a ThreadPool and the
+// awaiting coroutine is resumed on a pool thread when the data is in, so no
+// thread of the caller's is blocked while a load is in flight:
+//
+//   Task<size_t> load(AsyncFileReader& reader) {
+//     AsyncReadResult result = co_await reader.read_all();
+//     co_return result.error ? 0 : result.buffer.size();
+//   }
+//
+// Blocking callers can drive a task with sync_wait(). Errors are reported
+// through AsyncReadResult::error (an errno value, ECANCELED when cancelled).
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "read-strategies.h"
+#include "thread-pool.h"
+
+// Lazily started coroutine producing a T; runs when first co_awaited.
+template <typename T>
+class Task;
+
+namespace detail {
+
+template <typename Promise>
+struct FinalAwaiter {
+  bool await_ready() noexcept { return false; }
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> handle) noexcept {
+    std::coroutine_handle<> continuation = handle.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+  }
+  void await_resume() noexcept {}
+};
+
+struct PromiseBase {
+  std::coroutine_handle<> continuation;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  // Nothing in this project throws; an escaping exception is a bug.
+  void unhandled_exception() { std::terminate(); }
+};
+
+}  // namespace detail
+
+template <typename T>
+class Task {
+ public:
+  struct promise_type : detail::PromiseBase {
+    std::optional<T> value;
+
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    detail::FinalAwaiter<promise_type> final_suspend() noexcept { return {}; }
+    void return_value(T result) { value = std::move(result); }
+  };
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (handle_) handle_.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+  T await_resume() { return std::move(*handle_.promise().value); }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+template <>
+class Task<void> {
+ public:
+  struct promise_type : detail::PromiseBase {
+    Task get_return_object() {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    detail::FinalAwaiter<promise_type> final_suspend() noexcept { return {}; }
+    void return_void() {}
+  };
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (handle_) handle_.destroy();
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+    handle_.promise().continuation = awaiting;
+    return handle_;
+  }
+  void await_resume() {}
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+struct SyncWaitState {
+  std::mutex mutex;
+  std::condition_variable done_cv;
+  bool done = false;
+};
+
+// Coroutine that awaits a task and then wakes the thread in sync_wait().
+struct SyncWaitCoroutine {
+  struct promise_type {
+    SyncWaitState* state = nullptr;
+
+    SyncWaitCoroutine get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    auto final_suspend() noexcept {
+      struct Notify {
+        bool await_ready() noexcept { return false; }
+        void await_suspend(
+            std::coroutine_handle<promise_type> handle) noexcept {
+          SyncWaitState* state = handle.promise().state;
+          std::lock_guard<std::mutex> lock(state->mutex);
+          state->done = true;
+          state->done_cv.notify_one();
+        }
+        void await_resume() noexcept {}
+      };
+      return Notify{};
+    }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+SyncWaitCoroutine await_into(Task<T>& task, std::optional<T>* out) {
+  out->emplace(co_await task);
+}
+
+inline SyncWaitCoroutine await_into(Task<void>& task, std::optional<bool>*) {
+  co_await task;
+}
+
+template <typename T, typename Out>
+void run_and_wait(Task<T>& task, std::optional<Out>* out) {
+  SyncWaitState state;
+  SyncWaitCoroutine coroutine = await_into(task, out);
+  coroutine.handle.promise().state = &state;
+  coroutine.handle.resume();
+  {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.done_cv.wait(lock, [&state] { return state.done; });
+  }
+  coroutine.handle.destroy();
+}
+
+}  // namespace detail
+
+// Runs `task` to completion, blocking the calling thread.
+template <typename T>
+T sync_wait(Task<T> task) {
+  std::optional<T> result;
+  detail::run_and_wait(task, &result);
+  return std::move(*result);
+}
+
+inline void sync_wait(Task<void> task) {
+  std::optional<bool> unused;
+  detail::run_and_wait(task, &unused);
+}
+
+namespace detail {
+
+struct WhenAllState {
+  std::atomic<size_t> pending{0};
+  std::coroutine_handle<> parent;
+};
+
+// Fire-and-forget coroutine that frees itself when it finishes.
+struct DetachedCoroutine {
+  struct promise_type {
+    DetachedCoroutine get_return_object() {
+      return {std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T>
+DetachedCoroutine await_one(Task<T>& task, std::optional<T>* out,
+                            WhenAllState* state) {
+  out->emplace(co_await task);
+  if (state->pending.fetch_sub(1) == 1) state->parent.resume();
+}
+
+template <typename T>
+struct WhenAllAwaiter {
+  std::vector<Task<T>>& tasks;
+  std::vector<std::optional<T>>& results;
+  WhenAllState state;
+
+  bool await_ready() const noexcept { return tasks.empty(); }
+  bool await_suspend(std::coroutine_handle<> parent) {
+    // One extra count held while starting, so a task finishing inline
+    // can't resume the parent before every task has been started.
+    state.pending = tasks.size() + 1;
+    state.parent = parent;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      await_one(tasks[i], &results[i], &state).handle.resume();
+    }
+    return state.pending.fetch_sub(1) != 1;
+  }
+  void await_resume() noexcept {}
+};
+
+}  // namespace detail
+
+// Runs all `tasks` concurrently and completes when the last one does. The
+// awaiting coroutine is suspended, not blocked, in the meantime.
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+  std::vector<std::optional<T>> results(tasks.size());
+  co_await detail::WhenAllAwaiter<T>{tasks, results, {}};
+  std::vector<T> values;
+  values.reserve(results.size());
+  for (std::optional<T>& result : results) values.push_back(std::move(*result));
+  co_return values;
+}
+
+// Cooperative cancellation: reads check the token before each slice and
+// finish with ECANCELED once it's set.
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+  bool cancelled() const {
+    return flag_ && flag_->load(std::memory_order_relaxed);
+  }
+
+ private:
+  friend class CancellationSource;
+  explicit CancellationToken(std::shared_ptr<std::atomic<bool>> flag)
+      : flag_(std::move(flag)) {}
+
+  std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+class CancellationSource {
+ public:
+  CancellationSource() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+  CancellationToken token() const { return CancellationToken(flag_); }
+  void cancel() { flag_->store(true, std::memory_order_relaxed); }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+struct AsyncReadResult {
+  FileBuffer buffer;
+  int error = 0;
+};
+
+// Awaitable for one read. Large reads are split into slices that run on
+// several pool threads at once; the coroutine resumes when the last one is
+// done, on the thread that finished it.
+class ReadOperation {
+ public:
+  ReadOperation(ThreadPool* pool, int fd, off_t offset, size_t length,
+                CancellationToken token);
+
+  bool await_ready() const noexcept;
+  // Returns false, resuming right away with the error set, when the buffer
+  // can't be allocated.
+  bool await_suspend(std::coroutine_handle<> awaiting);
+  AsyncReadResult await_resume();
+
+ private:
+  void read_slice(off_t offset, char* dest, size_t length);
+  void finish_slice();
+
+  ThreadPool* pool_;
+  int fd_;
+  off_t offset_;
+  size_t length_;
+  CancellationToken token_;
+  std::coroutine_handle<> awaiting_;
+  std::atomic<size_t> pending_{0};
+  std::atomic<int> error_{0};
+  AsyncReadResult result_;
+};
+
+class AsyncFileReader {
+ public:
+  explicit AsyncFileReader(ThreadPool* pool) : pool_(pool) {}
+  ~AsyncFileReader();
+  AsyncFileReader(const AsyncFileReader&) = delete;
+  AsyncFileReader& operator=(const AsyncFileReader&) = delete;
+
+  // Returns 0 on success, -1 with errno set.
+  int open(const char* path);
+  size_t size() const { return size_; }
+
+  // Reads [offset, offset + length), clamped to the end of the file.
+  ReadOperation read(off_t offset, size_t length,
+                     CancellationToken token = CancellationToken());
+  ReadOperation read_all(CancellationToken token = CancellationToken());
+
+ private:
+  ThreadPool* pool_;
+  int fd_ = -1;
+  size_t size_ = 0;
+};
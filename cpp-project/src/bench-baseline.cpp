@@ -0,0 +1,241 @@
+#include "bench-baseline.h"
+
+#include <errno.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+double median(std::vector<double> values) {
+  if (values.empty()) return 0;
+  size_t middle = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + middle, values.end());
+  double upper = values[middle];
+  if (values.size() % 2 == 1) return upper;
+  double lower = *std::max_element(values.begin(), values.begin() + middle);
+  return (lower + upper) / 2;
+}
+
+int verdict_rank(BenchVerdict verdict) {
+  switch (verdict) {
+    case BenchVerdict::kSlower:
+      return 0;
+    case BenchVerdict::kMissing:
+      return 1;
+    case BenchVerdict::kFaster:
+      return 2;
+    case BenchVerdict::kNew:
+      return 3;
+    case BenchVerdict::kOk:
+      return 4;
+  }
+  return 5;
+}
+
+}  // namespace
+
+const BaselineEntry* Baseline::find(const std::string& name) const {
+  for (const BaselineEntry& entry : entries) {
+    if (entry.name == name) return &entry;
+  }
+  return nullptr;
+}
+
+std::string machine_class() {
+  const char* override_class = getenv("FILEREAD_MACHINE_CLASS");
+  if (override_class && *override_class) return override_class;
+  struct utsname name;
+  std::string arch = uname(&name) == 0 ? name.machine : "unknown";
+  return arch + "-" + std::to_string(sysconf(_SC_NPROCESSORS_ONLN)) + "cpu";
+}
+
+int load_baseline(const char* path, Baseline* out) {
+  errno = 0;
+  std::ifstream file(path);
+  if (!file) {
+    if (errno == 0) errno = ENOENT;
+    return -1;
+  }
+  Baseline baseline;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string kind;
+    if (!(fields >> kind) || kind[0] == '#') continue;
+    if (kind == "file_size") {
+      fields >> baseline.file_size;
+    } else if (kind == "pieces") {
+      fields >> baseline.pieces;
+    } else if (kind == "threshold") {
+      fields >> baseline.threshold_pct;
+    } else if (kind == "strategy") {
+      BaselineEntry entry;
+      fields >> entry.name >> entry.median_ms >> entry.noise_pct;
+      if (fields.fail()) {
+        errno = EINVAL;
+        return -1;
+      }
+      if (!(fields >> entry.threshold_pct)) entry.threshold_pct = 0;
+      baseline.entries.push_back(entry);
+      continue;
+    } else {
+      errno = EINVAL;
+      return -1;
+    }
+    if (fields.fail()) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+  *out = std::move(baseline);
+  return 0;
+}
+
+int save_baseline(const char* path, const std::string& machine,
+                  const Baseline& baseline) {
+  FILE* file = fopen(path, "w");
+  if (!file) return -1;
+  fprintf(file, "# read-file bench baseline for %s\n", machine.c_str());
+  fprintf(file, "# strategy <name> <median_ms> <noise_pct> [threshold_pct]\n");
+  fprintf(file, "file_size %zu\n", baseline.file_size);
+  fprintf(file, "pieces %d\n", baseline.pieces);
+  if (baseline.threshold_pct > 0) {
+    fprintf(file, "threshold %.1f\n", baseline.threshold_pct);
+  }
+  for (const BaselineEntry& entry : baseline.entries) {
+    fprintf(file, "strategy %s %.3f %.1f", entry.name.c_str(), entry.median_ms,
+            entry.noise_pct);
+    if (entry.threshold_pct > 0) fprintf(file, " %.1f", entry.threshold_pct);
+    fprintf(file, "\n");
+  }
+  if (fclose(file) != 0) return -1;
+  return 0;
+}
+
+BaselineEntry summarize_runs(const std::string& name,
+                             std::vector<double> runs_ms) {
+  BaselineEntry entry;
+  entry.name = name;
+  entry.median_ms = median(runs_ms);
+  if (entry.median_ms > 0) {
+    for (double& ms : runs_ms) ms = std::fabs(ms - entry.median_ms);
+    entry.noise_pct = median(runs_ms) / entry.median_ms * 100;
+  }
+  return entry;
+}
+
+const char* bench_verdict_name(BenchVerdict verdict) {
+  switch (verdict) {
+    case BenchVerdict::kOk:
+      return "ok";
+    case BenchVerdict::kFaster:
+      return "FASTER";
+    case BenchVerdict::kSlower:
+      return "SLOWER";
+    case BenchVerdict::kNew:
+      return "new";
+    case BenchVerdict::kMissing:
+      return "missing";
+  }
+  return "unknown";
+}
+
+std::vector<BenchComparison> compare_to_baseline(
+    const Baseline& baseline, const std::vector<BaselineEntry>& current,
+    const BenchThresholds& thresholds) {
+  std::vector<BenchComparison> comparisons;
+  for (const BaselineEntry& result : current) {
+    BenchComparison comparison;
+    comparison.name = result.name;
+    comparison.current_ms = result.median_ms;
+    const BaselineEntry* entry = baseline.find(result.name);
+    if (!entry) {
+      comparison.verdict = BenchVerdict::kNew;
+      comparisons.push_back(comparison);
+      continue;
+    }
+    comparison.baseline_ms = entry->median_ms;
+    if (entry->median_ms > 0) {
+      comparison.delta_pct =
+          (result.median_ms - entry->median_ms) / entry->median_ms * 100;
+    }
+    double threshold = thresholds.slowdown_pct;
+    if (baseline.threshold_pct > 0) threshold = baseline.threshold_pct;
+    if (entry->threshold_pct > 0) threshold = entry->threshold_pct;
+    comparison.allowed_pct =
+        std::max(threshold, thresholds.noise_factor * entry->noise_pct);
+    double delta_ms = result.median_ms - entry->median_ms;
+    if (std::fabs(delta_ms) >= thresholds.min_delta_ms &&
+        std::fabs(comparison.delta_pct) > comparison.allowed_pct) {
+      comparison.verdict =
+          delta_ms > 0 ? BenchVerdict::kSlower : BenchVerdict::kFaster;
+    }
+    comparisons.push_back(comparison);
+  }
+  for (const BaselineEntry& entry : baseline.entries) {
+    bool ran = std::any_of(current.begin(), current.end(),
+                           [&entry](const BaselineEntry& result) {
+                             return result.name == entry.name;
+                           });
+    if (ran) continue;
+    BenchComparison comparison;
+    comparison.name = entry.name;
+    comparison.baseline_ms = entry.median_ms;
+    comparison.verdict = BenchVerdict::kMissing;
+    comparisons.push_back(comparison);
+  }
+  return comparisons;
+}
+
+bool has_regression(const std::vector<BenchComparison>& comparisons) {
+  return std::any_of(comparisons.begin(), comparisons.end(),
+                     [](const BenchComparison& comparison) {
+                       return comparison.verdict == BenchVerdict::kSlower;
+                     });
+}
+
+std::string format_bench_report(
+    const std::vector<BenchComparison>& comparisons) {
+  std::vector<BenchComparison> sorted = comparisons;
+  std::stable_sort(sorted.begin(), sorted.end(),
+                   [](const BenchComparison& a, const BenchComparison& b) {
+                     return verdict_rank(a.verdict) < verdict_rank(b.verdict);
+                   });
+  // The name column fits the longest name.
+  int width = strlen("strategy");
+  for (const BenchComparison& comparison : sorted) {
+    width = std::max(width, static_cast<int>(comparison.name.size()));
+  }
+  std::string report;
+  std::vector<char> buffer(width + 128);
+  char* line = buffer.data();
+  snprintf(line, buffer.size(), "%-8s %-*s %13s %13s %9s %9s\n", "verdict",
+           width, "strategy", "baseline", "current", "delta", "allowed");
+  report += line;
+  for (const BenchComparison& comparison : sorted) {
+    const char* name = comparison.name.c_str();
+    const char* verdict = bench_verdict_name(comparison.verdict);
+    if (comparison.verdict == BenchVerdict::kNew) {
+      snprintf(line, buffer.size(), "%-8s %-*s %13s %10.3f ms\n", verdict,
+               width, name, "-", comparison.current_ms);
+    } else if (comparison.verdict == BenchVerdict::kMissing) {
+      snprintf(line, buffer.size(), "%-8s %-*s %10.3f ms %13s\n", verdict,
+               width, name, comparison.baseline_ms, "-");
+    } else {
+      snprintf(line, buffer.size(),
+               "%-8s %-*s %10.3f ms %10.3f ms %+8.1f%% %8.1f%%\n", verdict,
+               width, name, comparison.baseline_ms, comparison.current_ms,
+               comparison.delta_pct, comparison.allowed_pct);
+    }
+    report += line;
+  }
+  return report;
+}
@@ -0,0 +1,92 @@
+// Stored benchmark baselines and the regression check against them.
+//
+// A baseline is a small text file per machine class (one per kind of machine
+// the benchmarks run on, since timings from a laptop and a CI runner can't be
+// compared), holding the median time and run-to-run noise of every strategy:
+//
+//   # comment
+//   file_size 67108864
+//   pieces 100
+//   threshold 15
+//   strategy openOneGo 12.345 1.8
+//   strategy preadvMultipleGo 14.020 2.5 20
+//
+// The strategy lines are "strategy <name> <median_ms> <noise_pct>
+// [threshold_pct]". The optional last field overrides the slowdown threshold
+// for that strategy, and the optional "threshold" line overrides it for the
+// whole machine class (shared CI runners need more slack than a quiet
+// workstation).
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct BaselineEntry {
+  std::string name;
+  double median_ms = 0;
+  // Median absolute deviation of the runs, in percent of the median.
+  double noise_pct = 0;
+  // 0 means use Baseline::threshold_pct.
+  double threshold_pct = 0;
+};
+
+struct Baseline {
+  size_t file_size = 0;
+  int pieces = 0;
+  // 0 means use BenchThresholds::slowdown_pct.
+  double threshold_pct = 0;
+  std::vector<BaselineEntry> entries;
+
+  const BaselineEntry* find(const std::string& name) const;
+};
+
+// "<arch>-<cpus>cpu", e.g. "x86_64-8cpu", unless FILEREAD_MACHINE_CLASS is
+// set in the environment.
+std::string machine_class();
+
+// Both return 0 on success, -1 with errno set (EINVAL for a malformed file).
+int load_baseline(const char* path, Baseline* out);
+int save_baseline(const char* path, const std::string& machine,
+                  const Baseline& baseline);
+
+// Median and noise (as in BaselineEntry) of a set of run times.
+BaselineEntry summarize_runs(const std::string& name,
+                             std::vector<double> runs_ms);
+
+struct BenchThresholds {
+  // A strategy regressed when it got slower than its baseline by more than
+  // all of these.
+  double slowdown_pct = 10;
+  // Multiple of the baseline's own noise that still counts as noise.
+  double noise_factor = 3;
+  // Differences below this are timer and scheduling jitter.
+  double min_delta_ms = 0.5;
+};
+
+enum class BenchVerdict { kOk, kFaster, kSlower, kNew, kMissing };
+
+const char* bench_verdict_name(BenchVerdict verdict);
+
+struct BenchComparison {
+  std::string name;
+  double baseline_ms = 0;
+  double current_ms = 0;
+  double delta_pct = 0;
+  // The slowdown that was tolerated for this strategy.
+  double allowed_pct = 0;
+  BenchVerdict verdict = BenchVerdict::kOk;
+};
+
+// Compares every current result with its baseline entry. Strategies only in
+// the baseline are reported as kMissing, only in `current` as kNew.
+std::vector<BenchComparison> compare_to_baseline(
+    const Baseline& baseline, const std::vector<BaselineEntry>& current,
+    const BenchThresholds& thresholds);
+
+bool has_regression(const std::vector<BenchComparison>& comparisons);
+
+// Table of the comparisons, regressions first, for the test log.
+std::string format_bench_report(
+    const std::vector<BenchComparison>& comparisons);
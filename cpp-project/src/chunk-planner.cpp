@@ -0,0 +1,326 @@
+#include "chunk-planner.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILEREAD_X86 1
+#define FILEREAD_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace {
+
+class FixedPlanner : public ChunkPlanner {
+ public:
+  explicit FixedPlanner(int pieces) : pieces_(std::max(pieces, 1)) {}
+
+  const char* name() const override { return "fixed"; }
+  std::vector<FileExtent> plan(const char*, size_t size) const override {
+    size_t piece_size = size / pieces_;
+    std::vector<FileExtent> chunks;
+    chunks.reserve(pieces_);
+    for (int index = 0; index < pieces_; ++index) {
+      size_t offset = index * piece_size;
+      size_t length =
+          index == pieces_ - 1 ? size - piece_size * (pieces_ - 1) : piece_size;
+      chunks.push_back({static_cast<off_t>(offset), length});
+    }
+    return chunks;
+  }
+
+ private:
+  const int pieces_;
+};
+
+class PageAlignedPlanner : public ChunkPlanner {
+ public:
+  explicit PageAlignedPlanner(size_t chunk_size) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    chunk_size_ = std::max(page, (chunk_size + page - 1) / page * page);
+  }
+
+  const char* name() const override { return "page"; }
+  std::vector<FileExtent> plan(const char*, size_t size) const override {
+    std::vector<FileExtent> chunks;
+    for (size_t offset = 0; offset < size; offset += chunk_size_) {
+      chunks.push_back(
+          {static_cast<off_t>(offset), std::min(chunk_size_, size - offset)});
+    }
+    return chunks;
+  }
+
+ private:
+  size_t chunk_size_;
+};
+
+// Gear hash: h = (h << 1) + kGear[byte]. A byte's contribution is shifted
+// out after 64 more, which is what lets segments be searched on their own.
+struct GearTable {
+  uint64_t values[256];
+};
+
+constexpr GearTable make_gear_table() {
+  GearTable table{};
+  uint64_t state = 0x5eed0fc0ffee5eed;
+  for (uint64_t& value : table.values) {
+    // splitmix64
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    value = z ^ (z >> 31);
+  }
+  return table;
+}
+
+constexpr GearTable kGear = make_gear_table();
+constexpr size_t kWindow = 64;
+constexpr size_t kLanes = 4;
+// Smallest segment worth a thread of its own.
+constexpr size_t kMinSegment = 1 << 20;
+
+// The top `bits` bits: those depend on the most bytes of the window.
+constexpr uint64_t high_bits(int bits) {
+  return bits >= 64 ? ~uint64_t{0} : ~uint64_t{0} << (64 - bits);
+}
+
+// A place where a chunk may end: the hash after the byte before `end`
+// matched the loose mask, and maybe the strict one too (its bits are a
+// superset, so strict matches are always loose ones).
+struct Candidate {
+  uint64_t end;
+  bool strict;
+};
+
+struct Masks {
+  uint64_t strict;
+  uint64_t loose;
+};
+
+uint64_t warm_up(const uint8_t* data, size_t begin) {
+  uint64_t hash = 0;
+  for (size_t i = begin >= kWindow ? begin - kWindow : 0; i < begin; ++i) {
+    hash = (hash << 1) + kGear.values[data[i]];
+  }
+  return hash;
+}
+
+void search_scalar(const uint8_t* data, size_t begin, size_t end, Masks masks,
+                   std::vector<Candidate>* out) {
+  uint64_t hash = warm_up(data, begin);
+  for (size_t i = begin; i < end; ++i) {
+    hash = (hash << 1) + kGear.values[data[i]];
+    if (!(hash & masks.loose)) out->push_back({i + 1, !(hash & masks.strict)});
+  }
+}
+
+// The segment split in kLanes parts whose hashes advance together, so the
+// shift-add chains overlap instead of waiting on each other. Candidates are
+// rare, so they are collected per lane and appended in order at the end.
+void search_lanes(const uint8_t* data, size_t begin, size_t end, Masks masks,
+                  std::vector<Candidate>* out) {
+  size_t lane_size = (end - begin) / kLanes;
+  size_t starts[kLanes];
+  uint64_t hashes[kLanes];
+  std::vector<Candidate> found[kLanes];
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    starts[lane] = begin + lane * lane_size;
+    hashes[lane] = warm_up(data, starts[lane]);
+  }
+  for (size_t i = 0; i < lane_size; ++i) {
+    bool any = false;
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      hashes[lane] = (hashes[lane] << 1) + kGear.values[data[starts[lane] + i]];
+      any |= !(hashes[lane] & masks.loose);
+    }
+    if (!any) continue;
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      if (!(hashes[lane] & masks.loose)) {
+        found[lane].push_back(
+            {starts[lane] + i + 1, !(hashes[lane] & masks.strict)});
+      }
+    }
+  }
+  for (const std::vector<Candidate>& lane : found) {
+    out->insert(out->end(), lane.begin(), lane.end());
+  }
+  search_scalar(data, begin + kLanes * lane_size, end, masks, out);
+}
+
+#ifdef FILEREAD_X86
+// search_lanes with the four hashes in one AVX2 register and the table
+// lookups done by a gather.
+FILEREAD_AVX2 void search_avx2(const uint8_t* data, size_t begin, size_t end,
+                               Masks masks, std::vector<Candidate>* out) {
+  size_t lane_size = (end - begin) / kLanes;
+  size_t starts[kLanes];
+  alignas(32) uint64_t hashes[kLanes];
+  std::vector<Candidate> found[kLanes];
+  for (size_t lane = 0; lane < kLanes; ++lane) {
+    starts[lane] = begin + lane * lane_size;
+    hashes[lane] = warm_up(data, starts[lane]);
+  }
+  const long long* table = reinterpret_cast<const long long*>(kGear.values);
+  const __m256i loose = _mm256_set1_epi64x(masks.loose);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i hash = _mm256_load_si256(reinterpret_cast<const __m256i*>(hashes));
+  for (size_t i = 0; i < lane_size; ++i) {
+    __m256i bytes = _mm256_set_epi64x(
+        data[starts[3] + i], data[starts[2] + i], data[starts[1] + i],
+        data[starts[0] + i]);
+    __m256i gear = _mm256_i64gather_epi64(table, bytes, 8);
+    hash = _mm256_add_epi64(_mm256_slli_epi64(hash, 1), gear);
+    __m256i hits = _mm256_cmpeq_epi64(_mm256_and_si256(hash, loose), zero);
+    int lanes = _mm256_movemask_pd(_mm256_castsi256_pd(hits));
+    if (!lanes) continue;
+    _mm256_store_si256(reinterpret_cast<__m256i*>(hashes), hash);
+    for (size_t lane = 0; lane < kLanes; ++lane) {
+      if (lanes & (1 << lane)) {
+        found[lane].push_back(
+            {starts[lane] + i + 1, !(hashes[lane] & masks.strict)});
+      }
+    }
+  }
+  for (const std::vector<Candidate>& lane : found) {
+    out->insert(out->end(), lane.begin(), lane.end());
+  }
+  search_scalar(data, begin + kLanes * lane_size, end, masks, out);
+}
+
+bool has_avx2() {
+  static const bool kHasAvx2 = __builtin_cpu_supports("avx2");
+  return kHasAvx2;
+}
+#endif
+
+using SearchFn = void (*)(const uint8_t*, size_t, size_t, Masks,
+                          std::vector<Candidate>*);
+
+SearchFn search_for(bool vectorized) {
+  if (!vectorized) return search_scalar;
+#ifdef FILEREAD_X86
+  if (has_avx2()) return search_avx2;
+#endif
+  return search_lanes;
+}
+
+class CdcPlanner : public ChunkPlanner {
+ public:
+  explicit CdcPlanner(const CdcOptions& options) : options_(options) {
+    size_t average = 1;
+    int bits = 0;
+    while (average < options_.average_size) {
+      average <<= 1;
+      ++bits;
+    }
+    bits = std::max(bits, 3);
+    options_.average_size = size_t{1} << bits;
+    options_.min_size = std::min(options_.min_size, options_.average_size);
+    options_.max_size = std::max(options_.max_size, options_.average_size);
+    // FastCDC's normalized chunking: harder to cut before the average size,
+    // easier after it, so sizes bunch up around the average.
+    masks_ = {high_bits(bits + 2), high_bits(bits - 2)};
+    if (options_.threads == 0) {
+      options_.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
+  const char* name() const override { return "cdc"; }
+  bool needs_content() const override { return true; }
+
+  std::vector<FileExtent> plan(const char* data, size_t size) const override {
+    return cut(find_candidates(reinterpret_cast<const uint8_t*>(data), size),
+               size);
+  }
+
+ private:
+  std::vector<Candidate> find_candidates(const uint8_t* data,
+                                         size_t size) const {
+    SearchFn search = search_for(options_.vectorized);
+    size_t segments =
+        std::max<size_t>(1, std::min(options_.threads, size / kMinSegment));
+    size_t segment_size = (size + segments - 1) / segments;
+    std::vector<std::vector<Candidate>> found(segments);
+    std::vector<std::thread> workers;
+    for (size_t segment = 1; segment < segments; ++segment) {
+      size_t begin = std::min(size, segment * segment_size);
+      size_t end = std::min(size, begin + segment_size);
+      workers.emplace_back(search, data, begin, end, masks_, &found[segment]);
+    }
+    search(data, 0, std::min(size, segment_size), masks_, &found[0]);
+    for (std::thread& worker : workers) worker.join();
+
+    std::vector<Candidate> candidates;
+    for (const std::vector<Candidate>& segment : found) {
+      candidates.insert(candidates.end(), segment.begin(), segment.end());
+    }
+    return candidates;
+  }
+
+  std::vector<FileExtent> cut(const std::vector<Candidate>& candidates,
+                              size_t size) const {
+    std::vector<FileExtent> chunks;
+    size_t next = 0;
+    size_t start = 0;
+    while (start < size) {
+      size_t remaining = size - start;
+      size_t end = start + std::min(options_.max_size, remaining);
+      if (remaining > options_.min_size) {
+        size_t min_end = start + options_.min_size;
+        size_t normal_end = start + std::min(options_.average_size, remaining);
+        while (next < candidates.size() && candidates[next].end <= min_end) {
+          ++next;
+        }
+        for (size_t i = next;
+             i < candidates.size() && candidates[i].end <= end; ++i) {
+          if (candidates[i].strict || candidates[i].end > normal_end) {
+            end = candidates[i].end;
+            break;
+          }
+        }
+      }
+      chunks.push_back({static_cast<off_t>(start), end - start});
+      start = end;
+    }
+    return chunks;
+  }
+
+  CdcOptions options_;
+  Masks masks_;
+};
+
+}  // namespace
+
+std::unique_ptr<ChunkPlanner> make_fixed_planner(int pieces) {
+  return std::make_unique<FixedPlanner>(pieces);
+}
+
+std::unique_ptr<ChunkPlanner> make_page_aligned_planner(size_t chunk_size) {
+  return std::make_unique<PageAlignedPlanner>(chunk_size);
+}
+
+std::unique_ptr<ChunkPlanner> make_cdc_planner(const CdcOptions& options) {
+  return std::make_unique<CdcPlanner>(options);
+}
+
+const char* cdc_kernel_name(const CdcOptions& options) {
+  if (!options.vectorized) return "scalar";
+#ifdef FILEREAD_X86
+  if (has_avx2()) return "avx2";
+#endif
+  return "lanes";
+}
+
+std::vector<ChunkRequest> chunk_requests(const std::vector<FileExtent>& chunks,
+                                         const std::vector<int>& order,
+                                         char* buffer) {
+  std::vector<ChunkRequest> requests;
+  requests.reserve(order.size());
+  for (int index : order) {
+    const FileExtent& chunk = chunks[index];
+    requests.push_back({chunk.offset, chunk.length, buffer + chunk.offset});
+  }
+  return requests;
+}
@@ -0,0 +1,66 @@
+// Ways of cutting a file into chunks.
+//
+// - "fixed": `pieces` chunks of size / pieces bytes, the last one carrying
+//   the remainder; what the multiple-go strategies have always done.
+// - "page": chunks of a target size rounded to whole pages, so every chunk
+//   starts on a page boundary (mmap offsets, O_DIRECT).
+// - "cdc": content-defined chunking in the FastCDC style. A gear rolling
+//   hash over the data picks the cut points, so inserting or deleting bytes
+//   only moves the boundaries next to the edit and every other chunk stays
+//   byte-identical, which is what deduplication and delta updates need.
+//
+// The CDC hash at any position only depends on the 64 bytes before it, so
+// cut candidates are found independently per segment of the file: segments
+// run on several threads, and within a thread optionally in interleaved
+// lanes (AVX2 when available). A cheap serial pass then applies the
+// min/normal/max size rules to the candidates. The result doesn't depend on
+// either.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "vectored-read.h"
+
+class ChunkPlanner {
+ public:
+  virtual ~ChunkPlanner() = default;
+
+  virtual const char* name() const = 0;
+  // True when plan() looks at the data; otherwise `data` may be null.
+  virtual bool needs_content() const { return false; }
+  // Chunks covering all of [0, size), in file order.
+  virtual std::vector<FileExtent> plan(const char* data, size_t size) const = 0;
+};
+
+std::unique_ptr<ChunkPlanner> make_fixed_planner(int pieces);
+std::unique_ptr<ChunkPlanner> make_page_aligned_planner(size_t chunk_size);
+
+struct CdcOptions {
+  size_t min_size = 16 << 10;
+  // Rounded to a power of two.
+  size_t average_size = 64 << 10;
+  size_t max_size = 256 << 10;
+  // Segments searched for cut candidates in parallel; 0 means one per
+  // hardware thread.
+  size_t threads = 1;
+  // Use the lane-parallel candidate search (AVX2 where the CPU has it)
+  // instead of the plain one-byte-at-a-time loop. The cut points are the
+  // same either way; turn it on where `read-file chunk` shows it faster.
+  bool vectorized = false;
+};
+
+std::unique_ptr<ChunkPlanner> make_cdc_planner(const CdcOptions& options);
+
+// "avx2", "lanes" (interleaved scalar lanes) or "scalar": what the CDC
+// candidate search runs with for `options` on this machine.
+const char* cdc_kernel_name(const CdcOptions& options);
+
+// `chunks` visited in `order` (indices into `chunks`), each copied to the
+// same offset of `buffer`.
+std::vector<ChunkRequest> chunk_requests(const std::vector<FileExtent>& chunks,
+                                         const std::vector<int>& order,
+                                         char* buffer);
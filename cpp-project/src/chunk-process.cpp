@@ -0,0 +1,285 @@
+#include "chunk-process.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FILEREAD_X86 1
+#define FILEREAD_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FILEREAD_NEON 1
+#endif
+
+namespace {
+
+size_t count_newlines_scalar(const char* data, size_t size) {
+  return std::count(data, data + size, '\n');
+}
+
+size_t count_non_printable_scalar(const char* data, size_t size) {
+  size_t count = 0;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char c = data[i];
+    count += c < '!' || c > '~';
+  }
+  return count;
+}
+
+// The vector loops below all count matches the same way: every byte lane
+// subtracts its 0xff (-1) compare mask, and the lanes are folded into the
+// total before 255 iterations can overflow them. They return how many bytes
+// they consumed; the caller finishes the tail with the scalar loop.
+
+#ifdef __SSE2__
+__m128i newline_mask_sse2(__m128i v) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+}
+
+// Signed compares: bytes from 0x80 up are negative, so below '!' too.
+__m128i non_printable_mask_sse2(__m128i v) {
+  return _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8('!')),
+                      _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+}
+
+template <__m128i (*Mask)(__m128i)>
+size_t count_sse2(const char* data, size_t size, size_t* count) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i total = zero;
+  size_t i = 0;
+  while (i + 16 <= size) {
+    __m128i lanes = zero;
+    for (int k = 0; k < 255 && i + 16 <= size; ++k, i += 16) {
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      lanes = _mm_sub_epi8(lanes, Mask(v));
+    }
+    total = _mm_add_epi64(total, _mm_sad_epu8(lanes, zero));
+  }
+  alignas(16) uint64_t parts[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(parts), total);
+  *count += parts[0] + parts[1];
+  return i;
+}
+#endif
+
+#ifdef FILEREAD_X86
+FILEREAD_AVX2 __m256i newline_mask_avx2(__m256i v) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+}
+
+FILEREAD_AVX2 __m256i non_printable_mask_avx2(__m256i v) {
+  return _mm256_or_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8('!'), v),
+                         _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7f)));
+}
+
+template <__m256i (*Mask)(__m256i)>
+FILEREAD_AVX2 size_t count_avx2(const char* data, size_t size,
+                                size_t* count) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i total = zero;
+  size_t i = 0;
+  while (i + 32 <= size) {
+    __m256i lanes = zero;
+    for (int k = 0; k < 255 && i + 32 <= size; ++k, i += 32) {
+      __m256i v =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+      lanes = _mm256_sub_epi8(lanes, Mask(v));
+    }
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(lanes, zero));
+  }
+  alignas(32) uint64_t parts[4];
+  _mm256_store_si256(reinterpret_cast<__m256i*>(parts), total);
+  *count += parts[0] + parts[1] + parts[2] + parts[3];
+  return i;
+}
+
+bool has_avx2() {
+  static const bool kHasAvx2 = __builtin_cpu_supports("avx2");
+  return kHasAvx2;
+}
+#endif
+
+#ifdef FILEREAD_NEON
+uint8x16_t newline_mask_neon(uint8x16_t v) {
+  return vceqq_u8(v, vdupq_n_u8('\n'));
+}
+
+uint8x16_t non_printable_mask_neon(uint8x16_t v) {
+  return vorrq_u8(vcltq_u8(v, vdupq_n_u8('!')), vcgtq_u8(v, vdupq_n_u8('~')));
+}
+
+template <uint8x16_t (*Mask)(uint8x16_t)>
+size_t count_neon(const char* data, size_t size, size_t* count) {
+  uint64_t total = 0;
+  size_t i = 0;
+  while (i + 16 <= size) {
+    uint8x16_t lanes = vdupq_n_u8(0);
+    for (int k = 0; k < 255 && i + 16 <= size; ++k, i += 16) {
+      uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+      lanes = vsubq_u8(lanes, Mask(v));
+    }
+    total += vaddlvq_u8(lanes);
+  }
+  *count += total;
+  return i;
+}
+#endif
+
+enum class Match { kNewline, kNonPrintable };
+
+// Runs the widest vector loop available for `match`.
+size_t count_vector(Match match, const char* data, size_t size,
+                    size_t* count) {
+  bool newline = match == Match::kNewline;
+#ifdef FILEREAD_X86
+  if (has_avx2()) {
+    return newline ? count_avx2<newline_mask_avx2>(data, size, count)
+                   : count_avx2<non_printable_mask_avx2>(data, size, count);
+  }
+#endif
+#if defined(__SSE2__)
+  return newline ? count_sse2<newline_mask_sse2>(data, size, count)
+                 : count_sse2<non_printable_mask_sse2>(data, size, count);
+#elif defined(FILEREAD_NEON)
+  return newline ? count_neon<newline_mask_neon>(data, size, count)
+                 : count_neon<non_printable_mask_neon>(data, size, count);
+#else
+  (void)newline;
+  (void)data;
+  (void)size;
+  (void)count;
+  return 0;
+#endif
+}
+
+class HistogramProcessor : public ChunkProcessor {
+ public:
+  const char* name() const override { return "histogram"; }
+  void reset() override { std::fill(counts_, counts_ + 256, 0); }
+  void process(const char* data, size_t size) override {
+    byte_histogram(data, size, counts_);
+  }
+  std::string result() const override {
+    uint64_t total = 0;
+    int distinct = 0;
+    int most_common = 0;
+    for (int value = 0; value < 256; ++value) {
+      total += counts_[value];
+      distinct += counts_[value] > 0;
+      if (counts_[value] > counts_[most_common]) most_common = value;
+    }
+    char text[128];
+    snprintf(text, sizeof(text),
+             "%llu bytes, %d distinct, most common 0x%02x (%llu)",
+             static_cast<unsigned long long>(total), distinct, most_common,
+             static_cast<unsigned long long>(counts_[most_common]));
+    return text;
+  }
+
+ private:
+  uint64_t counts_[256] = {};
+};
+
+class NewlineProcessor : public ChunkProcessor {
+ public:
+  const char* name() const override { return "newlines"; }
+  void reset() override { newlines_ = 0; }
+  void process(const char* data, size_t size) override {
+    newlines_ += count_newlines(data, size);
+  }
+  std::string result() const override {
+    return std::to_string(newlines_) + " newlines";
+  }
+
+ private:
+  size_t newlines_ = 0;
+};
+
+class AsciiProcessor : public ChunkProcessor {
+ public:
+  const char* name() const override { return "ascii"; }
+  void reset() override { invalid_ = 0; }
+  void process(const char* data, size_t size) override {
+    invalid_ += count_non_printable(data, size);
+  }
+  std::string result() const override {
+    if (invalid_ == 0) return "all printable";
+    return std::to_string(invalid_) + " non-printable bytes";
+  }
+
+ private:
+  size_t invalid_ = 0;
+};
+
+}  // namespace
+
+const std::vector<const char*>& chunk_processor_names() {
+  static const std::vector<const char*> kNames = {"histogram", "newlines",
+                                                  "ascii"};
+  return kNames;
+}
+
+std::unique_ptr<ChunkProcessor> make_chunk_processor(const char* name) {
+  std::unique_ptr<ChunkProcessor> processor;
+  if (strcmp(name, "histogram") == 0) {
+    processor.reset(new HistogramProcessor());
+  } else if (strcmp(name, "newlines") == 0) {
+    processor.reset(new NewlineProcessor());
+  } else if (strcmp(name, "ascii") == 0) {
+    processor.reset(new AsciiProcessor());
+  }
+  return processor;
+}
+
+const char* chunk_kernel_isa() {
+#ifdef FILEREAD_X86
+  if (has_avx2()) return "avx2";
+#endif
+#if defined(__SSE2__)
+  return "sse2";
+#elif defined(FILEREAD_NEON)
+  return "neon";
+#else
+  return "scalar";
+#endif
+}
+
+void byte_histogram(const char* data, size_t size, uint64_t counts[256]) {
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  // Four tables, so a run of the same byte doesn't make every increment
+  // wait for the previous store to the same counter. Blocks are small
+  // enough that the 32-bit counters can't overflow.
+  uint32_t tables[4][256];
+  while (size > 0) {
+    size_t block = std::min<size_t>(size, size_t{1} << 30);
+    memset(tables, 0, sizeof(tables));
+    size_t i = 0;
+    for (; i + 4 <= block; i += 4) {
+      ++tables[0][bytes[i]];
+      ++tables[1][bytes[i + 1]];
+      ++tables[2][bytes[i + 2]];
+      ++tables[3][bytes[i + 3]];
+    }
+    for (; i < block; ++i) ++tables[0][bytes[i]];
+    for (int value = 0; value < 256; ++value) {
+      counts[value] += uint64_t{tables[0][value]} + tables[1][value] +
+                       tables[2][value] + tables[3][value];
+    }
+    bytes += block;
+    size -= block;
+  }
+}
+
+size_t count_newlines(const char* data, size_t size) {
+  size_t count = 0;
+  size_t done = count_vector(Match::kNewline, data, size, &count);
+  return count + count_newlines_scalar(data + done, size - done);
+}
+
+size_t count_non_printable(const char* data, size_t size) {
+  size_t count = 0;
+  size_t done = count_vector(Match::kNonPrintable, data, size, &count);
+  return count + count_non_printable_scalar(data + done, size - done);
+}
@@ -0,0 +1,49 @@
+// Work done on every chunk a strategy reads, so benchmarks measure reading
+// plus processing rather than only the copy into memory.
+//
+// Built-in kernels:
+// - "histogram": count of every byte value, spread over four tables so
+//   repeated bytes don't serialize on one counter.
+// - "newlines": number of '\n' bytes.
+// - "ascii": checks that every byte is printable ASCII without spaces, i.e.
+//   what generate-file.py writes, and counts the bytes that are not.
+// The last two are vectorized with AVX2 (picked at run time), SSE2 or NEON,
+// with a scalar fallback elsewhere.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class ChunkProcessor {
+ public:
+  virtual ~ChunkProcessor() = default;
+
+  virtual const char* name() const = 0;
+  // Clears the accumulated result.
+  virtual void reset() = 0;
+  // Chunks can come in any order; results don't depend on it.
+  virtual void process(const char* data, size_t size) = 0;
+  // Short summary of the result, e.g. "0 newlines".
+  virtual std::string result() const = 0;
+};
+
+// Names of the built-in kernels, for usage messages.
+const std::vector<const char*>& chunk_processor_names();
+
+// Returns nullptr when there is no kernel called `name`.
+std::unique_ptr<ChunkProcessor> make_chunk_processor(const char* name);
+
+// Instruction set the kernels run with on this machine: "avx2", "sse2",
+// "neon" or "scalar".
+const char* chunk_kernel_isa();
+
+// The kernels, for callers that want the numbers rather than a summary.
+// byte_histogram() adds to `counts`.
+void byte_histogram(const char* data, size_t size, uint64_t counts[256]);
+size_t count_newlines(const char* data, size_t size);
+// Number of bytes outside '!'..'~'.
+size_t count_non_printable(const char* data, size_t size);
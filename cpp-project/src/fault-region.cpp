@@ -0,0 +1,328 @@
+#include "fault-region.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/userfaultfd.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include "read-loop.h"
+
+namespace {
+
+class FileSource : public PageSource {
+ public:
+  FileSource(int fd, size_t size) : fd_(fd), size_(size) {}
+  ~FileSource() override { close(fd_); }
+
+  const char* name() const override { return "file"; }
+  size_t size() const override { return size_; }
+  int fill(size_t offset, char* dest, size_t length) override {
+    return pread_fully(fd_, dest, length, static_cast<off_t>(offset));
+  }
+
+ private:
+  const int fd_;
+  const size_t size_;
+};
+
+class RangeSource : public PageSource {
+ public:
+  RangeSource(std::unique_ptr<PageSource> inner, size_t offset, size_t length)
+      : inner_(std::move(inner)), offset_(offset), length_(length) {}
+
+  const char* name() const override { return "range"; }
+  size_t size() const override { return length_; }
+  int fill(size_t offset, char* dest, size_t length) override {
+    return inner_->fill(offset_ + offset, dest, length);
+  }
+
+ private:
+  const std::unique_ptr<PageSource> inner_;
+  const size_t offset_;
+  const size_t length_;
+};
+
+class XorSource : public PageSource {
+ public:
+  XorSource(std::unique_ptr<PageSource> inner, uint8_t key)
+      : inner_(std::move(inner)), key_(key) {}
+
+  const char* name() const override { return "xor"; }
+  size_t size() const override { return inner_->size(); }
+  int fill(size_t offset, char* dest, size_t length) override {
+    if (inner_->fill(offset, dest, length) == -1) return -1;
+    for (size_t i = 0; i < length; ++i) dest[i] ^= key_;
+    return 0;
+  }
+
+ private:
+  const std::unique_ptr<PageSource> inner_;
+  const uint8_t key_;
+};
+
+// Eager fills go through the source in pieces this size.
+constexpr size_t kEagerFill = 1 << 20;
+
+}  // namespace
+
+std::unique_ptr<PageSource> make_file_source(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return nullptr;
+  struct stat sb;
+  size_t size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &size) == -1) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return nullptr;
+  }
+  return std::make_unique<FileSource>(fd, size);
+}
+
+std::unique_ptr<PageSource> make_range_source(
+    std::unique_ptr<PageSource> inner, size_t offset, size_t length) {
+  if (!inner || offset > inner->size() || length > inner->size() - offset) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return std::make_unique<RangeSource>(std::move(inner), offset, length);
+}
+
+std::unique_ptr<PageSource> make_xor_source(std::unique_ptr<PageSource> inner,
+                                            uint8_t key) {
+  if (!inner) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return std::make_unique<XorSource>(std::move(inner), key);
+}
+
+const char* fault_mode_name(FaultMode mode) {
+  switch (mode) {
+    case FaultMode::kUserfaultfd:
+      return "userfaultfd";
+    case FaultMode::kEager:
+      return "eager";
+  }
+  return "?";
+}
+
+FaultRegion::~FaultRegion() { close(); }
+
+int FaultRegion::open(std::unique_ptr<PageSource> source,
+                      const FaultRegionOptions& options) {
+  close();
+  if (!source) {
+    errno = EINVAL;
+    return -1;
+  }
+  source_ = std::move(source);
+  options_ = options;
+  size_ = source_->size();
+  page_size_ = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  mapped_size_ =
+      std::max((size_ + page_size_ - 1) / page_size_ * page_size_, page_size_);
+  faults_ = 0;
+  prefetched_pages_ = 0;
+  bytes_filled_ = 0;
+  fill_errors_ = 0;
+  error_ = 0;
+
+  if (!options_.force_eager && start_userfaultfd() == 0) {
+    mode_ = FaultMode::kUserfaultfd;
+    return 0;
+  }
+  fallback_error_ = options_.force_eager ? 0 : errno;
+  mode_ = FaultMode::kEager;
+  if (fill_eagerly() == -1) {
+    int saved_errno = errno;
+    close();
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+void FaultRegion::close() {
+  if (handler_.joinable()) {
+    char byte = 1;
+    while (write(wake_[1], &byte, 1) == -1 && errno == EINTR) {
+    }
+    handler_.join();
+  }
+  for (int& fd : wake_) {
+    if (fd != -1) ::close(fd);
+    fd = -1;
+  }
+  if (data_) munmap(data_, mapped_size_);
+  data_ = nullptr;
+  if (uffd_ != -1) ::close(uffd_);
+  uffd_ = -1;
+  source_.reset();
+  size_ = 0;
+  mapped_size_ = 0;
+  fallback_error_ = 0;
+  filled_.clear();
+  staging_.clear();
+}
+
+FaultRegion::Stats FaultRegion::stats() const {
+  Stats stats;
+  stats.faults = faults_.load(std::memory_order_relaxed);
+  stats.prefetched_pages = prefetched_pages_.load(std::memory_order_relaxed);
+  stats.bytes_filled = bytes_filled_.load(std::memory_order_relaxed);
+  stats.fill_errors = fill_errors_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+int FaultRegion::start_userfaultfd() {
+#if defined(__linux__) && defined(SYS_userfaultfd)
+  int flags = O_CLOEXEC | O_NONBLOCK;
+  int uffd = -1;
+#ifdef UFFD_USER_MODE_ONLY
+  // Only faults from user space, which is all we need; unlike a plain
+  // userfaultfd this is allowed without privileges (Linux 5.11+) even with
+  // vm.unprivileged_userfaultfd=0. Older kernels reject the flag.
+  uffd = static_cast<int>(
+      syscall(SYS_userfaultfd, flags | UFFD_USER_MODE_ONLY));
+#endif
+  if (uffd == -1) uffd = static_cast<int>(syscall(SYS_userfaultfd, flags));
+  if (uffd == -1) return -1;
+
+  struct uffdio_api api = {};
+  api.api = UFFD_API;
+  void* data = MAP_FAILED;
+  if (ioctl(uffd, UFFDIO_API, &api) == 0) {
+    data = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  }
+  struct uffdio_register registration = {};
+  registration.range.start = reinterpret_cast<uintptr_t>(data);
+  registration.range.len = mapped_size_;
+  registration.mode = UFFDIO_REGISTER_MODE_MISSING;
+  if (data == MAP_FAILED ||
+      ioctl(uffd, UFFDIO_REGISTER, &registration) == -1 || pipe(wake_) == -1) {
+    int saved_errno = errno;
+    if (data != MAP_FAILED) munmap(data, mapped_size_);
+    ::close(uffd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  uffd_ = uffd;
+  data_ = static_cast<char*>(data);
+  size_t pages = mapped_size_ / page_size_;
+  filled_.assign(pages, false);
+  staging_.resize((options_.prefetch_pages + 1) * page_size_);
+  handler_ = std::thread(&FaultRegion::handle_faults, this);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int FaultRegion::fill_eagerly() {
+  void* data = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) return -1;
+  data_ = static_cast<char*>(data);
+  for (size_t offset = 0; offset < size_; offset += kEagerFill) {
+    size_t length = std::min(kEagerFill, size_ - offset);
+    if (source_->fill(offset, data_ + offset, length) == -1) return -1;
+    bytes_filled_ += length;
+  }
+  return 0;
+}
+
+void FaultRegion::handle_faults() {
+#if defined(__linux__) && defined(SYS_userfaultfd)
+  struct pollfd fds[2] = {{uffd_, POLLIN, 0}, {wake_[0], POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      return;
+    }
+    if (fds[1].revents) return;
+
+    struct uffd_msg message;
+    ssize_t n = read(uffd_, &message, sizeof(message));
+    if (n != static_cast<ssize_t>(sizeof(message))) {
+      if (n == -1 && (errno == EAGAIN || errno == EINTR)) continue;
+      return;
+    }
+    if (message.event != UFFD_EVENT_PAGEFAULT) continue;
+    faults_.fetch_add(1, std::memory_order_relaxed);
+    uintptr_t address = message.arg.pagefault.address;
+    serve((address - reinterpret_cast<uintptr_t>(data_)) / page_size_);
+  }
+#endif
+}
+
+void FaultRegion::serve(size_t page_index) {
+#if defined(__linux__) && defined(SYS_userfaultfd)
+  char* page = data_ + page_index * page_size_;
+  if (filled_[page_index]) {
+    // Installed since the fault was queued; the toucher only needs waking.
+    struct uffdio_range range = {reinterpret_cast<uintptr_t>(page),
+                                 page_size_};
+    ioctl(uffd_, UFFDIO_WAKE, &range);
+    return;
+  }
+
+  size_t pages = 1;
+  while (pages <= options_.prefetch_pages &&
+         page_index + pages < filled_.size() && !filled_[page_index + pages]) {
+    ++pages;
+  }
+  size_t offset = page_index * page_size_;
+  size_t length = pages * page_size_;
+  size_t content = offset < size_ ? std::min(length, size_ - offset) : 0;
+  if (content > 0 && source_->fill(offset, staging_.data(), content) == -1) {
+    error_.store(errno, std::memory_order_relaxed);
+    fill_errors_.fetch_add(1, std::memory_order_relaxed);
+    content = 0;
+  }
+  // The tail of the last page, and everything after a failed fill.
+  memset(staging_.data() + content, 0, length - content);
+
+  size_t done = 0;
+  while (done < length) {
+    struct uffdio_copy copy = {};
+    copy.dst = reinterpret_cast<uintptr_t>(page + done);
+    copy.src = reinterpret_cast<uintptr_t>(staging_.data() + done);
+    copy.len = length - done;
+    if (ioctl(uffd_, UFFDIO_COPY, &copy) == 0) break;
+    if (copy.copy > 0) {
+      done += copy.copy;
+    } else if (errno == EEXIST) {
+      done += page_size_;
+    } else if (errno != EAGAIN) {
+      // Nothing more can be installed; wake the toucher so it faults again
+      // rather than hanging.
+      error_.store(errno, std::memory_order_relaxed);
+      struct uffdio_range range = {reinterpret_cast<uintptr_t>(page),
+                                   page_size_};
+      ioctl(uffd_, UFFDIO_WAKE, &range);
+      return;
+    }
+  }
+  std::fill(filled_.begin() + page_index,
+            filled_.begin() + page_index + pages, true);
+  bytes_filled_.fetch_add(content, std::memory_order_relaxed);
+  prefetched_pages_.fetch_add(pages - 1, std::memory_order_relaxed);
+#else
+  (void)page_index;
+#endif
+}
@@ -0,0 +1,119 @@
+// mmap-style lazy access to data that isn't stored as-is on disk.
+//
+// A FaultRegion is an anonymous mapping registered with userfaultfd(2):
+// the first touch of a page blocks the toucher while a handler thread asks
+// a PageSource for that page's bytes (a plain file, a range of a container,
+// or anything that has to be decrypted, decompressed or patched first) and
+// installs them with UFFDIO_COPY, together with the next few missing pages
+// so sequential access doesn't fault on every page. Where userfaultfd isn't
+// permitted (no kernel support, vm.unprivileged_userfaultfd=0 on kernels
+// without UFFD_USER_MODE_ONLY, seccomp), the region is filled up front
+// instead: same contents, just not lazy.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class PageSource {
+ public:
+  virtual ~PageSource() = default;
+
+  virtual const char* name() const = 0;
+  // Size of the content, which the region mirrors.
+  virtual size_t size() const = 0;
+  // Writes content bytes [offset, offset + length) to `dest`; the range is
+  // within size(). Called from the handler thread only. Returns 0 on
+  // success, -1 with errno set.
+  virtual int fill(size_t offset, char* dest, size_t length) = 0;
+};
+
+// The factories return nullptr with errno set on failure.
+// The bytes of the file at `path`.
+std::unique_ptr<PageSource> make_file_source(const char* path);
+// [offset, offset + length) of `inner`: an entry stored in an archive.
+std::unique_ptr<PageSource> make_range_source(
+    std::unique_ptr<PageSource> inner, size_t offset, size_t length);
+// `inner` with every byte XORed with `key`, standing in for decryption.
+std::unique_ptr<PageSource> make_xor_source(std::unique_ptr<PageSource> inner,
+                                            uint8_t key);
+
+enum class FaultMode {
+  kUserfaultfd,
+  // userfaultfd not available: everything filled in open().
+  kEager,
+};
+
+const char* fault_mode_name(FaultMode mode);
+
+struct FaultRegionOptions {
+  // Missing pages after the faulting one filled by the same fault.
+  size_t prefetch_pages = 15;
+  // Skip userfaultfd, as if it weren't permitted.
+  bool force_eager = false;
+};
+
+class FaultRegion {
+ public:
+  struct Stats {
+    size_t faults = 0;
+    // Pages filled because a neighbour faulted.
+    size_t prefetched_pages = 0;
+    size_t bytes_filled = 0;
+    size_t fill_errors = 0;
+  };
+
+  FaultRegion() = default;
+  ~FaultRegion();
+  FaultRegion(const FaultRegion&) = delete;
+  FaultRegion& operator=(const FaultRegion&) = delete;
+
+  // Maps a region of source->size() bytes. Returns 0 on success, -1 with
+  // errno set (only for failures of the fallback too: userfaultfd being
+  // unavailable just selects kEager).
+  int open(std::unique_ptr<PageSource> source,
+           const FaultRegionOptions& options = FaultRegionOptions());
+  // Must not race with accesses to data().
+  void close();
+
+  // Read-only in spirit: writes before a page has been filled are lost.
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  FaultMode mode() const { return mode_; }
+  // Why open() fell back to kEager (the userfaultfd errno), 0 otherwise.
+  int fallback_error() const { return fallback_error_; }
+  Stats stats() const;
+  // errno of the last failed fill, 0 if none failed. Pages whose fill
+  // failed read as zeros.
+  int error() const { return error_.load(std::memory_order_relaxed); }
+
+ private:
+  int start_userfaultfd();
+  int fill_eagerly();
+  void handle_faults();
+  void serve(size_t page_index);
+
+  std::unique_ptr<PageSource> source_;
+  FaultRegionOptions options_;
+  FaultMode mode_ = FaultMode::kEager;
+  int fallback_error_ = 0;
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t mapped_size_ = 0;
+  size_t page_size_ = 0;
+  int uffd_ = -1;
+  int wake_[2] = {-1, -1};
+  std::thread handler_;
+  // Pages already installed; only touched by the handler thread.
+  std::vector<bool> filled_;
+  std::vector<char> staging_;
+  std::atomic<size_t> faults_{0};
+  std::atomic<size_t> prefetched_pages_{0};
+  std::atomic<size_t> bytes_filled_{0};
+  std::atomic<size_t> fill_errors_{0};
+  std::atomic<int> error_{0};
+};
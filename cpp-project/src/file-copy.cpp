@@ -0,0 +1,274 @@
+// Implementation of copy_fd_range. Each copy_with_* helper advances the
+// offsets and `remaining` as it goes, so when one method gives up half way the
+// next one picks up exactly where it stopped.
+
+#include "file-copy.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <vector>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include "read-loop.h"
+
+namespace {
+
+constexpr size_t kBufferSize = 1 << 20;
+constexpr int kPipeSize = 1 << 20;
+
+// Errors meaning "this method does not work for these fds", as opposed to a
+// real I/O error that the next method would hit as well.
+bool is_unsupported(int err) {
+  return err == ENOSYS || err == EINVAL || err == EXDEV ||
+         err == EOPNOTSUPP || err == ENOTSUP;
+}
+
+size_t clamp_transfer(size_t remaining) {
+  return remaining < kMaxTransfer ? remaining : kMaxTransfer;
+}
+
+#ifdef __linux__
+
+int copy_with_copy_file_range(int in_fd, off_t* in_off, int out_fd,
+                              off_t* out_off, size_t* remaining) {
+#ifdef __NR_copy_file_range
+  // Go through syscall(2): the libc wrapper needs glibc 2.27 / Android API 34.
+  bool copied_any = false;
+  while (*remaining > 0) {
+    loff_t in = *in_off;
+    loff_t out = *out_off;
+    long n = syscall(__NR_copy_file_range, in_fd, &in, out_fd, &out,
+                     clamp_transfer(*remaining), 0u);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) {
+      if (copied_any) break;  // Source hit EOF.
+      // Some kernels and filesystems (procfs and sysfs on 5.3-5.18) return
+      // 0 straight away instead of failing; let kAuto try the next method.
+      errno = EOPNOTSUPP;
+      return -1;
+    }
+    copied_any = true;
+    *in_off += n;
+    *out_off += n;
+    *remaining -= n;
+  }
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int copy_with_sendfile(int in_fd, off_t* in_off, int out_fd, off_t* out_off,
+                       size_t* remaining) {
+  // sendfile writes at the current position of out_fd.
+  if (lseek(out_fd, *out_off, SEEK_SET) == -1) return -1;
+  while (*remaining > 0) {
+    off_t in = *in_off;
+    ssize_t n = sendfile(out_fd, in_fd, &in, clamp_transfer(*remaining));
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) break;
+    *in_off += n;
+    *out_off += n;
+    *remaining -= n;
+  }
+  return 0;
+}
+
+int copy_with_splice(int in_fd, off_t* in_off, int out_fd, off_t* out_off,
+                     size_t* remaining) {
+  int pipe_fds[2];
+  if (pipe(pipe_fds) == -1) return -1;
+  // A larger pipe means fewer round trips; the default is only 64KB.
+  fcntl(pipe_fds[1], F_SETPIPE_SZ, kPipeSize);
+
+  int result = 0;
+  while (*remaining > 0) {
+    loff_t in = *in_off;
+    ssize_t filled = splice(in_fd, &in, pipe_fds[1], nullptr,
+                            clamp_transfer(*remaining),
+                            SPLICE_F_MOVE | SPLICE_F_MORE);
+    if (filled == -1) {
+      if (errno == EINTR) continue;
+      result = -1;
+      break;
+    }
+    if (filled == 0) break;
+
+    // Drain everything that went into the pipe before advancing, so the
+    // offsets always describe bytes that reached the output file.
+    ssize_t drained = 0;
+    while (drained < filled) {
+      loff_t out = *out_off + drained;
+      ssize_t n = splice(pipe_fds[0], nullptr, out_fd, &out, filled - drained,
+                         SPLICE_F_MOVE | SPLICE_F_MORE);
+      if (n == -1) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if (n == 0) {
+        // The output side accepts nothing; retrying would spin.
+        errno = EOPNOTSUPP;
+        break;
+      }
+      drained += n;
+    }
+    if (drained < filled) {
+      // Whatever is still in the pipe is lost; the caller must not resume
+      // from a position past the last byte actually written.
+      *in_off += drained;
+      *out_off += drained;
+      *remaining -= drained;
+      result = -1;
+      break;
+    }
+    *in_off += filled;
+    *out_off += filled;
+    *remaining -= filled;
+  }
+
+  int saved_errno = errno;
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  errno = saved_errno;
+  return result;
+}
+
+#endif  // __linux__
+
+int copy_with_read_write(int in_fd, off_t* in_off, int out_fd, off_t* out_off,
+                         size_t* remaining) {
+  std::vector<char> buffer(*remaining < kBufferSize ? *remaining : kBufferSize);
+  while (*remaining > 0) {
+    size_t want = *remaining < buffer.size() ? *remaining : buffer.size();
+    ssize_t got = pread(in_fd, buffer.data(), want, *in_off);
+    if (got == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (got == 0) break;
+
+    ssize_t written = 0;
+    while (written < got) {
+      ssize_t n = pwrite(out_fd, buffer.data() + written, got - written,
+                         *out_off + written);
+      if (n == -1) {
+        if (errno == EINTR) continue;
+        *in_off += written;
+        *out_off += written;
+        *remaining -= written;
+        return -1;
+      }
+      written += n;
+    }
+    *in_off += got;
+    *out_off += got;
+    *remaining -= got;
+  }
+  return 0;
+}
+
+int copy_with(CopyMethod method, int in_fd, off_t* in_off, int out_fd,
+              off_t* out_off, size_t* remaining) {
+  switch (method) {
+#ifdef __linux__
+    case CopyMethod::kCopyFileRange:
+      return copy_with_copy_file_range(in_fd, in_off, out_fd, out_off,
+                                       remaining);
+    case CopyMethod::kSendfile:
+      return copy_with_sendfile(in_fd, in_off, out_fd, out_off, remaining);
+    case CopyMethod::kSplice:
+      return copy_with_splice(in_fd, in_off, out_fd, out_off, remaining);
+#endif
+    case CopyMethod::kReadWrite:
+      return copy_with_read_write(in_fd, in_off, out_fd, out_off, remaining);
+    default:
+      errno = ENOSYS;
+      return -1;
+  }
+}
+
+}  // namespace
+
+const char* copy_method_name(CopyMethod method) {
+  switch (method) {
+    case CopyMethod::kAuto:
+      return "auto";
+    case CopyMethod::kCopyFileRange:
+      return "copy_file_range";
+    case CopyMethod::kSendfile:
+      return "sendfile";
+    case CopyMethod::kSplice:
+      return "splice";
+    case CopyMethod::kReadWrite:
+      return "read/write";
+  }
+  return "unknown";
+}
+
+ssize_t copy_fd_range(int in_fd, off_t in_offset, int out_fd, off_t out_offset,
+                      size_t length, CopyMethod method, CopyMethod* used) {
+  static const CopyMethod kFallbackOrder[] = {
+      CopyMethod::kCopyFileRange,
+      CopyMethod::kSendfile,
+      CopyMethod::kSplice,
+      CopyMethod::kReadWrite,
+  };
+
+  size_t remaining = length;
+  if (method != CopyMethod::kAuto) {
+    if (used) *used = method;
+    if (copy_with(method, in_fd, &in_offset, out_fd, &out_offset,
+                  &remaining) == -1) {
+      return -1;
+    }
+    return length - remaining;
+  }
+
+  for (CopyMethod candidate : kFallbackOrder) {
+    if (used) *used = candidate;
+    if (copy_with(candidate, in_fd, &in_offset, out_fd, &out_offset,
+                  &remaining) == 0) {
+      return length - remaining;
+    }
+    if (!is_unsupported(errno)) return -1;
+  }
+  return -1;
+}
+
+int extract_to_file(int in_fd, off_t in_offset, size_t length,
+                    const char* out_path, CopyMethod method,
+                    CopyMethod* used) {
+  int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (out_fd == -1) return -1;
+
+  ssize_t copied =
+      copy_fd_range(in_fd, in_offset, out_fd, 0, length, method, used);
+  if (copied != -1 && static_cast<size_t>(copied) != length) {
+    // The source ended before `length` bytes; don't leave a silently
+    // truncated file behind looking like a complete extraction.
+    errno = EIO;
+    copied = -1;
+  }
+
+  int saved_errno = errno;
+  if (close(out_fd) == -1 && copied != -1) return -1;
+  if (copied == -1) {
+    unlink(out_path);
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
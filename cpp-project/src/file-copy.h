@@ -0,0 +1,36 @@
+// Kernel-side file copy used to extract assets without bouncing every byte
+// through a user space buffer.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+enum class CopyMethod {
+  kAuto,           // Try each method below in order until one works.
+  kCopyFileRange,  // copy_file_range(2), may reflink on CoW filesystems.
+  kSendfile,       // sendfile(2) from the source fd into the output fd.
+  kSplice,         // splice(2) through an intermediate pipe.
+  kReadWrite,      // pread/pwrite through a user space buffer.
+};
+
+const char* copy_method_name(CopyMethod method);
+
+// Copies `length` bytes starting at `in_offset` of `in_fd` to `out_offset` of
+// `out_fd`. The source can be a plain file or a range inside an archive (e.g.
+// the fd+offset returned by AAsset_openFileDescriptor64). File positions of
+// both fds are left untouched, except with sendfile, which advances `out_fd`.
+//
+// With kAuto, methods the kernel or filesystem rejects fall through to the
+// next one; `used` (optional) receives the method that did the copy.
+// Returns the number of bytes copied, or -1 with errno set.
+ssize_t copy_fd_range(int in_fd, off_t in_offset, int out_fd, off_t out_offset,
+                      size_t length, CopyMethod method = CopyMethod::kAuto,
+                      CopyMethod* used = nullptr);
+
+// Creates (or truncates) `out_path` and fills it with `length` bytes from
+// `in_fd` starting at `in_offset`. Returns 0 on success, -1 with errno set.
+int extract_to_file(int in_fd, off_t in_offset, size_t length,
+                    const char* out_path, CopyMethod method = CopyMethod::kAuto,
+                    CopyMethod* used = nullptr);
@@ -0,0 +1,343 @@
+#include "file-registry.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/stat.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+
+#include "read-loop.h"
+
+namespace {
+
+// What a path has to keep naming for a cached entry to stay valid.
+struct FileIdentity {
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+  uint64_t size = 0;
+  int64_t mtime_ns = 0;
+
+  // Spelled out: the Android app builds this file as C++17.
+  bool operator==(const FileIdentity& other) const {
+    return dev == other.dev && ino == other.ino && size == other.size &&
+           mtime_ns == other.mtime_ns;
+  }
+};
+
+void identity_from_stat(const struct stat& sb, FileIdentity* identity) {
+  identity->dev = sb.st_dev;
+  identity->ino = sb.st_ino;
+  identity->size = sb.st_size;
+#ifdef __APPLE__
+  identity->mtime_ns =
+      sb.st_mtimespec.tv_sec * 1000000000LL + sb.st_mtimespec.tv_nsec;
+#else
+  identity->mtime_ns = sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+#endif
+}
+
+// statx() asks for just the fields compared, which some filesystems answer
+// without fetching the rest; plain stat() where it's missing.
+int identify_path(const char* path, FileIdentity* identity) {
+#if defined(__linux__) && defined(SYS_statx) && defined(STATX_INO)
+  struct statx stx;
+  if (syscall(SYS_statx, AT_FDCWD, path, AT_STATX_SYNC_AS_STAT,
+              STATX_INO | STATX_SIZE | STATX_MTIME, &stx) == 0) {
+    identity->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    identity->ino = stx.stx_ino;
+    identity->size = stx.stx_size;
+    identity->mtime_ns =
+        stx.stx_mtime.tv_sec * 1000000000LL + stx.stx_mtime.tv_nsec;
+    return 0;
+  }
+  if (errno != ENOSYS) return -1;
+#endif
+  struct stat sb;
+  if (stat(path, &sb) == -1) return -1;
+  identity_from_stat(sb, identity);
+  return 0;
+}
+
+#ifdef __linux__
+// Writes, truncation, chmod/touch and link count changes (so unlink, or a
+// rename over the path) all end up here.
+constexpr uint32_t kWatchMask =
+    IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF;
+#endif
+
+}  // namespace
+
+namespace detail {
+
+struct RegistryEntry {
+  int fd = -1;
+  FileIdentity identity;
+  char* data = nullptr;
+  // inotify watch descriptor, -1 when revalidated with statx().
+  int watch = -1;
+  // The rest is guarded by the registry's mutex.
+  size_t refs = 0;
+  uint64_t last_used = 0;
+  bool stale = false;
+  // Out of the registry; its mapping is counted until the last handle goes.
+  bool dropped = false;
+
+  ~RegistryEntry() {
+    if (data) munmap(data, identity.size);
+    if (fd != -1) close(fd);
+  }
+};
+
+}  // namespace detail
+
+using detail::RegistryEntry;
+
+FileHandle::FileHandle(FileHandle&& other) noexcept
+    : registry_(other.registry_), entry_(std::move(other.entry_)) {
+  other.registry_ = nullptr;
+}
+
+FileHandle& FileHandle::operator=(FileHandle&& other) noexcept {
+  if (this != &other) {
+    reset();
+    registry_ = other.registry_;
+    entry_ = std::move(other.entry_);
+    other.registry_ = nullptr;
+  }
+  return *this;
+}
+
+FileHandle::~FileHandle() { reset(); }
+
+int FileHandle::fd() const { return entry_ ? entry_->fd : -1; }
+
+size_t FileHandle::size() const { return entry_ ? entry_->identity.size : 0; }
+
+const char* FileHandle::data() const {
+  return entry_ ? entry_->data : nullptr;
+}
+
+void FileHandle::reset() {
+  if (registry_) registry_->release(entry_);
+  registry_ = nullptr;
+  // Closes the file here, outside the registry's lock, if the entry was
+  // dropped while this handle held it.
+  entry_.reset();
+}
+
+FileRegistry::FileRegistry(const RegistryOptions& options)
+    : options_(options) {
+#ifdef __linux__
+  if (options_.revalidation != Revalidation::kInotify) return;
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ == -1) return;
+  if (pipe2(wake_pipe_, O_CLOEXEC) == -1) {
+    close(inotify_fd_);
+    inotify_fd_ = -1;
+    return;
+  }
+  watching_ = true;
+  watcher_ = std::thread([this] { watch_events(); });
+#endif
+}
+
+FileRegistry::~FileRegistry() {
+  if (watcher_.joinable()) {
+    char stop = 0;
+    while (write(wake_pipe_[1], &stop, 1) == -1 && errno == EINTR) {
+    }
+    watcher_.join();
+  }
+  for (int fd : {inotify_fd_, wake_pipe_[0], wake_pipe_[1]}) {
+    if (fd != -1) close(fd);
+  }
+}
+
+FileRegistry& FileRegistry::global() {
+  static FileRegistry* registry = new FileRegistry();
+  return *registry;
+}
+
+int FileRegistry::acquire(const char* path, bool map, FileHandle* out) {
+  out->reset();
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  EntryPtr entry;
+  auto it = entries_.find(path);
+  if (it != entries_.end()) {
+    if (still_valid(path, *it->second)) {
+      entry = it->second;
+      ++stats_.hits;
+    } else {
+      ++stats_.stale;
+      drop(it);
+    }
+  }
+  if (!entry) {
+    ++stats_.misses;
+    if (open_entry(path, &entry) == -1) return -1;
+    entries_.emplace(path, entry);
+  }
+
+  if (map && !entry->data && entry->identity.size > 0) {
+    size_t size;
+    if (buffer_size_for(entry->identity.size, &size) == -1) return -1;
+    void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+    if (memory == MAP_FAILED) return -1;
+    entry->data = static_cast<char*>(memory);
+    stats_.mapped_bytes += size;
+  }
+
+  ++entry->refs;
+  entry->last_used = ++clock_;
+  out->registry_ = this;
+  out->entry_ = std::move(entry);
+  enforce_budget();
+  return 0;
+}
+
+void FileRegistry::trim() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto next = std::next(it);
+    if (it->second->refs == 0) drop(it);
+    it = next;
+  }
+}
+
+FileRegistry::Stats FileRegistry::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Stats stats = stats_;
+  stats.open_files = entries_.size();
+  stats.inotify = watching_;
+  return stats;
+}
+
+void FileRegistry::release(const EntryPtr& entry) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--entry->refs == 0 && entry->dropped && entry->data) {
+    stats_.mapped_bytes -= entry->identity.size;
+  }
+  entry->last_used = ++clock_;
+  enforce_budget();
+}
+
+bool FileRegistry::still_valid(const char* path, const RegistryEntry& entry) {
+  if (entry.stale) return false;
+  if (entry.watch != -1 && watching_) return true;
+  ++stats_.revalidations;
+  FileIdentity identity;
+  return identify_path(path, &identity) == 0 && identity == entry.identity;
+}
+
+int FileRegistry::open_entry(const char* path, EntryPtr* out) {
+  auto entry = std::make_shared<RegistryEntry>();
+  entry->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (entry->fd == -1) return -1;
+  struct stat sb;
+  if (fstat(entry->fd, &sb) == -1) {
+    int saved_errno = errno;
+    entry.reset();
+    errno = saved_errno;
+    return -1;
+  }
+  identity_from_stat(sb, &entry->identity);
+
+#ifdef __linux__
+  if (watching_) {
+    entry->watch = inotify_add_watch(inotify_fd_, path, kWatchMask);
+    // The watch follows whatever the path names now. If that is no longer
+    // the file just opened, nothing would report changes to it.
+    FileIdentity now;
+    if (entry->watch != -1 &&
+        (identify_path(path, &now) == -1 || !(now == entry->identity))) {
+      entry->stale = true;
+    }
+  }
+#endif
+  *out = std::move(entry);
+  return 0;
+}
+
+void FileRegistry::drop(EntryMap::iterator it) {
+  RegistryEntry& entry = *it->second;
+  entry.dropped = true;
+  // A handle still holding the entry keeps the mapping alive.
+  if (entry.data && entry.refs == 0) {
+    stats_.mapped_bytes -= entry.identity.size;
+  }
+#ifdef __linux__
+  // Paths naming the same file share a watch descriptor.
+  if (entry.watch != -1) {
+    bool shared = false;
+    for (const auto& [path, other] : entries_) {
+      shared |= other != it->second && other->watch == entry.watch;
+    }
+    if (!shared) inotify_rm_watch(inotify_fd_, entry.watch);
+  }
+#endif
+  entries_.erase(it);
+}
+
+void FileRegistry::enforce_budget() {
+  auto over_budget = [this] {
+    return entries_.size() > options_.max_open_files ||
+           stats_.mapped_bytes > options_.max_mapped_bytes;
+  };
+  if (!over_budget()) return;
+
+  std::vector<std::pair<uint64_t, std::string>> idle;
+  for (const auto& [path, entry] : entries_) {
+    if (entry->refs == 0) idle.emplace_back(entry->last_used, path);
+  }
+  std::sort(idle.begin(), idle.end());
+  for (const auto& [last_used, path] : idle) {
+    if (!over_budget()) break;
+    drop(entries_.find(path));
+    ++stats_.evictions;
+  }
+}
+
+void FileRegistry::watch_events() {
+#ifdef __linux__
+  alignas(struct inotify_event) char buffer[4096];
+  pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {wake_pipe_[0], POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) == -1) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    if (fds[1].revents) return;
+
+    ssize_t length;
+    while ((length = read(inotify_fd_, buffer, sizeof(buffer))) > 0) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (ssize_t offset = 0; offset < length;) {
+        const auto* event =
+            reinterpret_cast<const struct inotify_event*>(buffer + offset);
+        offset += sizeof(struct inotify_event) + event->len;
+        // A lost event could have been about any file.
+        bool everything = event->mask & IN_Q_OVERFLOW;
+        for (auto& [path, entry] : entries_) {
+          if (everything || entry->watch == event->wd) entry->stale = true;
+        }
+      }
+    }
+    if (length == -1 && errno != EAGAIN && errno != EINTR) break;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  watching_ = false;
+#endif
+}
@@ -0,0 +1,141 @@
+// Process-wide cache of open files and their mappings, so loading the same
+// hot file again costs a hash lookup instead of open + fstat + mmap and a
+// fresh round of page faults.
+//
+// Entries are keyed by path and remember the identity of the file they
+// opened (device, inode, size, mtime). Every acquire checks that the path
+// still names that file, either with one statx() (Revalidation::kStat) or,
+// with kInotify, by trusting a watcher thread that marks entries stale when
+// the file is written, renamed or unlinked, so a hit makes no syscall at
+// all. Stale entries are dropped and the file is opened again.
+//
+// Handles are reference counted; the fd and mapping stay valid while a
+// handle holds them, even if the entry goes stale or is evicted meanwhile.
+// Idle entries are closed, least recently used first, once the registry
+// holds more open files or mapped bytes than its budget allows.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace detail {
+struct RegistryEntry;
+}  // namespace detail
+
+enum class Revalidation {
+  // statx() the path on every hit.
+  kStat,
+  // Rely on inotify; falls back to kStat where inotify is unavailable. A
+  // change can go unnoticed for as long as the event takes to arrive.
+  kInotify,
+};
+
+struct RegistryOptions {
+  size_t max_open_files = 64;
+  size_t max_mapped_bytes = size_t{1} << 30;
+  Revalidation revalidation = Revalidation::kStat;
+};
+
+class FileRegistry;
+
+// Reference to a registry entry; released when destroyed. Must not outlive
+// the registry it came from.
+class FileHandle {
+ public:
+  FileHandle() = default;
+  FileHandle(FileHandle&& other) noexcept;
+  FileHandle& operator=(FileHandle&& other) noexcept;
+  ~FileHandle();
+  FileHandle(const FileHandle&) = delete;
+  FileHandle& operator=(const FileHandle&) = delete;
+
+  explicit operator bool() const { return entry_ != nullptr; }
+  int fd() const;
+  // Size of the file when it was opened.
+  size_t size() const;
+  // Read-only mapping of the whole file, or nullptr if it was acquired
+  // without `map` (or is empty).
+  const char* data() const;
+
+  void reset();
+
+ private:
+  friend class FileRegistry;
+
+  FileRegistry* registry_ = nullptr;
+  std::shared_ptr<detail::RegistryEntry> entry_;
+};
+
+class FileRegistry {
+ public:
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Hits checked with statx(); 0 when inotify does the checking.
+    uint64_t revalidations = 0;
+    // Entries found changed on disk and opened again.
+    uint64_t stale = 0;
+    uint64_t evictions = 0;
+    size_t open_files = 0;
+    // Includes mappings of dropped entries that handles still hold.
+    size_t mapped_bytes = 0;
+    // True when kInotify was asked for and is in use.
+    bool inotify = false;
+  };
+
+  explicit FileRegistry(const RegistryOptions& options = RegistryOptions());
+  ~FileRegistry();
+  FileRegistry(const FileRegistry&) = delete;
+  FileRegistry& operator=(const FileRegistry&) = delete;
+
+  // Shared instance with default options, never destroyed so handles in
+  // other static objects stay valid.
+  static FileRegistry& global();
+
+  // Points `out` at the cached entry for `path`, opening it on a miss. With
+  // `map`, the whole file is also mapped read-only (once; later acquires
+  // reuse the mapping). Returns 0 on success, -1 with errno set.
+  //
+  // Misses open and map the file with the registry locked, so concurrent
+  // acquires of other paths wait for them.
+  int acquire(const char* path, bool map, FileHandle* out);
+
+  // Closes every entry no handle holds.
+  void trim();
+
+  Stats stats() const;
+
+ private:
+  friend class FileHandle;
+  using EntryPtr = std::shared_ptr<detail::RegistryEntry>;
+  using EntryMap = std::unordered_map<std::string, EntryPtr>;
+
+  void release(const EntryPtr& entry);
+  bool still_valid(const char* path, const detail::RegistryEntry& entry);
+  int open_entry(const char* path, EntryPtr* entry);
+  void drop(EntryMap::iterator it);
+  void enforce_budget();
+  void watch_events();
+
+  const RegistryOptions options_;
+  mutable std::mutex mutex_;
+  EntryMap entries_;
+  uint64_t clock_ = 0;
+  Stats stats_;
+
+  int inotify_fd_ = -1;
+  // False once the watcher thread has stopped, after which every hit is
+  // checked with statx() again.
+  bool watching_ = false;
+  // Written to by the destructor to stop the watcher thread.
+  int wake_pipe_[2] = {-1, -1};
+  std::thread watcher_;
+};
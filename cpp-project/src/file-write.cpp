@@ -0,0 +1,280 @@
+// Implementation of write_file. Every strategy opens the file its own way,
+// writes, and then goes through the same fsync so the durable numbers are
+// comparable.
+
+#include "file-write.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "read-loop.h"
+
+namespace {
+
+using Clock = std::chrono::high_resolution_clock;
+
+constexpr size_t kDirectAlignment = 4096;
+
+double elapsed_ms(Clock::time_point start) {
+  std::chrono::duration<double, std::milli> duration = Clock::now() - start;
+  return duration.count();
+}
+
+int pwrite_all(int fd, const char* data, size_t size, off_t offset) {
+  while (size > 0) {
+    ssize_t n = pwrite(fd, data, size < kMaxTransfer ? size : kMaxTransfer,
+                       offset);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    data += n;
+    size -= n;
+    offset += n;
+  }
+  return 0;
+}
+
+int write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size < kMaxTransfer ? size : kMaxTransfer);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    data += n;
+    size -= n;
+  }
+  return 0;
+}
+
+// Writes data[0, size) to [base, base + size) of the file.
+int pwrite_chunks(int fd, const char* data, size_t size, off_t base,
+                  size_t chunk_size) {
+  for (size_t offset = 0; offset < size; offset += chunk_size) {
+    size_t n = size - offset < chunk_size ? size - offset : chunk_size;
+    if (pwrite_all(fd, data + offset, n, base + offset) == -1) return -1;
+  }
+  return 0;
+}
+
+// What the durable phase has to flush besides the fd itself.
+struct WriteTarget {
+  int fd = -1;
+  void* map = nullptr;
+  size_t map_size = 0;
+};
+
+int write_with_mmap(WriteTarget* target, const char* data, size_t size) {
+  if (ftruncate(target->fd, size) == -1) return -1;
+  if (size == 0) return 0;
+  void* map =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, target->fd, 0);
+  if (map == MAP_FAILED) return -1;
+  target->map = map;
+  target->map_size = size;
+  memcpy(map, data, size);
+  return 0;
+}
+
+int write_with_direct(int fd, const char* data, size_t size,
+                      size_t chunk_size) {
+  // O_DIRECT needs the buffer, offset and length block aligned, so every
+  // chunk is staged through an aligned buffer and the tail is zero padded
+  // and trimmed off again with ftruncate.
+  size_t aligned_chunk =
+      (chunk_size + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+  void* bounce = nullptr;
+  int err = posix_memalign(&bounce, kDirectAlignment, aligned_chunk);
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+
+  int result = 0;
+  for (size_t offset = 0; offset < size; offset += aligned_chunk) {
+    size_t n = size - offset < aligned_chunk ? size - offset : aligned_chunk;
+    size_t padded =
+        (n + kDirectAlignment - 1) / kDirectAlignment * kDirectAlignment;
+    memcpy(bounce, data + offset, n);
+    memset(static_cast<char*>(bounce) + n, 0, padded - n);
+    if (pwrite_all(fd, static_cast<char*>(bounce), padded, offset) == -1) {
+      result = -1;
+      break;
+    }
+  }
+  if (result == 0 && size % kDirectAlignment != 0) {
+    result = ftruncate(fd, size);
+  }
+
+  int saved_errno = errno;
+  free(bounce);
+  errno = saved_errno;
+  return result;
+}
+
+#ifdef __linux__
+
+int write_with_fallocate(int fd, const char* data, size_t size,
+                         size_t chunk_size) {
+  if (size > 0 && fallocate(fd, 0, 0, size) == -1) return -1;
+  return pwrite_chunks(fd, data, size, 0, chunk_size);
+}
+
+int write_with_sync_file_range(int fd, const char* data, size_t size,
+                               const WriteOptions& options) {
+  // Start writeback of each batch as soon as it is written and wait for the
+  // previous batch, so dirty pages never pile up beyond two batches and the
+  // final fsync has little left to do.
+  size_t batch = options.sync_batch;
+  off_t previous = -1;
+  for (size_t offset = 0; offset < size; offset += batch) {
+    size_t n = size - offset < batch ? size - offset : batch;
+    if (pwrite_chunks(fd, data + offset, n, offset, options.chunk_size) ==
+        -1) {
+      return -1;
+    }
+    if (sync_file_range(fd, offset, n, SYNC_FILE_RANGE_WRITE) == -1) return -1;
+    if (previous >= 0 &&
+        sync_file_range(fd, previous, batch,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER) == -1) {
+      return -1;
+    }
+    previous = offset;
+  }
+  return 0;
+}
+
+#endif  // __linux__
+
+int open_flags(WriteStrategy strategy, int* flags) {
+  *flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  switch (strategy) {
+    case WriteStrategy::kMmapMsync:
+      // A shared writable mapping needs the fd opened for reading too.
+      *flags = O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC;
+      return 0;
+    case WriteStrategy::kDirect:
+#ifdef O_DIRECT
+      *flags |= O_DIRECT;
+      return 0;
+#else
+      errno = ENOSYS;
+      return -1;
+#endif
+    case WriteStrategy::kFallocate:
+    case WriteStrategy::kSyncFileRange:
+#ifdef __linux__
+      return 0;
+#else
+      errno = ENOSYS;
+      return -1;
+#endif
+    default:
+      return 0;
+  }
+}
+
+int write_to(WriteTarget* target, const char* data, size_t size,
+             WriteStrategy strategy, const WriteOptions& options) {
+  switch (strategy) {
+    case WriteStrategy::kWrite:
+      return write_all(target->fd, data, size);
+    case WriteStrategy::kPwriteChunks:
+      return pwrite_chunks(target->fd, data, size, 0, options.chunk_size);
+    case WriteStrategy::kMmapMsync:
+      return write_with_mmap(target, data, size);
+    case WriteStrategy::kDirect:
+      return write_with_direct(target->fd, data, size, options.chunk_size);
+#ifdef __linux__
+    case WriteStrategy::kFallocate:
+      return write_with_fallocate(target->fd, data, size, options.chunk_size);
+    case WriteStrategy::kSyncFileRange:
+      return write_with_sync_file_range(target->fd, data, size, options);
+#endif
+    default:
+      errno = ENOSYS;
+      return -1;
+  }
+}
+
+int write_with_fwrite(const char* path, const char* data, size_t size,
+                      WriteTiming* timing) {
+  Clock::time_point start = Clock::now();
+  FILE* file = fopen(path, "wb");
+  if (!file) return -1;
+
+  int result = 0;
+  if (fwrite(data, 1, size, file) != size || fflush(file) != 0) result = -1;
+  if (timing) timing->buffered_ms = elapsed_ms(start);
+  if (result == 0 && fsync(fileno(file)) == -1) result = -1;
+  if (timing) timing->durable_ms = elapsed_ms(start);
+
+  int saved_errno = errno;
+  if (fclose(file) != 0 && result == 0) return -1;
+  errno = saved_errno;
+  return result;
+}
+
+}  // namespace
+
+const char* write_strategy_name(WriteStrategy strategy) {
+  switch (strategy) {
+    case WriteStrategy::kFwrite:
+      return "fwrite";
+    case WriteStrategy::kWrite:
+      return "write";
+    case WriteStrategy::kPwriteChunks:
+      return "pwrite chunks";
+    case WriteStrategy::kMmapMsync:
+      return "mmap+msync";
+    case WriteStrategy::kDirect:
+      return "O_DIRECT";
+    case WriteStrategy::kFallocate:
+      return "fallocate+pwrite";
+    case WriteStrategy::kSyncFileRange:
+      return "sync_file_range";
+  }
+  return "unknown";
+}
+
+int write_file(const char* path, const void* data, size_t size,
+               WriteStrategy strategy, const WriteOptions& options,
+               WriteTiming* timing) {
+  const char* bytes = static_cast<const char*>(data);
+  if (strategy == WriteStrategy::kFwrite) {
+    return write_with_fwrite(path, bytes, size, timing);
+  }
+
+  int flags = 0;
+  if (open_flags(strategy, &flags) == -1) return -1;
+
+  Clock::time_point start = Clock::now();
+  WriteTarget target;
+  target.fd = open(path, flags, 0644);
+  if (target.fd == -1) return -1;
+
+  int result = write_to(&target, bytes, size, strategy, options);
+  if (timing) timing->buffered_ms = elapsed_ms(start);
+
+  if (result == 0 && target.map && msync(target.map, target.map_size,
+                                         MS_SYNC) == -1) {
+    result = -1;
+  }
+  if (result == 0 && fsync(target.fd) == -1) result = -1;
+  if (timing) timing->durable_ms = elapsed_ms(start);
+
+  int saved_errno = errno;
+  if (target.map) munmap(target.map, target.map_size);
+  close(target.fd);
+  errno = saved_errno;
+  return result;
+}
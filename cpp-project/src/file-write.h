@@ -0,0 +1,40 @@
+// Strategies for writing a large in-memory blob to a file, mirroring the read
+// strategies benchmarked in the Android app.
+
+#pragma once
+
+#include <cstddef>
+
+enum class WriteStrategy {
+  kFwrite,         // One fwrite through stdio, like init() in the Android app.
+  kWrite,          // write(2) of the whole buffer.
+  kPwriteChunks,   // pwrite(2) of `chunk_size` pieces.
+  kMmapMsync,      // ftruncate + mmap(MAP_SHARED) + memcpy, flushed by msync.
+  kDirect,         // O_DIRECT pwrite from an aligned bounce buffer.
+  kFallocate,      // fallocate the full size up front, then pwrite chunks.
+  kSyncFileRange,  // pwrite chunks, starting writeback every `sync_batch`.
+};
+
+const char* write_strategy_name(WriteStrategy strategy);
+
+struct WriteOptions {
+  size_t chunk_size = 1 << 20;
+  // Bytes written between sync_file_range calls for kSyncFileRange.
+  size_t sync_batch = 8 << 20;
+};
+
+struct WriteTiming {
+  // From open until the last write call returned: data is in the page cache
+  // (or, for O_DIRECT, on the device but not necessarily its metadata).
+  double buffered_ms = 0;
+  // From open until fsync returned: data and metadata are durable.
+  double durable_ms = 0;
+};
+
+// Creates or truncates `path` and writes `size` bytes of `data` to it with
+// `strategy`, then fsyncs. Returns 0 on success, -1 with errno set; ENOSYS
+// when the strategy isn't available on this platform and EINVAL when the
+// filesystem refuses it (e.g. O_DIRECT on tmpfs).
+int write_file(const char* path, const void* data, size_t size,
+               WriteStrategy strategy, const WriteOptions& options,
+               WriteTiming* timing);
@@ -0,0 +1,166 @@
+#include "lazy-file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "read-loop.h"
+
+namespace {
+
+constexpr size_t kBitsPerWord = 64;
+
+size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+}  // namespace
+
+LazyFile::~LazyFile() { close(); }
+
+int LazyFile::open(const char* path, size_t chunk_size) {
+  close();
+  if (chunk_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+
+  struct stat sb;
+  size_t size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &size) == -1) {
+    int saved_errno = errno;
+    ::close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  // Chunks are page multiples so every load fills whole pages of the
+  // reservation.
+  size_t page = page_size();
+  chunk_size = (chunk_size + page - 1) / page * page;
+  size_t mapped_size = std::max((size + page - 1) / page * page, page);
+
+  // MAP_NORESERVE: only chunks that get loaded are ever committed.
+  void* data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (data == MAP_FAILED) {
+    int saved_errno = errno;
+    ::close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  fd_ = fd;
+  size_ = size;
+  chunk_size_ = chunk_size;
+  chunk_count_ = (size + chunk_size - 1) / chunk_size;
+  data_ = static_cast<char*>(data);
+  mapped_size_ = mapped_size;
+
+  size_t words = (chunk_count_ + kBitsPerWord - 1) / kBitsPerWord;
+  claimed_.reset(new std::atomic<uint64_t>[words]);
+  loaded_.reset(new std::atomic<uint64_t>[words]);
+  for (size_t i = 0; i < words; ++i) {
+    claimed_[i] = 0;
+    loaded_[i] = 0;
+  }
+  chunks_loaded_ = 0;
+  bytes_loaded_ = 0;
+  reads_ = 0;
+  error_ = 0;
+  return 0;
+}
+
+void LazyFile::close() {
+  if (data_) munmap(data_, mapped_size_);
+  if (fd_ != -1) ::close(fd_);
+  data_ = nullptr;
+  fd_ = -1;
+  size_ = 0;
+  chunk_count_ = 0;
+  claimed_.reset();
+  loaded_.reset();
+}
+
+bool LazyFile::is_loaded(size_t chunk) const {
+  if (chunk >= chunk_count_) return false;
+  uint64_t bit = uint64_t{1} << (chunk % kBitsPerWord);
+  return loaded_[chunk / kBitsPerWord].load(std::memory_order_acquire) & bit;
+}
+
+int LazyFile::load(size_t chunk) {
+  std::atomic<uint64_t>& claimed = claimed_[chunk / kBitsPerWord];
+  std::atomic<uint64_t>& loaded = loaded_[chunk / kBitsPerWord];
+  uint64_t bit = uint64_t{1} << (chunk % kBitsPerWord);
+  if (loaded.load(std::memory_order_acquire) & bit) return 0;
+
+  // Claim the chunk, or wait for whoever holds the claim to finish. A failed
+  // load drops its claim, so a waiter then retries the read itself.
+  while (claimed.fetch_or(bit, std::memory_order_acq_rel) & bit) {
+    while (claimed.load(std::memory_order_acquire) & bit) {
+      if (loaded.load(std::memory_order_acquire) & bit) return 0;
+      std::this_thread::yield();
+    }
+  }
+  if (loaded.load(std::memory_order_acquire) & bit) return 0;
+
+  size_t offset = chunk * chunk_size_;
+  size_t length = std::min(chunk_size_, size_ - offset);
+  ReadLoopStats reads;
+  int result = pread_fully(fd_, data_ + offset, length, offset, length, &reads);
+  reads_.fetch_add(reads.calls, std::memory_order_relaxed);
+  if (result == -1) {
+    int err = errno;
+    error_.store(err, std::memory_order_relaxed);
+    claimed.fetch_and(~bit, std::memory_order_release);
+    errno = err;
+    return -1;
+  }
+
+  chunks_loaded_.fetch_add(1, std::memory_order_relaxed);
+  bytes_loaded_.fetch_add(length, std::memory_order_relaxed);
+  loaded.fetch_or(bit, std::memory_order_release);
+  return 0;
+}
+
+char LazyFile::operator[](size_t offset) {
+  if (offset >= size_) return 0;
+  if (load(offset / chunk_size_) == -1) return 0;
+  return data_[offset];
+}
+
+std::span<const char> LazyFile::span(size_t offset, size_t length) {
+  if (offset >= size_) return {};
+  length = std::min(length, size_ - offset);
+  if (length == 0) return {};
+
+  size_t first = offset / chunk_size_;
+  size_t last = (offset + length - 1) / chunk_size_;
+  for (size_t chunk = first; chunk <= last; ++chunk) {
+    if (load(chunk) == -1) return {};
+  }
+  return std::span<const char>(data_ + offset, length);
+}
+
+std::string LazyFile::bitmap() const {
+  std::string bitmap(chunk_count_, '.');
+  for (size_t chunk = 0; chunk < chunk_count_; ++chunk) {
+    if (is_loaded(chunk)) bitmap[chunk] = '#';
+  }
+  return bitmap;
+}
+
+LazyFile::Stats LazyFile::stats() const {
+  Stats stats;
+  stats.chunk_count = chunk_count_;
+  stats.chunks_loaded = chunks_loaded_.load(std::memory_order_relaxed);
+  stats.bytes_loaded = bytes_loaded_.load(std::memory_order_relaxed);
+  stats.reads = reads_.load(std::memory_order_relaxed);
+  return stats;
+}
@@ -0,0 +1,72 @@
+// A view of a file that only reads the chunks callers actually touch.
+//
+// The whole file gets one contiguous anonymous reservation up front, but
+// memory is only committed for chunks that have been pread() into it, so a
+// caller reading 20% of a file pays for 20% of the I/O and RSS, while
+// span() can still return contiguous memory across chunk boundaries.
+//
+// Safe to use from several threads; each chunk is read at most once.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+class LazyFile {
+ public:
+  struct Stats {
+    size_t chunk_count = 0;
+    size_t chunks_loaded = 0;
+    size_t bytes_loaded = 0;
+    size_t reads = 0;
+  };
+
+  LazyFile() = default;
+  ~LazyFile();
+  LazyFile(const LazyFile&) = delete;
+  LazyFile& operator=(const LazyFile&) = delete;
+
+  // Returns 0 on success, -1 with errno set. Nothing is read yet.
+  int open(const char* path, size_t chunk_size = 256 << 10);
+  void close();
+
+  size_t size() const { return size_; }
+  size_t chunk_size() const { return chunk_size_; }
+
+  // The byte at `offset`, loading its chunk first. Reads 0 if the load
+  // failed; see error().
+  char operator[](size_t offset);
+
+  // Contiguous view of [offset, offset + length), clamped to the file,
+  // after loading every chunk it overlaps. Empty on failure, with errno set.
+  std::span<const char> span(size_t offset, size_t length);
+
+  bool is_loaded(size_t chunk) const;
+  // One character per chunk: '#' loaded, '.' not.
+  std::string bitmap() const;
+  Stats stats() const;
+  // errno of the last failed load, 0 if none failed.
+  int error() const { return error_.load(std::memory_order_relaxed); }
+
+ private:
+  int load(size_t chunk);
+
+  int fd_ = -1;
+  size_t size_ = 0;
+  size_t chunk_size_ = 0;
+  size_t chunk_count_ = 0;
+  char* data_ = nullptr;
+  size_t mapped_size_ = 0;
+  // One bit per chunk. A chunk is claimed by the thread reading it, and
+  // marked loaded once its bytes are in place.
+  std::unique_ptr<std::atomic<uint64_t>[]> claimed_;
+  std::unique_ptr<std::atomic<uint64_t>[]> loaded_;
+  std::atomic<size_t> chunks_loaded_{0};
+  std::atomic<size_t> bytes_loaded_{0};
+  std::atomic<size_t> reads_{0};
+  std::atomic<int> error_{0};
+};
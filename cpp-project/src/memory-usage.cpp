@@ -0,0 +1,208 @@
+#include "memory-usage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+std::atomic<uint64_t> g_count{0};
+std::atomic<uint64_t> g_bytes{0};
+std::atomic<uint64_t> g_live_bytes{0};
+std::atomic<uint64_t> g_peak_live_bytes{0};
+
+// Adds up the "<key>: <n> kB" lines of a /proc file for each of `keys`,
+// reading through a fixed buffer so that nothing is allocated.
+int sum_kb_fields(const char* path, const char* const* keys, size_t count,
+                  size_t* values) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+  std::fill(values, values + count, 0);
+
+  char buffer[4096];
+  size_t used = 0;
+  while (true) {
+    ssize_t n = read(fd, buffer + used, sizeof(buffer) - used - 1);
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      int saved_errno = errno;
+      close(fd);
+      errno = saved_errno;
+      return -1;
+    }
+    used += n;
+    buffer[used] = '\0';
+    // Handle every complete line; keep a partial last line for the next
+    // read (or handle it at the end of the file).
+    char* line = buffer;
+    while (true) {
+      char* end = strchr(line, '\n');
+      if (!end && n != 0) break;
+      if (end) *end = '\0';
+      for (size_t i = 0; i < count; ++i) {
+        size_t key_length = strlen(keys[i]);
+        if (strncmp(line, keys[i], key_length) == 0 &&
+            line[key_length] == ':') {
+          values[i] += strtoull(line + key_length + 1, nullptr, 10) << 10;
+        }
+      }
+      if (!end) break;
+      line = end + 1;
+    }
+    if (n == 0) break;
+    used = buffer + used - line;
+    memmove(buffer, line, used);
+    // A line longer than the buffer (never the case for these files) is
+    // dropped rather than stalling the loop.
+    if (used == sizeof(buffer) - 1) used = 0;
+  }
+  close(fd);
+  return 0;
+}
+
+void raise_to(std::atomic<uint64_t>* peak, uint64_t value) {
+  uint64_t current = peak->load(std::memory_order_relaxed);
+  while (current < value &&
+         !peak->compare_exchange_weak(current, value,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace
+
+int read_memory_usage(MemoryUsage* out) {
+#ifdef __linux__
+  static const char* const kKeys[] = {"Rss", "Pss", "Anonymous"};
+  size_t values[3];
+  if (sum_kb_fields("/proc/self/smaps_rollup", kKeys, 3, values) == -1 &&
+      (errno != ENOENT ||
+       sum_kb_fields("/proc/self/smaps", kKeys, 3, values) == -1)) {
+    return -1;
+  }
+  out->rss = values[0];
+  out->pss = values[1];
+  out->anonymous = values[2];
+  out->file_backed = values[0] > values[2] ? values[0] - values[2] : 0;
+  return 0;
+#else
+  (void)out;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int read_peak_rss(size_t* out) {
+#ifdef __linux__
+  static const char* const kKeys[] = {"VmHWM"};
+  return sum_kb_fields("/proc/self/status", kKeys, 1, out);
+#else
+  (void)out;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int reset_peak_rss() {
+#ifdef __linux__
+  int fd = open("/proc/self/clear_refs", O_WRONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+  // "5" resets the peak RSS; see proc(5).
+  ssize_t n = write(fd, "5", 1);
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return n == 1 ? 0 : -1;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int read_system_memory(SystemMemory* out) {
+#ifdef __linux__
+  static const char* const kKeys[] = {"MemTotal", "MemAvailable"};
+  size_t values[2];
+  if (sum_kb_fields("/proc/meminfo", kKeys, 2, values) == -1) return -1;
+  out->total = values[0];
+  out->available = values[1];
+  return 0;
+#else
+  (void)out;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+AllocationCounts allocation_counts() {
+  AllocationCounts counts;
+  counts.count = g_count.load(std::memory_order_relaxed);
+  counts.bytes = g_bytes.load(std::memory_order_relaxed);
+  counts.live_bytes = g_live_bytes.load(std::memory_order_relaxed);
+  counts.peak_live_bytes = g_peak_live_bytes.load(std::memory_order_relaxed);
+  return counts;
+}
+
+void reset_allocation_peak() {
+  g_peak_live_bytes.store(g_live_bytes.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+}
+
+namespace detail {
+
+void record_allocation(size_t requested, size_t usable) {
+  g_count.fetch_add(1, std::memory_order_relaxed);
+  g_bytes.fetch_add(requested, std::memory_order_relaxed);
+  uint64_t live =
+      g_live_bytes.fetch_add(usable, std::memory_order_relaxed) + usable;
+  raise_to(&g_peak_live_bytes, live);
+}
+
+void record_free(size_t usable) {
+  g_live_bytes.fetch_sub(usable, std::memory_order_relaxed);
+}
+
+}  // namespace detail
+
+MemorySampler::~MemorySampler() { stop(); }
+
+int MemorySampler::start(double interval_ms) {
+  stop();
+  peak_ = MemoryUsage();
+  samples_ = 0;
+  sample();
+  if (samples_ == 0) return -1;
+  stopping_ = false;
+  thread_ = std::thread(&MemorySampler::run, this, interval_ms);
+  return 0;
+}
+
+void MemorySampler::stop() {
+  stopping_ = true;
+  if (!thread_.joinable()) return;
+  thread_.join();
+  // One last sample, so the state at the end of the run is covered too.
+  sample();
+}
+
+void MemorySampler::run(double interval_ms) {
+  std::chrono::duration<double, std::milli> interval(interval_ms);
+  while (!stopping_) {
+    sample();
+    std::this_thread::sleep_for(interval);
+  }
+}
+
+void MemorySampler::sample() {
+  MemoryUsage usage;
+  if (read_memory_usage(&usage) == -1) return;
+  peak_.rss = std::max(peak_.rss, usage.rss);
+  peak_.pss = std::max(peak_.pss, usage.pss);
+  peak_.anonymous = std::max(peak_.anonymous, usage.anonymous);
+  peak_.file_backed = std::max(peak_.file_backed, usage.file_backed);
+  ++samples_;
+}
@@ -0,0 +1,90 @@
+// Memory cost of the process while a strategy runs: RSS and PSS split into
+// anonymous and file-backed pages from /proc/self/smaps_rollup, the kernel's
+// peak RSS, and heap allocation counts from the operator new/delete hook in
+// allocation-hook.cpp.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+struct MemoryUsage {
+  size_t rss = 0;
+  size_t pss = 0;
+  // Resident anonymous pages: heap, stacks, MAP_ANONYMOUS mappings.
+  size_t anonymous = 0;
+  // The rest of the RSS: mapped files (page cache) and shared memory.
+  size_t file_backed = 0;
+};
+
+// All sizes in bytes. Return 0 on success, -1 with errno set (ENOSYS off
+// Linux). read_memory_usage() falls back to summing /proc/self/smaps on
+// kernels older than 4.14, and never allocates, so it can run alongside the
+// allocation hook without showing up in its counts.
+int read_memory_usage(MemoryUsage* out);
+int read_peak_rss(size_t* out);
+// Resets the peak RSS to the current RSS (Linux 4.0+), so the next
+// read_peak_rss() covers only what ran in between.
+int reset_peak_rss();
+
+// Host-wide memory from /proc/meminfo. `total - available` is what the
+// kernel considers in use: it grows with anonymous memory, but not with
+// page cache it could drop.
+struct SystemMemory {
+  size_t total = 0;
+  size_t available = 0;
+};
+
+int read_system_memory(SystemMemory* out);
+
+struct AllocationCounts {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+  // Heap bytes allocated through operator new and not freed yet, and the
+  // highest that got since the last reset_allocation_peak().
+  uint64_t live_bytes = 0;
+  uint64_t peak_live_bytes = 0;
+};
+
+// Totals since the process started. Only operator new is counted (not
+// malloc from C code such as stdio buffers), and only in executables that
+// link allocation-hook.cpp; elsewhere everything stays zero.
+AllocationCounts allocation_counts();
+void reset_allocation_peak();
+
+namespace detail {
+// Called by the allocation hook.
+void record_allocation(size_t requested, size_t usable);
+void record_free(size_t usable);
+}  // namespace detail
+
+// Samples read_memory_usage() every `interval_ms` on a background thread and
+// keeps the highest value of each field, to catch transient peaks (a buffer
+// that is freed before the run ends) that a snapshot afterwards misses.
+class MemorySampler {
+ public:
+  MemorySampler() = default;
+  ~MemorySampler();
+  MemorySampler(const MemorySampler&) = delete;
+  MemorySampler& operator=(const MemorySampler&) = delete;
+
+  // Takes the first sample before returning. Returns 0 on success, -1 with
+  // errno set when usage can't be read on this system.
+  int start(double interval_ms);
+  void stop();
+
+  // Field-wise maximum; only valid after stop().
+  const MemoryUsage& peak() const { return peak_; }
+  size_t samples() const { return samples_; }
+
+ private:
+  void run(double interval_ms);
+  void sample();
+
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+  MemoryUsage peak_;
+  size_t samples_ = 0;
+};
@@ -0,0 +1,191 @@
+#include "multi-process.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+namespace {
+
+// The workers are released by closing the write end of a pipe, which every
+// one of them sees as end-of-file at once; they report back one byte each
+// on `ack`.
+struct Pipes {
+  int go[2];
+  int sample[2];
+  int finish[2];
+  int ack[2];
+
+  int* all() { return &go[0]; }
+};
+
+constexpr int kPipeEnds = 8;
+// How often await_acks checks for workers that died without acking.
+constexpr int kReapIntervalMs = 100;
+
+void wait_for_close(int fd) {
+  char byte;
+  while (read(fd, &byte, 1) == -1 && errno == EINTR) {
+  }
+}
+
+void send_ack(int fd) {
+  char byte = 1;
+  while (write(fd, &byte, 1) == -1 && errno == EINTR) {
+  }
+}
+
+// Reaps any of `children` that has exited, marking it -1. Returns true when
+// there was one: before the finish barrier a worker only exits by dying.
+bool reap_exited(std::vector<pid_t>* children) {
+  bool exited = false;
+  for (pid_t& child : *children) {
+    if (child != -1 && waitpid(child, nullptr, WNOHANG) == child) {
+      child = -1;
+      exited = true;
+    }
+  }
+  return exited;
+}
+
+// Returns 0 once `count` workers have written their byte, -1 with errno set
+// (ECHILD when a worker died first; the others would keep the pipe open
+// and wait for it forever).
+int await_acks(int fd, int count, std::vector<pid_t>* children) {
+  char buffer[64];
+  while (count > 0) {
+    struct pollfd readable = {fd, POLLIN, 0};
+    int ready = poll(&readable, 1, kReapIntervalMs);
+    if (ready == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (ready == 0) {
+      if (reap_exited(children)) {
+        errno = ECHILD;
+        return -1;
+      }
+      continue;
+    }
+    ssize_t n = read(fd, buffer, std::min<size_t>(count, sizeof(buffer)));
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) {
+      errno = ECHILD;
+      return -1;
+    }
+    count -= static_cast<int>(n);
+  }
+  return 0;
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+[[noreturn]] void run_worker(const ProcessTask& task, Pipes* pipes,
+                             WorkerResult* slot) {
+  close(pipes->go[1]);
+  close(pipes->sample[1]);
+  close(pipes->finish[1]);
+  close(pipes->ack[0]);
+
+  wait_for_close(pipes->go[0]);
+  auto start = std::chrono::steady_clock::now();
+  bool held = false;
+  auto hold = [&] {
+    held = true;
+    slot->ms = ms_since(start);
+    send_ack(pipes->ack[1]);
+    wait_for_close(pipes->sample[0]);
+    read_memory_usage(&slot->usage);
+    send_ack(pipes->ack[1]);
+    wait_for_close(pipes->finish[0]);
+  };
+  bool ok = task(hold);
+  // A failed worker still takes part in the barriers, so the others aren't
+  // left waiting for it.
+  if (!held) hold();
+  slot->ok = ok && held;
+  _exit(0);
+}
+
+}  // namespace
+
+int run_in_processes(int workers, const ProcessTask& task,
+                     MultiProcessResult* out) {
+  if (workers <= 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  *out = MultiProcessResult();
+  read_system_memory(&out->before);
+
+  size_t results_size = sizeof(WorkerResult) * workers;
+  void* memory = mmap(nullptr, results_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return -1;
+  WorkerResult* results = new (memory) WorkerResult[workers];
+
+  Pipes pipes;
+  std::fill(pipes.all(), pipes.all() + kPipeEnds, -1);
+  int result = 0;
+  for (int i = 0; i < kPipeEnds && result == 0; i += 2) {
+    result = pipe(pipes.all() + i);
+  }
+
+  std::vector<pid_t> children;
+  for (int i = 0; result == 0 && i < workers; ++i) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      result = -1;
+    } else if (pid == 0) {
+      run_worker(task, &pipes, &results[i]);
+    } else {
+      children.push_back(pid);
+    }
+  }
+  int saved_errno = errno;
+
+  // Only the workers read these and write `ack`.
+  for (int fd : {pipes.go[0], pipes.sample[0], pipes.finish[0], pipes.ack[1]}) {
+    if (fd != -1) close(fd);
+  }
+  auto start = std::chrono::steady_clock::now();
+  close(pipes.go[1]);
+  if (result == 0) {
+    result = await_acks(pipes.ack[0], workers, &children);
+    if (result == 0) {
+      out->wall_ms = ms_since(start);
+      read_system_memory(&out->during);
+    }
+    saved_errno = errno;
+  }
+  close(pipes.sample[1]);
+  if (result == 0) {
+    result = await_acks(pipes.ack[0], workers, &children);
+    saved_errno = errno;
+  }
+  close(pipes.finish[1]);
+  if (pipes.ack[0] != -1) close(pipes.ack[0]);
+
+  // On failure the survivors see the pipes close and exit.
+  for (pid_t child : children) {
+    if (child == -1) continue;
+    while (waitpid(child, nullptr, 0) == -1 && errno == EINTR) {
+    }
+  }
+  if (result == 0) out->workers.assign(results, results + workers);
+  munmap(memory, results_size);
+  errno = saved_errno;
+  return result;
+}
@@ -0,0 +1,48 @@
+// Runs the same load in several forked processes at once, the way many
+// processes on a host open the same asset file, and measures what each one
+// costs while all of them hold their copy. Pages of a file mapped by every
+// process are shared through the page cache: each one's RSS counts them in
+// full, but PSS divides them among the processes mapping them, so the PSS
+// of all workers adds up to the memory really used. Heap copies are private
+// and cost their full size in every process.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "memory-usage.h"
+
+struct WorkerResult {
+  bool ok = false;
+  // From the release of all workers until the task called `loaded`.
+  double ms = 0;
+  // Sampled once every worker has loaded.
+  MemoryUsage usage;
+};
+
+struct MultiProcessResult {
+  std::vector<WorkerResult> workers;
+  // From the release of all workers until the last one had loaded.
+  double wall_ms = 0;
+  // read_system_memory() before forking and while all workers held their
+  // data; zeros where /proc/meminfo isn't available.
+  SystemMemory before;
+  SystemMemory during;
+};
+
+// Loads the data and calls `loaded` with it in memory, keeping it there
+// until `loaded` returns. Returns false on failure (with or without having
+// called `loaded`).
+using ProcessTask = std::function<bool(const std::function<void()>& loaded)>;
+
+// Forks `workers` processes that start `task` together. Once every one of
+// them has loaded, the host memory is sampled, then each worker samples its
+// own usage, and only then do they all exit, so nothing shared is released
+// before everyone has been measured. Must be called before starting other
+// threads. Returns 0 on success (check each worker's `ok`), -1 with errno
+// set when the workers couldn't be run, or ECHILD when one of them died
+// (killed by a signal, say) before everyone had been measured.
+int run_in_processes(int workers, const ProcessTask& task,
+                     MultiProcessResult* out);
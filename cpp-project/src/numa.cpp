@@ -0,0 +1,139 @@
+#include "numa.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+
+// Parses a sysfs list such as "0-3,8-11".
+std::vector<int> parse_list(const std::string& text) {
+  std::vector<int> values;
+  std::stringstream stream(text);
+  std::string range;
+  while (std::getline(stream, range, ',')) {
+    int first = 0;
+    int last = 0;
+    int fields = sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (fields < 1) continue;
+    if (fields == 1) last = first;
+    for (int value = first; value <= last; ++value) values.push_back(value);
+  }
+  return values;
+}
+
+std::string read_line(const std::string& path) {
+  std::ifstream file(path);
+  std::string line;
+  std::getline(file, line);
+  return line;
+}
+
+std::vector<NumaNode> discover_nodes() {
+  std::vector<NumaNode> nodes;
+#ifdef __linux__
+  const std::string root = "/sys/devices/system/node/";
+  for (int id : parse_list(read_line(root + "online"))) {
+    std::vector<int> cpus = parse_list(
+        read_line(root + "node" + std::to_string(id) + "/cpulist"));
+    if (!cpus.empty()) nodes.push_back({id, cpus});
+  }
+#endif
+  if (nodes.empty()) {
+    // No NUMA information: a single node holding every CPU.
+    NumaNode node{0, {}};
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long cpu = 0; cpu < cpus; ++cpu) node.cpus.push_back(cpu);
+    nodes.push_back(node);
+  }
+  return nodes;
+}
+
+#ifdef __linux__
+
+constexpr size_t kMaskWords = 16;
+constexpr size_t kMaskBits = kMaskWords * 8 * sizeof(unsigned long);
+
+int mbind_nodes(void* addr, size_t size, int mode,
+                const std::vector<int>& node_ids) {
+  unsigned long mask[kMaskWords] = {};
+  for (int id : node_ids) {
+    if (id < 0 || static_cast<size_t>(id) >= kMaskBits) {
+      errno = EINVAL;
+      return -1;
+    }
+    mask[id / (8 * sizeof(unsigned long))] |=
+        1UL << (id % (8 * sizeof(unsigned long)));
+  }
+  // The kernel reads maxnode - 1 bits of the mask.
+  return syscall(SYS_mbind, addr, size, mode, mask, kMaskBits + 1, 0);
+}
+
+#endif  // __linux__
+
+}  // namespace
+
+const std::vector<NumaNode>& numa_nodes() {
+  static const std::vector<NumaNode> kNodes = discover_nodes();
+  return kNodes;
+}
+
+bool numa_available() { return numa_nodes().size() > 1; }
+
+int numa_bind_memory(void* addr, size_t size, int node) {
+  if (!numa_available() || size == 0) return 0;
+#ifdef __linux__
+  return mbind_nodes(addr, size, MPOL_BIND, {node});
+#else
+  (void)addr;
+  (void)node;
+  return 0;
+#endif
+}
+
+int numa_interleave_memory(void* addr, size_t size) {
+  if (!numa_available() || size == 0) return 0;
+#ifdef __linux__
+  std::vector<int> ids;
+  for (const NumaNode& node : numa_nodes()) ids.push_back(node.id);
+  return mbind_nodes(addr, size, MPOL_INTERLEAVE, ids);
+#else
+  (void)addr;
+  return 0;
+#endif
+}
+
+int numa_pin_thread(const NumaNode& node) {
+  if (!numa_available()) return 0;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : node.cpus) CPU_SET(cpu, &set);
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+#endif
+  return 0;
+}
+
+int numa_current_node() {
+#if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) return node;
+#endif
+  return -1;
+}
@@ -0,0 +1,31 @@
+// Minimal NUMA support on top of sysfs and raw syscalls, so nothing beyond
+// libc is needed (libnuma isn't available on Android).
+//
+// On machines with a single node, or where the kernel has no NUMA support,
+// numa_nodes() reports one node holding every CPU and the bind/interleave
+// calls are no-ops that succeed.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct NumaNode {
+  int id;
+  std::vector<int> cpus;
+};
+
+// Online nodes that have CPUs, read from /sys/devices/system/node.
+const std::vector<NumaNode>& numa_nodes();
+bool numa_available();
+
+// Sets the policy for [addr, addr + size) before it is first touched.
+// `addr` must be page aligned. Return 0 on success, -1 with errno set.
+int numa_bind_memory(void* addr, size_t size, int node);
+int numa_interleave_memory(void* addr, size_t size);
+
+// Restricts the calling thread to the CPUs of `node`.
+int numa_pin_thread(const NumaNode& node);
+
+// Node the calling thread is currently running on, or -1 if unknown.
+int numa_current_node();
@@ -0,0 +1,134 @@
+#include "output-sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include <new>
+
+namespace {
+
+class HeapSink : public OutputSink {
+ public:
+  SinkKind kind() const override { return SinkKind::kHeap; }
+  int allocate(size_t size) override {
+    buffer_.reset(new (std::nothrow) char[size]);
+    if (!buffer_) {
+      data_ = nullptr;
+      size_ = 0;
+      errno = ENOMEM;
+      return -1;
+    }
+    data_ = buffer_.get();
+    size_ = size;
+    return 0;
+  }
+
+ private:
+  std::unique_ptr<char[]> buffer_;
+};
+
+// Shared by the memfd and file sinks: `fd` sized to the output and mapped
+// MAP_SHARED.
+class MappedSink : public OutputSink {
+ public:
+  MappedSink(SinkKind kind, int fd, bool durable)
+      : kind_(kind), fd_(fd), durable_(durable) {}
+  ~MappedSink() override {
+    unmap();
+    close(fd_);
+  }
+
+  SinkKind kind() const override { return kind_; }
+  int fd() const override { return fd_; }
+
+  int allocate(size_t size) override {
+    unmap();
+    if (ftruncate(fd_, size) == -1) return -1;
+#ifdef __linux__
+    // Only for files: memfd pages are allocated on first touch either way.
+    if (kind_ == SinkKind::kMappedFile && size > 0 &&
+        fallocate(fd_, 0, 0, size) == -1 && errno != EOPNOTSUPP) {
+      return -1;
+    }
+#endif
+    if (size > 0) {
+      void* memory =
+          mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if (memory == MAP_FAILED) return -1;
+      data_ = static_cast<char*>(memory);
+    }
+    size_ = size;
+    return 0;
+  }
+
+  int finish() override {
+    if (kind_ == SinkKind::kMemfd) {
+#ifdef F_ADD_SEALS
+      // Whoever the fd is handed to can map it without fearing that it
+      // shrinks under them. Also means allocate() can't resize it again.
+      return fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+#else
+      return 0;
+#endif
+    }
+    if (!durable_) return 0;  // Already in the page cache.
+    if (data_ && msync(data_, size_, MS_SYNC) == -1) return -1;
+    return fsync(fd_);
+  }
+
+ private:
+  void unmap() {
+    if (data_) munmap(data_, size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+
+  const SinkKind kind_;
+  const int fd_;
+  const bool durable_;
+};
+
+}  // namespace
+
+const char* sink_kind_name(SinkKind kind) {
+  switch (kind) {
+    case SinkKind::kHeap:
+      return "heap";
+    case SinkKind::kMemfd:
+      return "memfd";
+    case SinkKind::kMappedFile:
+      return "mapped file";
+  }
+  return "?";
+}
+
+std::unique_ptr<OutputSink> make_heap_sink() {
+  return std::make_unique<HeapSink>();
+}
+
+std::unique_ptr<OutputSink> make_memfd_sink(const char* name) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+  // Through syscall(2), like the shared chunk cache: the libc wrapper needs
+  // glibc 2.27 / Android API 30. Flags are MFD_CLOEXEC | MFD_ALLOW_SEALING.
+  int fd = static_cast<int>(syscall(SYS_memfd_create, name, 3u));
+  if (fd == -1) return nullptr;
+  return std::make_unique<MappedSink>(SinkKind::kMemfd, fd, false);
+#else
+  (void)name;
+  errno = ENOSYS;
+  return nullptr;
+#endif
+}
+
+std::unique_ptr<OutputSink> make_mapped_file_sink(const char* path,
+                                                  bool durable) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) return nullptr;
+  return std::make_unique<MappedSink>(SinkKind::kMappedFile, fd, durable);
+}
@@ -0,0 +1,52 @@
+// Destinations the read strategies reassemble a file into.
+//
+// - Heap: new char[], what the Android code does. The result goes away with
+//   the buffer.
+// - memfd: anonymous shared memory. Its fd can be passed to another process
+//   (fork, SCM_RIGHTS) which maps the same pages, so the data is handed off
+//   without copying.
+// - Mapped file: the output file is sized with ftruncate and mapped
+//   MAP_SHARED, so chunks land straight in its page cache pages and the
+//   result persists without a separate write of the whole buffer.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+enum class SinkKind { kHeap, kMemfd, kMappedFile };
+
+const char* sink_kind_name(SinkKind kind);
+
+class OutputSink {
+ public:
+  virtual ~OutputSink() = default;
+
+  virtual SinkKind kind() const = 0;
+  // Makes room for `size` bytes, dropping whatever was there. Returns 0 on
+  // success, -1 with errno set.
+  virtual int allocate(size_t size) = 0;
+  // Called once the data is complete: the mapped file sink writes it back
+  // (and waits for it when durable), the memfd sink seals its size. Returns
+  // 0 on success, -1 with errno set.
+  virtual int finish() { return 0; }
+  // The memfd or output file, -1 for the heap.
+  virtual int fd() const { return -1; }
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ protected:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+std::unique_ptr<OutputSink> make_heap_sink();
+// The factories below return nullptr with errno set on failure. `name` only
+// labels the memfd in /proc/<pid>/fd.
+std::unique_ptr<OutputSink> make_memfd_sink(const char* name);
+// Creates or truncates `path`. allocate() reserves the blocks up front, so
+// a full disk fails there instead of raising SIGBUS halfway through a copy.
+// With `durable`, finish() waits until the data is on disk.
+std::unique_ptr<OutputSink> make_mapped_file_sink(const char* path,
+                                                  bool durable);
@@ -0,0 +1,215 @@
+#include "parallel-read.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <thread>
+
+#include "numa.h"
+#include "read-loop.h"
+
+namespace {
+
+size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+size_t round_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+struct Slice {
+  size_t offset = 0;
+  size_t size = 0;
+  const NumaNode* pin = nullptr;
+};
+
+struct SliceResult {
+  int node = -1;
+  double ms = 0;
+  int error = 0;
+  // errno from pinning the thread, 0 when it was pinned or needn't be.
+  int pin_error = 0;
+};
+
+// Splits [begin, begin + size) into `parts` page aligned slices.
+void split(size_t begin, size_t size, size_t parts, const NumaNode* pin,
+           std::vector<Slice>* slices) {
+  size_t page = page_size();
+  size_t part = round_up((size + parts - 1) / parts, page);
+  for (size_t offset = 0; offset < size && parts > 0; offset += part) {
+    slices->push_back({begin + offset, std::min(part, size - offset), pin});
+  }
+}
+
+// Lays out the slices. With kLocal every node gets a contiguous region sized
+// by its share of the threads, bound to that node, so each thread only ever
+// touches memory local to the CPU it is pinned to. A failed bind leaves
+// its errno in `*numa_error` (the first one only) and the slices as planned.
+std::vector<Slice> plan_slices(size_t file_size, size_t threads,
+                               NumaPolicy policy, char* buffer,
+                               int* numa_error) {
+  std::vector<Slice> slices;
+  if (policy != NumaPolicy::kLocal) {
+    split(0, file_size, threads, nullptr, &slices);
+    return slices;
+  }
+
+  const std::vector<NumaNode>& nodes = numa_nodes();
+  size_t used_nodes = std::min(nodes.size(), threads);
+  size_t page = page_size();
+  size_t begin = 0;
+  size_t threads_so_far = 0;
+  for (size_t i = 0; i < used_nodes; ++i) {
+    size_t node_threads = threads / used_nodes + (i < threads % used_nodes);
+    threads_so_far += node_threads;
+    size_t end = std::min(file_size,
+                          round_up(file_size * threads_so_far / threads, page));
+    if (end > begin) {
+      if (numa_bind_memory(buffer + begin, round_up(end - begin, page),
+                           nodes[i].id) == -1 &&
+          *numa_error == 0) {
+        *numa_error = errno;
+      }
+      split(begin, end - begin, node_threads, &nodes[i], &slices);
+    }
+    begin = end;
+  }
+  return slices;
+}
+
+}  // namespace
+
+const char* numa_policy_name(NumaPolicy policy) {
+  switch (policy) {
+    case NumaPolicy::kNone:
+      return "none";
+    case NumaPolicy::kLocal:
+      return "local";
+    case NumaPolicy::kInterleave:
+      return "interleave";
+  }
+  return "unknown";
+}
+
+bool parse_numa_policy(const char* name, NumaPolicy* out) {
+  static const NumaPolicy kPolicies[] = {
+      NumaPolicy::kNone, NumaPolicy::kLocal, NumaPolicy::kInterleave};
+  for (NumaPolicy policy : kPolicies) {
+    if (strcmp(name, numa_policy_name(policy)) == 0) {
+      *out = policy;
+      return true;
+    }
+  }
+  return false;
+}
+
+AnonymousBuffer::~AnonymousBuffer() { release(); }
+
+int AnonymousBuffer::allocate(size_t size) {
+  release();
+  size_t mapped_size = round_up(std::max<size_t>(size, 1), page_size());
+  void* data = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) return -1;
+  data_ = static_cast<char*>(data);
+  size_ = size;
+  mapped_size_ = mapped_size;
+  return 0;
+}
+
+void AnonymousBuffer::release() {
+  if (data_) munmap(data_, mapped_size_);
+  data_ = nullptr;
+  size_ = 0;
+  mapped_size_ = 0;
+}
+
+int parallel_read_file(const char* path, const ParallelReadOptions& options,
+                       AnonymousBuffer* out, ParallelReadStats* stats) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1 ||
+      out->allocate(file_size) == -1) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+
+  size_t threads = options.threads;
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+
+  int numa_error = 0;
+  if (options.numa == NumaPolicy::kInterleave &&
+      numa_interleave_memory(out->data(), file_size) == -1) {
+    numa_error = errno;
+  }
+  std::vector<Slice> slices =
+      plan_slices(file_size, threads, options.numa, out->data(), &numa_error);
+
+  std::vector<SliceResult> results(slices.size());
+  std::vector<std::thread> workers;
+  workers.reserve(slices.size());
+  for (size_t i = 0; i < slices.size(); ++i) {
+    workers.emplace_back([fd, out, &slices, &results, i] {
+      using Clock = std::chrono::high_resolution_clock;
+      Clock::time_point start = Clock::now();
+      const Slice& slice = slices[i];
+      if (slice.pin && numa_pin_thread(*slice.pin) == -1) {
+        results[i].pin_error = errno;
+      }
+      // One request for the whole slice.
+      if (pread_fully(fd, out->data() + slice.offset, slice.size,
+                      slice.offset, slice.size) == -1) {
+        results[i].error = errno;
+      }
+      // A pinned thread stays on its node; an unpinned one is credited to
+      // wherever it finished, which is where most of its slice was read
+      // unless it migrated late.
+      results[i].node = slice.pin && results[i].pin_error == 0
+                            ? slice.pin->id
+                            : numa_current_node();
+      std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+      results[i].ms = elapsed.count();
+    });
+  }
+  for (std::thread& worker : workers) worker.join();
+  close(fd);
+
+  std::map<int, NodeReadStats> by_node;
+  int error = 0;
+  for (size_t i = 0; i < slices.size(); ++i) {
+    if (results[i].error != 0) error = results[i].error;
+    if (results[i].pin_error != 0 && numa_error == 0) {
+      numa_error = results[i].pin_error;
+    }
+    NodeReadStats& node = by_node[results[i].node];
+    node.node = results[i].node;
+    node.threads += 1;
+    node.bytes += slices[i].size;
+    node.ms = std::max(node.ms, results[i].ms);
+  }
+
+  if (stats) {
+    stats->numa_applied = options.numa != NumaPolicy::kNone &&
+                          numa_available() && numa_error == 0;
+    stats->numa_error = numa_error;
+    stats->nodes.clear();
+    for (const auto& entry : by_node) stats->nodes.push_back(entry.second);
+  }
+  if (error != 0) {
+    out->release();
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,69 @@
+// Reads a file into one buffer with several threads, each pread()ing a
+// disjoint slice, with optional NUMA placement of the buffer and threads.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+enum class NumaPolicy {
+  kNone,        // Pages land wherever they are first touched; threads float.
+  kLocal,       // Each node's threads are pinned to it and fill a slice of
+                // the buffer bound to that node.
+  kInterleave,  // The buffer is interleaved page by page across all nodes.
+};
+
+const char* numa_policy_name(NumaPolicy policy);
+// Returns false when `name` is not one of "none", "local", "interleave".
+bool parse_numa_policy(const char* name, NumaPolicy* out);
+
+// Anonymous private mapping, so a memory policy can be set before the pages
+// are first touched (which new char[] doesn't allow).
+class AnonymousBuffer {
+ public:
+  AnonymousBuffer() = default;
+  ~AnonymousBuffer();
+  AnonymousBuffer(const AnonymousBuffer&) = delete;
+  AnonymousBuffer& operator=(const AnonymousBuffer&) = delete;
+
+  // Returns 0 on success, -1 with errno set.
+  int allocate(size_t size);
+  void release();
+
+  char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  char* data_ = nullptr;
+  size_t size_ = 0;
+  size_t mapped_size_ = 0;
+};
+
+struct ParallelReadOptions {
+  // 0 means one thread per CPU.
+  size_t threads = 0;
+  NumaPolicy numa = NumaPolicy::kNone;
+};
+
+// Threads grouped by the node they ran on.
+struct NodeReadStats {
+  int node = -1;
+  size_t threads = 0;
+  size_t bytes = 0;
+  // Slowest thread on this node, from its start to its last byte.
+  double ms = 0;
+};
+
+struct ParallelReadStats {
+  // False when the policy was requested on a single-node machine and
+  // reading fell back to plain placement, or when a bind, interleave or
+  // pin call failed and the reading went ahead without it.
+  bool numa_applied = false;
+  // errno of the first NUMA call that failed, or 0.
+  int numa_error = 0;
+  std::vector<NodeReadStats> nodes;
+};
+
+// Reads all of `path` into `out`. Returns 0 on success, -1 with errno set.
+int parallel_read_file(const char* path, const ParallelReadOptions& options,
+                       AnonymousBuffer* out, ParallelReadStats* stats);
@@ -0,0 +1,105 @@
+#include "phase-timing.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+
+namespace {
+
+thread_local PhaseRecorder* t_recorder = nullptr;
+
+double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void read_faults(uint64_t* minor, uint64_t* major) {
+  struct rusage usage;
+#ifdef RUSAGE_THREAD
+  int who = RUSAGE_THREAD;
+#else
+  int who = RUSAGE_SELF;
+#endif
+  if (getrusage(who, &usage) == -1) {
+    *minor = 0;
+    *major = 0;
+    return;
+  }
+  *minor = usage.ru_minflt;
+  *major = usage.ru_majflt;
+}
+
+}  // namespace
+
+const char* phase_name(Phase phase) {
+  switch (phase) {
+    case Phase::kOpen:
+      return "open";
+    case Phase::kSize:
+      return "size";
+    case Phase::kMap:
+      return "map";
+    case Phase::kAllocate:
+      return "allocate";
+    case Phase::kFault:
+      return "fault";
+    case Phase::kRead:
+      return "read";
+    case Phase::kCallback:
+      return "callback";
+    case Phase::kClose:
+      return "close";
+    case Phase::kOther:
+      return "other";
+  }
+  return "?";
+}
+
+double PhaseBreakdown::total_ms() const {
+  double total = 0;
+  for (double phase_ms : ms) total += phase_ms;
+  return total;
+}
+
+PhaseRecorder::PhaseRecorder(bool prefault_output)
+    : previous_(t_recorder), prefault_output_(prefault_output) {
+  t_recorder = this;
+  read_faults(&last_minor_, &last_major_);
+  last_ms_ = now_ms();
+}
+
+PhaseRecorder::~PhaseRecorder() { t_recorder = previous_; }
+
+void PhaseRecorder::mark(Phase phase) {
+  double ms = now_ms();
+  uint64_t minor;
+  uint64_t major;
+  read_faults(&minor, &major);
+  size_t index = static_cast<size_t>(phase);
+  breakdown_.ms[index] += ms - last_ms_;
+  breakdown_.minor_faults[index] += minor - last_minor_;
+  breakdown_.major_faults[index] += major - last_major_;
+  // Restart after the bookkeeping, so getrusage isn't charged to the next
+  // phase.
+  last_minor_ = minor;
+  last_major_ = major;
+  last_ms_ = now_ms();
+}
+
+void phase_end(Phase phase) {
+  if (t_recorder) t_recorder->mark(phase);
+}
+
+bool phase_prefault_output() {
+  return t_recorder && t_recorder->prefault_output();
+}
+
+void prefault_pages(char* data, size_t size) {
+  static const size_t kPage = sysconf(_SC_PAGESIZE);
+  for (size_t offset = 0; offset < size; offset += kPage) {
+    static_cast<volatile char*>(data)[offset] = 0;
+  }
+  phase_end(Phase::kFault);
+}
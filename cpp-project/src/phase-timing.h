@@ -0,0 +1,78 @@
+// Per-phase timing of a read. The strategies call phase_end() after each
+// step (open, size discovery, mapping, allocating the destination, copying,
+// close); while a PhaseRecorder is alive on the thread, the time and page
+// faults since the previous mark are added to that phase. Without one a
+// mark is a thread-local load and a branch.
+//
+// First-touch faults on a fresh destination buffer happen inside the copy,
+// so by default they are part of Phase::kRead (its fault count shows how
+// many). A recorder created with `prefault_output` has the strategies touch
+// the destination right after allocating it, which moves those faults into
+// Phase::kFault and leaves kRead with the I/O and the copy.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class Phase {
+  kOpen,
+  kSize,
+  kMap,
+  kAllocate,
+  kFault,
+  kRead,
+  // ChunkReady callbacks.
+  kCallback,
+  kClose,
+  // Anything else the strategy marks: planning, shuffling.
+  kOther,
+};
+
+constexpr size_t kPhaseCount = 9;
+
+const char* phase_name(Phase phase);
+
+struct PhaseBreakdown {
+  double ms[kPhaseCount] = {};
+  // Minor faults map a page that is already in memory (first touch of a
+  // heap page, a cached file page); major faults wait for I/O.
+  uint64_t minor_faults[kPhaseCount] = {};
+  uint64_t major_faults[kPhaseCount] = {};
+
+  double total_ms() const;
+};
+
+class PhaseRecorder {
+ public:
+  // Installs the recorder for the calling thread until it is destroyed;
+  // the clock for the first phase starts here.
+  explicit PhaseRecorder(bool prefault_output = false);
+  ~PhaseRecorder();
+  PhaseRecorder(const PhaseRecorder&) = delete;
+  PhaseRecorder& operator=(const PhaseRecorder&) = delete;
+
+  const PhaseBreakdown& breakdown() const { return breakdown_; }
+  bool prefault_output() const { return prefault_output_; }
+
+ private:
+  friend void phase_end(Phase phase);
+  void mark(Phase phase);
+
+  PhaseRecorder* const previous_;
+  const bool prefault_output_;
+  PhaseBreakdown breakdown_;
+  double last_ms_ = 0;
+  uint64_t last_minor_ = 0;
+  uint64_t last_major_ = 0;
+};
+
+// Attributes everything since the previous mark on this thread to `phase`.
+void phase_end(Phase phase);
+
+// True when the thread's recorder wants destinations touched right after
+// they are allocated.
+bool phase_prefault_output();
+
+// Writes one byte per page of [data, data + size), then marks Phase::kFault.
+void prefault_pages(char* data, size_t size);
@@ -0,0 +1,386 @@
+#include "pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+
+#include "read-loop.h"
+#include "ring-queue.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double ms_since(Clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+  return elapsed.count();
+}
+
+class ChunkQueue {
+ public:
+  virtual ~ChunkQueue() = default;
+  // Moves from `chunk` only when it returns true.
+  virtual bool try_push(PipelineChunk* chunk) = 0;
+  virtual bool try_pop(PipelineChunk* chunk) = 0;
+  virtual size_t size() const = 0;
+  virtual size_t capacity() const = 0;
+  virtual const char* kind() const = 0;
+};
+
+template <typename Queue>
+class RingChunkQueue : public ChunkQueue {
+ public:
+  RingChunkQueue(size_t capacity, const char* kind)
+      : queue_(capacity), kind_(kind) {}
+
+  bool try_push(PipelineChunk* chunk) override {
+    return queue_.try_push(std::move(*chunk));
+  }
+  bool try_pop(PipelineChunk* chunk) override { return queue_.try_pop(chunk); }
+  size_t size() const override { return queue_.size(); }
+  size_t capacity() const override { return queue_.capacity(); }
+  const char* kind() const override { return kind_; }
+
+ private:
+  Queue queue_;
+  const char* kind_;
+};
+
+// A queue plus the number of threads still pushing to it; once that drops
+// to zero and the queue is empty, the consumers are done.
+struct Link {
+  std::unique_ptr<ChunkQueue> queue;
+  std::atomic<size_t> producers{0};
+};
+
+struct Shared {
+  std::atomic<bool> failed{false};
+  std::atomic<int> error{0};
+
+  void fail(int error_number) {
+    int expected = 0;
+    error.compare_exchange_strong(expected, error_number ? error_number : EIO);
+    failed.store(true);
+  }
+};
+
+struct ThreadStats {
+  uint64_t chunks = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  double busy_ms = 0;
+  double starved_ms = 0;
+  double blocked_ms = 0;
+  double occupancy_sum = 0;
+  uint64_t occupancy_samples = 0;
+  size_t occupancy_max = 0;
+};
+
+// Waiting on a queue: yield a few times (the other side is usually about
+// to move), then sleep briefly so a waiting thread doesn't steal the CPU
+// from the one it waits for.
+class Backoff {
+ public:
+  void pause() {
+    if (rounds_++ < 16) {
+      std::this_thread::yield();
+    } else {
+      std::this_thread::sleep_for(std::chrono::microseconds(20));
+    }
+  }
+
+ private:
+  unsigned rounds_ = 0;
+};
+
+// Waits for the next chunk from `link`. Returns false once its producers
+// are done and it is drained, or when the pipeline failed.
+bool pop(Link* link, Shared* shared, PipelineChunk* chunk,
+         ThreadStats* stats) {
+  Backoff backoff;
+  Clock::time_point wait_start;
+  bool waited = false;
+  while (true) {
+    size_t occupancy = link->queue->size();
+    if (link->queue->try_pop(chunk)) {
+      stats->occupancy_sum += occupancy;
+      stats->occupancy_samples += 1;
+      stats->occupancy_max = std::max(stats->occupancy_max, occupancy);
+      if (waited) stats->starved_ms += ms_since(wait_start);
+      return true;
+    }
+    if (shared->failed.load(std::memory_order_relaxed)) return false;
+    if (link->producers.load(std::memory_order_acquire) == 0) {
+      // Everything pushed before the last producer left is visible now.
+      if (link->queue->try_pop(chunk)) return true;
+      if (waited) stats->starved_ms += ms_since(wait_start);
+      return false;
+    }
+    if (!waited) {
+      wait_start = Clock::now();
+      waited = true;
+    }
+    backoff.pause();
+  }
+}
+
+bool push(Link* link, Shared* shared, PipelineChunk* chunk,
+          ThreadStats* stats) {
+  if (link->queue->try_push(chunk)) return true;
+  Backoff backoff;
+  Clock::time_point wait_start = Clock::now();
+  while (!link->queue->try_push(chunk)) {
+    if (shared->failed.load(std::memory_order_relaxed)) return false;
+    backoff.pause();
+  }
+  stats->blocked_ms += ms_since(wait_start);
+  return true;
+}
+
+// Waits until `sequence` is within `window` chunks of the next one the sink
+// needs. Returns false when the pipeline failed.
+bool wait_for_window(uint64_t sequence, size_t window,
+                     const std::atomic<uint64_t>* emitted, Shared* shared,
+                     ThreadStats* stats) {
+  if (sequence < emitted->load(std::memory_order_acquire) + window) {
+    return true;
+  }
+  Backoff backoff;
+  Clock::time_point wait_start = Clock::now();
+  while (sequence >= emitted->load(std::memory_order_acquire) + window) {
+    if (shared->failed.load(std::memory_order_relaxed)) return false;
+    backoff.pause();
+  }
+  stats->blocked_ms += ms_since(wait_start);
+  return true;
+}
+
+void read_worker(int fd, size_t file_size, size_t chunk_size, size_t window,
+                 std::atomic<uint64_t>* next,
+                 const std::atomic<uint64_t>* emitted, Link* out,
+                 Shared* shared, ThreadStats* stats) {
+  uint64_t chunk_count = (file_size + chunk_size - 1) / chunk_size;
+  while (!shared->failed.load(std::memory_order_relaxed)) {
+    uint64_t sequence = next->fetch_add(1, std::memory_order_relaxed);
+    if (sequence >= chunk_count) break;
+    if (!wait_for_window(sequence, window, emitted, shared, stats)) break;
+    Clock::time_point start = Clock::now();
+    PipelineChunk chunk;
+    chunk.sequence = sequence;
+    chunk.offset = static_cast<off_t>(sequence * chunk_size);
+    size_t size = std::min<size_t>(chunk_size, file_size - chunk.offset);
+    chunk.data.resize(size);
+    if (pread_fully(fd, chunk.data.data(), size, chunk.offset, chunk_size) ==
+        -1) {
+      shared->fail(errno);
+      break;
+    }
+    stats->busy_ms += ms_since(start);
+    stats->chunks += 1;
+    stats->bytes_in += size;
+    stats->bytes_out += size;
+    if (!push(out, shared, &chunk, stats)) break;
+  }
+  out->producers.fetch_sub(1, std::memory_order_release);
+}
+
+void stage_worker(const PipelineStage* stage, Link* in, Link* out,
+                  Shared* shared, ThreadStats* stats) {
+  PipelineChunk chunk;
+  while (pop(in, shared, &chunk, stats)) {
+    size_t size_in = chunk.data.size();
+    Clock::time_point start = Clock::now();
+    errno = 0;
+    int result = stage->run(&chunk);
+    stats->busy_ms += ms_since(start);
+    if (result == -1) {
+      shared->fail(errno);
+      break;
+    }
+    stats->chunks += 1;
+    stats->bytes_in += size_in;
+    stats->bytes_out += chunk.data.size();
+    if (!push(out, shared, &chunk, stats)) break;
+  }
+  out->producers.fetch_sub(1, std::memory_order_release);
+}
+
+PipelineStageStats merge(const std::string& name,
+                         const std::vector<ThreadStats>& threads,
+                         const Link* in) {
+  PipelineStageStats stage;
+  stage.name = name;
+  stage.threads = threads.size();
+  double occupancy_sum = 0;
+  uint64_t occupancy_samples = 0;
+  for (const ThreadStats& thread : threads) {
+    stage.chunks += thread.chunks;
+    stage.bytes_in += thread.bytes_in;
+    stage.bytes_out += thread.bytes_out;
+    stage.busy_ms += thread.busy_ms;
+    stage.starved_ms += thread.starved_ms;
+    stage.blocked_ms += thread.blocked_ms;
+    occupancy_sum += thread.occupancy_sum;
+    occupancy_samples += thread.occupancy_samples;
+    stage.queue_max = std::max(stage.queue_max, thread.occupancy_max);
+  }
+  if (in) {
+    stage.queue_kind = in->queue->kind();
+    stage.queue_capacity = in->queue->capacity();
+    if (occupancy_samples > 0) {
+      stage.queue_average = occupancy_sum / occupancy_samples;
+    }
+  }
+  return stage;
+}
+
+}  // namespace
+
+double PipelineStageStats::mb_per_s() const {
+  if (busy_ms <= 0 || threads == 0) return 0;
+  return bytes_in / 1048576.0 / (busy_ms / threads / 1000);
+}
+
+const PipelineStageStats* PipelineStats::bottleneck() const {
+  const PipelineStageStats* slowest = nullptr;
+  for (const PipelineStageStats& stage : stages) {
+    if (stage.threads == 0) continue;
+    if (!slowest || stage.busy_ms / stage.threads >
+                        slowest->busy_ms / slowest->threads) {
+      slowest = &stage;
+    }
+  }
+  return slowest;
+}
+
+int run_pipeline(const char* path, const std::vector<PipelineStage>& stages,
+                 const PipelineOptions& options, const PipelineSinkFn& sink,
+                 PipelineStats* stats) {
+  if (options.chunk_size == 0 || options.read_threads == 0 ||
+      options.queue_capacity == 0 || options.reorder_window == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  for (const PipelineStage& stage : stages) {
+    if (stage.threads == 0 || !stage.run) {
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  Clock::time_point start = Clock::now();
+
+  // links[i] feeds stage i; the last one feeds the sink.
+  std::vector<size_t> producers = {options.read_threads};
+  for (const PipelineStage& stage : stages) producers.push_back(stage.threads);
+  std::vector<std::unique_ptr<Link>> links;
+  for (size_t i = 0; i < producers.size(); ++i) {
+    size_t consumers = i < stages.size() ? stages[i].threads : 1;
+    std::unique_ptr<Link> link(new Link());
+    if (producers[i] == 1 && consumers == 1) {
+      link->queue.reset(new RingChunkQueue<SpscQueue<PipelineChunk>>(
+          options.queue_capacity, "spsc"));
+    } else {
+      link->queue.reset(new RingChunkQueue<MpmcQueue<PipelineChunk>>(
+          options.queue_capacity, "mpmc"));
+    }
+    link->producers.store(producers[i]);
+    links.push_back(std::move(link));
+  }
+
+  Shared shared;
+  std::atomic<uint64_t> next_chunk{0};
+  // The next chunk the sink needs; the readers stay within the window of it.
+  std::atomic<uint64_t> emitted{0};
+  std::vector<std::vector<ThreadStats>> thread_stats(stages.size() + 1);
+  thread_stats[0].resize(options.read_threads);
+  for (size_t i = 0; i < stages.size(); ++i) {
+    thread_stats[i + 1].resize(stages[i].threads);
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < options.read_threads; ++t) {
+    threads.emplace_back(read_worker, fd, static_cast<size_t>(sb.st_size),
+                         options.chunk_size, options.reorder_window,
+                         &next_chunk, &emitted, links[0].get(), &shared,
+                         &thread_stats[0][t]);
+  }
+  for (size_t i = 0; i < stages.size(); ++i) {
+    for (size_t t = 0; t < stages[i].threads; ++t) {
+      threads.emplace_back(stage_worker, &stages[i], links[i].get(),
+                           links[i + 1].get(), &shared,
+                           &thread_stats[i + 1][t]);
+    }
+  }
+
+  // The sink: chunks that arrive ahead of their turn wait in `pending`,
+  // which the window keeps below options.reorder_window.
+  std::vector<ThreadStats> sink_stats(1);
+  std::map<uint64_t, PipelineChunk> pending;
+  size_t reorder_peak = 0;
+  uint64_t next_sequence = 0;
+  auto emit = [&](const PipelineChunk& chunk) {
+    Clock::time_point emit_start = Clock::now();
+    errno = 0;
+    if (sink(chunk) == -1) shared.fail(errno);
+    sink_stats[0].busy_ms += ms_since(emit_start);
+    sink_stats[0].chunks += 1;
+    sink_stats[0].bytes_in += chunk.data.size();
+    ++next_sequence;
+    emitted.store(next_sequence, std::memory_order_release);
+  };
+  PipelineChunk chunk;
+  while (!shared.failed.load() &&
+         pop(links.back().get(), &shared, &chunk, &sink_stats[0])) {
+    if (chunk.sequence != next_sequence) {
+      pending.emplace(chunk.sequence, std::move(chunk));
+      reorder_peak = std::max(reorder_peak, pending.size());
+      continue;
+    }
+    emit(chunk);
+    while (!pending.empty() && pending.begin()->first == next_sequence &&
+           !shared.failed.load()) {
+      emit(pending.begin()->second);
+      pending.erase(pending.begin());
+    }
+  }
+  if (!shared.failed.load() && !pending.empty()) shared.fail(EIO);
+
+  for (std::thread& thread : threads) thread.join();
+  close(fd);
+
+  if (stats) {
+    stats->stages.clear();
+    stats->stages.push_back(merge("read", thread_stats[0], nullptr));
+    for (size_t i = 0; i < stages.size(); ++i) {
+      stats->stages.push_back(
+          merge(stages[i].name, thread_stats[i + 1], links[i].get()));
+    }
+    stats->stages.push_back(merge("sink", sink_stats, links.back().get()));
+    stats->reorder_peak = reorder_peak;
+    stats->reorder_window = options.reorder_window;
+    stats->elapsed_ms = ms_since(start);
+  }
+  if (shared.failed.load()) {
+    errno = shared.error.load();
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+// Streaming pipeline: a file is read in chunks and every chunk flows through
+// a chain of stages (decompress, verify, parse, ...), each running on its own
+// threads and connected by bounded lock-free queues (SPSC between two
+// single-threaded stages, MPMC otherwise). Chunks reach the sink in file
+// order whatever order the stages finish them in, through a reorder buffer;
+// the read stage stays within a fixed window of the sink, so a slow chunk
+// can't make the others pile up there without bound.
+//
+// Every stage reports how busy it was and how long it waited for input
+// (starved) or for room downstream (blocked), and every queue how full it
+// ran, so the bottleneck stage is the one that is busy while its neighbours
+// starve or block on it.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct PipelineChunk {
+  // Position in the file, in chunks; the sink sees them in this order.
+  uint64_t sequence = 0;
+  off_t offset = 0;
+  // Stages may replace the data (a decompressor would) or leave it alone.
+  std::vector<char> data;
+};
+
+// Returns 0 on success, -1 with errno set to abort the pipeline.
+using PipelineStageFn = std::function<int(PipelineChunk* chunk)>;
+using PipelineSinkFn = std::function<int(const PipelineChunk& chunk)>;
+
+struct PipelineStage {
+  std::string name;
+  // Threads running `run`; it must be thread-safe when this is above 1.
+  size_t threads = 1;
+  PipelineStageFn run;
+};
+
+struct PipelineOptions {
+  size_t chunk_size = 1 << 20;
+  size_t read_threads = 1;
+  // Chunks each queue holds, rounded up to a power of two.
+  size_t queue_capacity = 16;
+  // How far ahead of the next chunk the sink needs the read stage may go,
+  // in chunks. Bounds the reorder buffer to one less than this.
+  size_t reorder_window = 64;
+};
+
+struct PipelineStageStats {
+  std::string name;
+  size_t threads = 0;
+  uint64_t chunks = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  // Summed over the stage's threads.
+  double busy_ms = 0;
+  double starved_ms = 0;
+  double blocked_ms = 0;
+  // The queue feeding this stage (none for the read stage), sampled at
+  // every pop.
+  const char* queue_kind = "";
+  size_t queue_capacity = 0;
+  double queue_average = 0;
+  size_t queue_max = 0;
+
+  // Input bytes per second of busy time per thread.
+  double mb_per_s() const;
+};
+
+struct PipelineStats {
+  // The read stage, the caller's stages, then the sink.
+  std::vector<PipelineStageStats> stages;
+  // Most chunks the reorder buffer held while waiting for an earlier one,
+  // out of at most reorder_window - 1.
+  size_t reorder_peak = 0;
+  size_t reorder_window = 0;
+  double elapsed_ms = 0;
+
+  // The stage with the most busy time per thread.
+  const PipelineStageStats* bottleneck() const;
+};
+
+// Reads `path` through `stages` and calls `sink` on the calling thread for
+// every chunk, in file order. Returns 0 on success, -1 with errno set when
+// reading, a stage or the sink failed; the other threads stop at their next
+// chunk. `stats` is filled either way.
+int run_pipeline(const char* path, const std::vector<PipelineStage>& stages,
+                 const PipelineOptions& options, const PipelineSinkFn& sink,
+                 PipelineStats* stats);
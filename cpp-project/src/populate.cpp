@@ -0,0 +1,101 @@
+#include "populate.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Linux 5.14; older headers don't have it, and older kernels reject it
+// with EINVAL.
+#if defined(__linux__) && !defined(MADV_POPULATE_READ)
+#define MADV_POPULATE_READ 22
+#endif
+
+namespace {
+
+size_t page_size() {
+  static const size_t kPage = sysconf(_SC_PAGESIZE);
+  return kPage;
+}
+
+void touch(const char* data, size_t size) {
+  const volatile char* bytes = data;
+  char sum = 0;
+  for (size_t offset = 0; offset < size; offset += page_size()) {
+    sum += bytes[offset];
+  }
+  (void)sum;
+}
+
+}  // namespace
+
+const char* populate_method_name(PopulateMethod method) {
+  switch (method) {
+    case PopulateMethod::kNone:
+      return "none";
+    case PopulateMethod::kMapPopulate:
+      return "MAP_POPULATE";
+    case PopulateMethod::kTouch:
+      return "touch";
+    case PopulateMethod::kMadvise:
+      return "MADV_POPULATE_READ";
+  }
+  return "?";
+}
+
+void Populator::start(const char* data, size_t size, PopulateMethod method,
+                      size_t threads) {
+  wait();
+  method_ = method;
+  madvise_failed_ = false;
+  if (method != PopulateMethod::kTouch && method != PopulateMethod::kMadvise) {
+    return;
+  }
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  // Whole pages per thread, so no page is populated twice.
+  size_t pages = (size + page_size() - 1) / page_size();
+  threads = std::max<size_t>(1, std::min(threads, pages));
+  size_t per_thread = (pages + threads - 1) / threads * page_size();
+  for (size_t begin = 0; begin < size; begin += per_thread) {
+    size_t length = std::min(per_thread, size - begin);
+    threads_.emplace_back(&Populator::populate, this, data + begin, length);
+  }
+}
+
+PopulateMethod Populator::wait() {
+  for (std::thread& thread : threads_) thread.join();
+  threads_.clear();
+  if (method_ == PopulateMethod::kMadvise && madvise_failed_) {
+    return PopulateMethod::kTouch;
+  }
+  return method_;
+}
+
+void Populator::populate(const char* data, size_t size) {
+  if (method_ == PopulateMethod::kMadvise && !madvise_failed_) {
+#ifdef MADV_POPULATE_READ
+    // `data` is page-aligned: the mapping starts on a page, and every range
+    // is a whole number of pages into it.
+    if (madvise(const_cast<char*>(data), size, MADV_POPULATE_READ) == 0) {
+      return;
+    }
+#endif
+    madvise_failed_ = true;
+  }
+  touch(data, size);
+}
+
+void* map_populated(int fd, size_t size, PopulateMethod method,
+                    size_t threads) {
+  int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+  if (method == PopulateMethod::kMapPopulate) flags |= MAP_POPULATE;
+#endif
+  void* data = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+  if (data == MAP_FAILED) return data;
+  Populator populator;
+  populator.start(static_cast<const char*>(data), size, method, threads);
+  populator.wait();
+  return data;
+}
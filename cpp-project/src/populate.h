@@ -0,0 +1,58 @@
+// Faulting a file mapping in before (or while) it is used. A memcpy out of
+// a fresh mapping takes one page fault per page (~25k for 100MB) on the
+// copying thread, one after the other; populating the mapping up front
+// moves them out of the copy, and splitting the range across threads takes
+// them in parallel, trading cores for wall-clock time.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+enum class PopulateMethod {
+  kNone,
+  // mmap(MAP_POPULATE): the kernel faults the whole range in inside mmap,
+  // on the calling thread only.
+  kMapPopulate,
+  // One read per page.
+  kTouch,
+  // madvise(MADV_POPULATE_READ) (Linux 5.14): the kernel populates the
+  // range without a trip back to user space per page. Where it isn't
+  // supported, kTouch is used instead.
+  kMadvise,
+};
+
+const char* populate_method_name(PopulateMethod method);
+
+// Populates a range with several threads, each taking a disjoint part.
+// The caller isn't one of them, so it can start consuming the range while
+// they run. Only kTouch and kMadvise make sense here.
+class Populator {
+ public:
+  Populator() = default;
+  ~Populator() { wait(); }
+  Populator(const Populator&) = delete;
+  Populator& operator=(const Populator&) = delete;
+
+  // `threads` 0 means one per hardware thread.
+  void start(const char* data, size_t size, PopulateMethod method,
+             size_t threads);
+  // Joins the threads. Returns the method that was actually used: kTouch
+  // when MADV_POPULATE_READ turned out not to be supported.
+  PopulateMethod wait();
+
+ private:
+  void populate(const char* data, size_t size);
+
+  PopulateMethod method_ = PopulateMethod::kNone;
+  std::atomic<bool> madvise_failed_{false};
+  std::vector<std::thread> threads_;
+};
+
+// Maps `size` bytes of `fd` read-only and populates them with `method` on
+// `threads` threads before returning. Returns the mapping, or MAP_FAILED
+// with errno set.
+void* map_populated(int fd, size_t size, PopulateMethod method,
+                    size_t threads);
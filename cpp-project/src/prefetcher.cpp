@@ -0,0 +1,114 @@
+#include "prefetcher.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include "read-loop.h"
+
+namespace {
+
+double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// At least one chunk ahead, and max_depth >= min_depth.
+PrefetchOptions normalized(PrefetchOptions options) {
+  options.min_depth = std::max<size_t>(1, options.min_depth);
+  options.max_depth = std::max(options.min_depth, options.max_depth);
+  options.initial_depth = std::clamp(options.initial_depth, options.min_depth,
+                                     options.max_depth);
+  return options;
+}
+
+}  // namespace
+
+LookaheadPrefetcher::LookaheadPrefetcher(int fd, const char* mapping,
+                                         std::vector<FileExtent> order,
+                                         const PrefetchOptions& options)
+    : fd_(fd),
+      mapping_(mapping),
+      order_(std::move(order)),
+      options_(normalized(options)),
+      depth_(options_.initial_depth) {
+  stats_.max_depth = depth_;
+  stats_.final_depth = depth_;
+}
+
+void LookaheadPrefetcher::begin(size_t index) {
+  // The current chunk is about to be read anyway; hinting it would only
+  // add a syscall.
+  next_hint_ = std::max(next_hint_, index + 1);
+  size_t last = std::min(order_.size(), index + 1 + depth_);
+  while (next_hint_ < last) hint(order_[next_hint_++]);
+  begin_ms_ = now_ms();
+}
+
+void LookaheadPrefetcher::end(size_t index) {
+  size_t length = order_[index].length;
+  if (length == 0 || options_.fixed) return;
+  double ms_per_byte = (now_ms() - begin_ms_) / length;
+  if (best_ms_per_byte_ == 0 || ms_per_byte < best_ms_per_byte_) {
+    best_ms_per_byte_ = ms_per_byte;
+  }
+
+  if (ms_per_byte > best_ms_per_byte_ * options_.stall_factor) {
+    ++stats_.stalls;
+    on_time_ = 0;
+    depth_ = std::min(options_.max_depth, depth_ * 2);
+  } else if (++on_time_ >= depth_) {
+    on_time_ = 0;
+    depth_ = std::max(options_.min_depth, depth_ - 1);
+  }
+  stats_.max_depth = std::max(stats_.max_depth, depth_);
+  stats_.final_depth = depth_;
+}
+
+void LookaheadPrefetcher::hint(const FileExtent& chunk) {
+  if (chunk.length == 0) return;
+  ++stats_.hints;
+  stats_.hinted_bytes += chunk.length;
+  if (mapping_) {
+    // madvise wants a page-aligned start.
+    static const uintptr_t kPage = sysconf(_SC_PAGESIZE);
+    uintptr_t start = reinterpret_cast<uintptr_t>(mapping_ + chunk.offset);
+    uintptr_t aligned = start & ~(kPage - 1);
+    madvise(reinterpret_cast<void*>(aligned), chunk.length + (start - aligned),
+            MADV_WILLNEED);
+    return;
+  }
+#ifdef __linux__
+  readahead(fd_, chunk.offset, chunk.length);
+#elif defined(POSIX_FADV_WILLNEED)
+  posix_fadvise(fd_, chunk.offset, chunk.length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+int read_chunks_prefetched(
+    int fd, const std::vector<ChunkRequest>& chunks,
+    const PrefetchOptions& options,
+    const std::function<void(const ChunkRequest&)>& done,
+    PrefetchStats* stats) {
+  std::vector<FileExtent> order;
+  order.reserve(chunks.size());
+  for (const ChunkRequest& chunk : chunks) {
+    order.push_back({chunk.offset, chunk.size});
+  }
+  LookaheadPrefetcher prefetcher(fd, nullptr, std::move(order), options);
+  int result = 0;
+  for (size_t i = 0; i < chunks.size() && result == 0; ++i) {
+    const ChunkRequest& chunk = chunks[i];
+    prefetcher.begin(i);
+    result = pread_fully(fd, chunk.dest, chunk.size, chunk.offset);
+    prefetcher.end(i);
+    if (result == 0 && done) done(chunk);
+  }
+  if (stats) *stats = prefetcher.stats();
+  return result;
+}
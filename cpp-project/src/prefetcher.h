@@ -0,0 +1,83 @@
+// Lookahead prefetching for reads whose order is known up front.
+//
+// The multiple-go strategies shuffle their chunks, so the kernel's own
+// readahead, which looks for sequential access, never kicks in and every
+// chunk is read cold when it is reached. Since the whole order is planned
+// before the first read, the next `depth` chunks of it can be announced
+// while the current one is copied: MADV_WILLNEED for a mapping,
+// readahead(2) for a file descriptor. Both start the I/O and return.
+//
+// The depth adapts. A chunk that takes much longer per byte than the
+// fastest one seen so far stalled on I/O, so the window doubles. After a
+// window's worth of chunks in a row arrive on time, it shrinks by one, so
+// page cache is not filled further ahead than it has to be.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "vectored-read.h"
+
+struct PrefetchOptions {
+  size_t initial_depth = 4;
+  size_t min_depth = 1;
+  size_t max_depth = 64;
+  // Same depth throughout.
+  bool fixed = false;
+  // A chunk stalled when its time per byte exceeds the best seen by this
+  // factor.
+  double stall_factor = 4;
+};
+
+struct PrefetchStats {
+  size_t hints = 0;
+  size_t hinted_bytes = 0;
+  size_t stalls = 0;
+  size_t max_depth = 0;
+  size_t final_depth = 0;
+};
+
+class LookaheadPrefetcher {
+ public:
+  // `order` lists the chunks in the order they will be consumed. Hints go
+  // to `mapping` (the whole file mapped at offset 0) when it is set, and to
+  // `fd` otherwise.
+  LookaheadPrefetcher(int fd, const char* mapping,
+                      std::vector<FileExtent> order,
+                      const PrefetchOptions& options = PrefetchOptions());
+
+  // Call right before consuming order[index]: hints the chunks after it up
+  // to the current depth, and starts timing it.
+  void begin(size_t index);
+  // Call once order[index] has been consumed; adjusts the depth.
+  void end(size_t index);
+
+  size_t depth() const { return depth_; }
+  const PrefetchStats& stats() const { return stats_; }
+
+ private:
+  void hint(const FileExtent& chunk);
+
+  const int fd_;
+  const char* const mapping_;
+  const std::vector<FileExtent> order_;
+  const PrefetchOptions options_;
+  size_t depth_;
+  size_t next_hint_ = 0;
+  size_t on_time_ = 0;
+  // Best milliseconds per byte so far: a chunk that was already cached.
+  double best_ms_per_byte_ = 0;
+  double begin_ms_ = 0;
+  PrefetchStats stats_;
+};
+
+// read_chunks_pread with a LookaheadPrefetcher announcing the chunks ahead
+// of each pread. `done` (if set) is called after every chunk. Returns 0 on
+// success, -1 with errno set.
+int read_chunks_prefetched(
+    int fd, const std::vector<ChunkRequest>& chunks,
+    const PrefetchOptions& options,
+    const std::function<void(const ChunkRequest&)>& done,
+    PrefetchStats* stats);
@@ -2,62 +2,2587 @@
 
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <memory>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
 #include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
 
-void read_file_chunks(const char* filename) {
+#ifdef FILEREAD_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "asset-manager.h"
+#include "asset-strategies.h"
+#include "async-file.h"
+#include "bench-baseline.h"
+#include "chunk-planner.h"
+#include "chunk-process.h"
+#include "fault-region.h"
+#include "file-copy.h"
+#include "file-registry.h"
+#include "file-write.h"
+#include "lazy-file.h"
+#include "memory-usage.h"
+#include "multi-process.h"
+#include "numa.h"
+#include "output-sink.h"
+#include "parallel-read.h"
+#include "phase-timing.h"
+#include "populate.h"
+#include "pipeline.h"
+#include "prefetcher.h"
+#include "read-loop.h"
+#include "read-strategies.h"
+#include "residency.h"
+#include "shared-chunk-cache.h"
+#include "sparse-file.h"
+#include "strategy-selector.h"
+#include "vectored-read.h"
+#include "zip-archive.h"
+
+// `ready`, when set, processes every chunk right after it has been copied.
+// With `prefetch`, the chunks coming up in the shuffled order are announced
+// with MADV_WILLNEED while the current one is copied.
+bool read_file_chunks(const char* filename, int pieces = 100,
+                      const ChunkReady& ready = ChunkReady(),
+                      bool prefetch = false) {
   int fd = open(filename, O_RDONLY);
   if (fd == -1) {
     perror("Error opening file");
-    return;
+    return false;
   }
+  phase_end(Phase::kOpen);
 
   struct stat sb;
-  if (fstat(fd, &sb) == -1) {
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
     perror("Error getting file size");
     close(fd);
-    return;
+    return false;
   }
-  size_t file_size = sb.st_size;
+  phase_end(Phase::kSize);
 
-  char* file_data = static_cast<char*>(mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0));
+  char* file_data = static_cast<char*>(
+      mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0));
   if (file_data == MAP_FAILED) {
     perror("Error mapping file");
     close(fd);
-    return;
+    return false;
+  }
+  phase_end(Phase::kMap);
+
+  std::vector<FileExtent> plan =
+      make_fixed_planner(pieces)->plan(nullptr, file_size);
+  std::vector<int> indices = create_random_read_sequence(plan.size());
+
+  // Every chunk is copied to the start of one buffer, sized for the largest.
+  size_t largest = 0;
+  for (const FileExtent& chunk : plan) {
+    largest = std::max(largest, chunk.length);
+  }
+  std::vector<char> buffer(largest);
+  phase_end(Phase::kAllocate);
+
+  std::vector<FileExtent> order;
+  for (int index : indices) order.push_back(plan[index]);
+  std::unique_ptr<LookaheadPrefetcher> prefetcher;
+  if (prefetch) {
+    prefetcher = std::make_unique<LookaheadPrefetcher>(fd, file_data, order);
+  }
+  phase_end(Phase::kOther);
+
+  for (size_t i = 0; i < order.size(); ++i) {
+    const FileExtent& chunk = order[i];
+    if (prefetcher) prefetcher->begin(i);
+    std::copy(file_data + chunk.offset,
+              file_data + chunk.offset + chunk.length, buffer.begin());
+    if (prefetcher) prefetcher->end(i);
+    phase_end(Phase::kRead);
+    if (ready) ready(buffer.data(), chunk.length);
+    phase_end(Phase::kCallback);
+  }
+
+  munmap(file_data, file_size);
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start) {
+  std::chrono::duration<double, std::milli> duration =
+      std::chrono::high_resolution_clock::now() - start;
+  return duration.count();
+}
+
+// Positional arguments plus --name=value (or bare --name) flags.
+struct Args {
+  std::vector<const char*> positional;
+  std::map<std::string, std::string> flags;
+
+  bool has(const char* name) const { return flags.count(name) > 0; }
+
+  long number(const char* name, long fallback) const {
+    auto it = flags.find(name);
+    return it == flags.end() ? fallback
+                             : strtol(it->second.c_str(), nullptr, 10);
+  }
+
+  double real(const char* name, double fallback) const {
+    auto it = flags.find(name);
+    return it == flags.end() ? fallback : strtod(it->second.c_str(), nullptr);
+  }
+};
+
+static Args parse_args(int argc, char* argv[]) {
+  Args args;
+  for (int i = 0; i < argc; ++i) {
+    if (strncmp(argv[i], "--", 2) != 0) {
+      args.positional.push_back(argv[i]);
+      continue;
+    }
+    const char* name = argv[i] + 2;
+    const char* eq = strchr(name, '=');
+    if (eq) {
+      args.flags[std::string(name, eq)] = eq + 1;
+    } else {
+      args.flags[name] = "";
+    }
+  }
+  return args;
+}
+
+static bool read_file_chunks_strategy(const char* path, int pieces, FileBuffer*,
+                                      const ChunkReady& ready) {
+  return read_file_chunks(path, pieces, ready);
+}
+
+static bool read_file_chunks_prefetch_strategy(const char* path, int pieces,
+                                               FileBuffer*,
+                                               const ChunkReady& ready) {
+  return read_file_chunks(path, pieces, ready, true);
+}
+
+// The library strategies plus read_file_chunks from this file.
+static std::vector<ReadStrategy> all_read_strategies() {
+  std::vector<ReadStrategy> strategies = read_strategies();
+  strategies.push_back({"read_file_chunks", true, read_file_chunks_strategy});
+  strategies.push_back({"read_file_chunks_prefetch", true,
+                        read_file_chunks_prefetch_strategy});
+  return strategies;
+}
+
+static bool find_strategy(const char* name, ReadStrategy* out) {
+  for (const ReadStrategy& strategy : all_read_strategies()) {
+    if (strcmp(strategy.name, name) == 0) {
+      *out = strategy;
+      return true;
+    }
+  }
+  std::cerr << "Unknown strategy " << name << ", expected one of:";
+  for (const ReadStrategy& strategy : all_read_strategies()) {
+    std::cerr << " " << strategy.name;
+  }
+  std::cerr << std::endl;
+  return false;
+}
+
+// Every strategy, or the comma separated --strategies=a,b,... list.
+static bool select_strategies(const Args& args,
+                              std::vector<ReadStrategy>* out) {
+  auto only = args.flags.find("strategies");
+  if (only == args.flags.end()) {
+    *out = all_read_strategies();
+    return true;
+  }
+  std::stringstream names(only->second);
+  std::string name;
+  while (std::getline(names, name, ',')) {
+    ReadStrategy strategy;
+    if (!find_strategy(name.c_str(), &strategy)) return false;
+    out->push_back(strategy);
+  }
+  return true;
+}
+
+// Width of a table's strategy column: the longest name, and at least the
+// "strategy" heading.
+static int strategy_column_width(const std::vector<ReadStrategy>& strategies) {
+  size_t width = strlen("strategy");
+  for (const ReadStrategy& strategy : strategies) {
+    width = std::max(width, strlen(strategy.name));
+  }
+  return static_cast<int>(width);
+}
+
+static void print_residency(const char* label, const Residency& residency,
+                            size_t chunks) {
+  printf("  %-16s %6.1f%% [%s]\n", label, residency.resident_percent(),
+         residency.bitmap(chunks).c_str());
+}
+
+// Runs one strategy, reporting page cache residency of the file before and
+// after each run so cold and warm numbers can be told apart.
+static int run_strategy(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.size() < 2) return -1;
+  ReadStrategy strategy;
+  if (!find_strategy(args.positional[0], &strategy)) return 1;
+  const char* path = args.positional[1];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 1);
+  double sample_ms = args.number("sample-ms", 0);
+  size_t bitmap_chunks = args.number("bitmap-chunks", 64);
+  if (pieces <= 0 || runs <= 0 || sample_ms < 0) return -1;
+
+  for (long run = 1; run <= runs; ++run) {
+    if (args.has("evict") && evict_from_page_cache(path) == -1) {
+      perror("Error evicting file");
+    }
+
+    Residency before;
+    if (snapshot_residency(path, &before) == -1) {
+      perror("Error getting residency");
+      return 1;
+    }
+
+    ResidencySampler sampler;
+    if (sample_ms > 0 && sampler.start(path, sample_ms) == -1) {
+      perror("Error sampling residency");
+    }
+
+    FileBuffer buffer;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool ok = strategy.read(path, pieces, &buffer);
+    double ms = elapsed_ms(start);
+    sampler.stop();
+    if (!ok) return 1;
+
+    Residency after;
+    snapshot_residency(path, &after);
+
+    printf("%s run %ld: %.3f ms\n", strategy.name, run, ms);
+    print_residency("before", before, bitmap_chunks);
+    for (const ResidencySample& sample : sampler.samples()) {
+      printf("  at %8.3f ms   %6.1f%%\n", sample.elapsed_ms,
+             sample.resident_percent);
+    }
+    print_residency("after", after, bitmap_chunks);
+  }
+  return 0;
+}
+
+// Reads the same shuffled chunk plan with one pread per chunk and with
+// coalesced preadv calls, reporting time and syscall counts for both.
+static int run_vectored(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  VectoredReadOptions options;
+  options.window = args.number("window", 0);
+  options.probe_nowait = !args.has("no-nowait");
+  if (pieces <= 0) return -1;
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return 1;
+  }
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return 1;
+  }
+
+  std::vector<int> order = create_random_read_sequence(pieces);
+  std::unique_ptr<char[]> buffer(new char[file_size]);
+  std::vector<ChunkRequest> chunks = chunk_requests(
+      make_fixed_planner(pieces)->plan(nullptr, file_size), order,
+      buffer.get());
+
+  printf("%-10s %13s %10s %12s %12s\n", "method", "time", "syscalls",
+         "nowait MB", "blocking MB");
+  for (int vectored = 0; vectored < 2; ++vectored) {
+    if (args.has("evict") && evict_from_page_cache(path) == -1) {
+      perror("Error evicting file");
+    }
+    VectoredReadStats stats;
+    auto start = std::chrono::high_resolution_clock::now();
+    int result = vectored ? read_chunks_vectored(fd, chunks, options, &stats)
+                          : read_chunks_pread(fd, chunks, &stats);
+    double ms = elapsed_ms(start);
+    if (result == -1) {
+      perror(vectored ? "preadv" : "pread");
+      continue;
+    }
+    printf("%-10s %10.3f ms %10zu %12.1f %12.1f\n",
+           vectored ? "preadv" : "pread", ms, stats.syscalls,
+           stats.nowait_bytes / 1048576.0, stats.blocking_bytes / 1048576.0);
+  }
+
+  close(fd);
+  return 0;
+}
+
+static Task<AsyncReadResult> load_file(AsyncFileReader* reader,
+                                       CancellationToken token) {
+  co_return co_await reader->read_all(token);
+}
+
+static Task<std::vector<AsyncReadResult>> load_file_many(
+    AsyncFileReader* reader, int loads) {
+  std::vector<Task<AsyncReadResult>> tasks;
+  for (int i = 0; i < loads; ++i) {
+    tasks.push_back(load_file(reader, CancellationToken()));
+  }
+  co_return co_await when_all(std::move(tasks));
+}
+
+// Compares blocking openOneGo loads against the same number of concurrent
+// coroutine loads waited on by a single thread, then cancels a load midway.
+static int run_async(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int loads = static_cast<int>(args.number("loads", 4));
+  long cancel_after_ms = args.number("cancel-after-ms", 5);
+  if (loads <= 0 || cancel_after_ms < 0) return -1;
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < loads; ++i) {
+    FileBuffer buffer;
+    if (!find_read_strategy("openOneGo")->read(path, 0, &buffer)) return 1;
+  }
+  printf("%-28s %10.3f ms\n", "blocking openOneGo", elapsed_ms(start));
+
+  ThreadPool pool(args.number("threads", 0));
+  AsyncFileReader reader(&pool);
+  if (reader.open(path) == -1) {
+    perror("Error opening file");
+    return 1;
+  }
+
+  start = std::chrono::high_resolution_clock::now();
+  std::vector<AsyncReadResult> results =
+      sync_wait(load_file_many(&reader, loads));
+  double ms = elapsed_ms(start);
+  for (const AsyncReadResult& result : results) {
+    if (result.error != 0) {
+      fprintf(stderr, "Error reading file: %s\n", strerror(result.error));
+      return 1;
+    }
+  }
+  printf("%-28s %10.3f ms (%zu threads)\n", "co_await read_all", ms,
+         pool.size());
+
+  CancellationSource cancel;
+  std::thread canceller([&cancel, cancel_after_ms] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(cancel_after_ms));
+    cancel.cancel();
+  });
+  start = std::chrono::high_resolution_clock::now();
+  AsyncReadResult cancelled = sync_wait(load_file(&reader, cancel.token()));
+  ms = elapsed_ms(start);
+  canceller.join();
+  printf("%-28s %10.3f ms (%s)\n", "cancelled read_all", ms,
+         cancelled.error ? strerror(cancelled.error) : "completed first");
+  return 0;
+}
+
+// Reads the file with several threads into one buffer under a NUMA policy
+// and reports throughput per node.
+static int run_parallel(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  ParallelReadOptions options;
+  options.threads = args.number("threads", 0);
+  auto numa = args.flags.find("numa");
+  if (numa != args.flags.end() &&
+      !parse_numa_policy(numa->second.c_str(), &options.numa)) {
+    return -1;
+  }
+  long runs = args.number("runs", 1);
+  if (runs <= 0) return -1;
+
+  printf("%zu NUMA node(s), policy %s\n", numa_nodes().size(),
+         numa_policy_name(options.numa));
+  for (long run = 1; run <= runs; ++run) {
+    if (args.has("evict") && evict_from_page_cache(path) == -1) {
+      perror("Error evicting file");
+    }
+    AnonymousBuffer buffer;
+    ParallelReadStats stats;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (parallel_read_file(path, options, &buffer, &stats) == -1) {
+      perror("Error reading file");
+      return 1;
+    }
+    double ms = elapsed_ms(start);
+    std::string note;
+    if (stats.numa_error != 0) {
+      note = std::string(" (policy not applied: ") +
+             strerror(stats.numa_error) + ")";
+    } else if (options.numa != NumaPolicy::kNone && !stats.numa_applied) {
+      note = " (single node, policy not applied)";
+    }
+    printf("run %ld: %.3f ms, %.1f MB/s%s\n", run, ms,
+           buffer.size() / 1048576.0 / (ms / 1000), note.c_str());
+    for (const NodeReadStats& node : stats.nodes) {
+      printf("  node %2d: %2zu threads %10.1f MB %10.3f ms %10.1f MB/s\n",
+             node.node, node.threads, node.bytes / 1048576.0, node.ms,
+             node.bytes / 1048576.0 / (node.ms / 1000));
+    }
+  }
+  return 0;
+}
+
+// Touches random spans covering roughly `--percent` of the file through a
+// LazyFile and compares the cost with loading the whole file eagerly.
+static int run_lazy(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  size_t chunk_size = args.number("chunk-kb", 256) << 10;
+  size_t span_size = args.number("span-kb", 16) << 10;
+  long percent = args.number("percent", 20);
+  if (chunk_size == 0 || span_size == 0 || percent <= 0 || percent > 100) {
+    return -1;
+  }
+
+  if (args.has("evict")) evict_from_page_cache(path);
+  FileBuffer eager;
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!find_read_strategy("openWithMmapOneGo")->read(path, 0, &eager)) {
+    return 1;
+  }
+  printf("%-20s %10.3f ms %10.1f MB loaded\n", "openWithMmapOneGo",
+         elapsed_ms(start), eager.size() / 1048576.0);
+
+  if (args.has("evict")) evict_from_page_cache(path);
+  LazyFile file;
+  start = std::chrono::high_resolution_clock::now();
+  if (file.open(path, chunk_size) == -1) {
+    perror("Error opening file");
+    return 1;
+  }
+  if (file.size() == 0) return 0;
+
+  // Random spans until the requested share of the file has been read.
+  std::mt19937 g(std::random_device{}());
+  std::uniform_int_distribution<size_t> pick(0, file.size() - 1);
+  size_t wanted = file.size() / 100 * percent;
+  unsigned long checksum = 0;
+  for (size_t touched = 0; touched < wanted; touched += span_size) {
+    std::span<const char> bytes = file.span(pick(g), span_size);
+    if (bytes.empty() && file.error() != 0) {
+      perror("Error reading file");
+      return 1;
+    }
+    for (char c : bytes) checksum += static_cast<unsigned char>(c);
+  }
+  LazyFile::Stats stats = file.stats();
+  printf("%-20s %10.3f ms %10.1f MB loaded (%zu/%zu chunks, %zu reads, "
+         "checksum %lu)\n",
+         "LazyFile", elapsed_ms(start), stats.bytes_loaded / 1048576.0,
+         stats.chunks_loaded, stats.chunk_count, stats.reads, checksum);
+  if (args.has("bitmap")) printf("[%s]\n", file.bitmap().c_str());
+  return 0;
+}
+
+// Touches random spans covering `--percent` of the file through a
+// FaultRegion, whose pages are filled by a userfaultfd handler on first
+// touch, and checks them against an eager read. `--xor=KEY` reads through
+// a source that XORs every byte with KEY, standing in for decryption.
+static int run_fault(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  size_t span_size = args.number("span-kb", 16) << 10;
+  long percent = args.number("percent", 20);
+  long prefetch = args.number("prefetch", 15);
+  long key = args.number("xor", 0);
+  if (span_size == 0 || percent <= 0 || percent > 100 || prefetch < 0 ||
+      key < 0 || key > 255) {
+    return -1;
+  }
+
+  if (args.has("evict")) evict_from_page_cache(path);
+  FileBuffer eager;
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!find_read_strategy("openWithMmapOneGo")->read(path, 0, &eager)) {
+    return 1;
+  }
+  printf("%-20s %10.3f ms %10.1f MB loaded\n", "openWithMmapOneGo",
+         elapsed_ms(start), eager.size() / 1048576.0);
+
+  if (args.has("evict")) evict_from_page_cache(path);
+  std::unique_ptr<PageSource> source = make_file_source(path);
+  if (source && key != 0) {
+    source = make_xor_source(std::move(source), static_cast<uint8_t>(key));
+  }
+  FaultRegionOptions options;
+  options.prefetch_pages = prefetch;
+  options.force_eager = args.has("eager");
+  FaultRegion region;
+  start = std::chrono::high_resolution_clock::now();
+  if (!source || region.open(std::move(source), options) == -1) {
+    perror("Error opening region");
+    return 1;
+  }
+  double open_ms = elapsed_ms(start);
+  if (region.size() == 0) return 0;
+
+  std::mt19937 g(std::random_device{}());
+  std::uniform_int_distribution<size_t> pick(0, region.size() - 1);
+  size_t wanted = region.size() / 100 * percent;
+  bool match = true;
+  for (size_t touched = 0; touched < wanted; touched += span_size) {
+    size_t offset = pick(g);
+    size_t length = std::min(span_size, region.size() - offset);
+    const char* expected = eager.data() + offset;
+    const char* actual = region.data() + offset;
+    for (size_t i = 0; i < length; ++i) {
+      match &= static_cast<char>(actual[i] ^ key) == expected[i];
+    }
+  }
+  if (region.error() != 0) {
+    errno = region.error();
+    perror("Error filling pages");
+    return 1;
+  }
+  FaultRegion::Stats stats = region.stats();
+  printf("%-20s %10.3f ms %10.1f MB loaded (open %.3f ms, %zu faults, %zu "
+         "pages prefetched)\n",
+         "FaultRegion", elapsed_ms(start), stats.bytes_filled / 1048576.0,
+         open_ms, stats.faults, stats.prefetched_pages);
+  printf("Mode %s", fault_mode_name(region.mode()));
+  if (region.fallback_error() != 0) {
+    printf(" (userfaultfd: %s)", strerror(region.fallback_error()));
+  }
+  printf(", contents %s.\n", match ? "match" : "DIFFER");
+  return match ? 0 : 1;
+}
+
+// One worker process of run_shared_cache: reads every chunk of the file in
+// random order through the cache, `rounds` times.
+static int shared_cache_worker(int worker, const char* path, int cache_fd,
+                               long rounds) {
+  SharedChunkCache cache;
+  if (cache.attach(cache_fd) == -1) {
+    perror("Error attaching cache");
+    return 1;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return 1;
+  }
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return 1;
+  }
+  size_t chunk_size = cache.chunk_size();
+  int chunks = static_cast<int>((sb.st_size + chunk_size - 1) / chunk_size);
+
+  size_t hits = 0;
+  size_t misses = 0;
+  unsigned long checksum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (long round = 0; round < rounds; ++round) {
+    for (int chunk : create_random_read_sequence(chunks)) {
+      ChunkKey key;
+      chunk_key_for(fd, chunk, &key);
+      ChunkRef ref = cache.lookup(key);
+      if (ref) {
+        ++hits;
+      } else {
+        ++misses;
+        off_t offset = static_cast<off_t>(chunk) * chunk_size;
+        ref = cache.insert(key, [fd, offset](char* dest, size_t capacity) {
+          return pread(fd, dest, capacity, offset);
+        });
+        if (!ref) {
+          perror("Error filling cache");
+          close(fd);
+          return 1;
+        }
+      }
+      // Stand-in for decoding: use the pinned bytes in place.
+      for (size_t i = 0; i < ref.size(); i += 4096) {
+        checksum += static_cast<unsigned char>(ref.data()[i]);
+      }
+    }
+  }
+  printf("worker %d: %10.3f ms, %zu hits, %zu misses (checksum %lu)\n",
+         worker, elapsed_ms(start), hits, misses, checksum);
+  close(fd);
+  return 0;
+}
+
+// Forks worker processes that all read the same file through one shared
+// chunk cache, and compares its size with one private copy per worker.
+static int run_shared_cache(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  long workers = args.number("workers", 4);
+  long rounds = args.number("rounds", 2);
+  size_t chunk_size = args.number("chunk-kb", 1024) << 10;
+  long slots = args.number("slots", 0);
+  if (workers <= 0 || rounds <= 0 || chunk_size == 0 || slots < 0) return -1;
+
+  struct stat sb;
+  if (stat(path, &sb) == -1) {
+    perror("Error getting file size");
+    return 1;
+  }
+  if (slots == 0) slots = (sb.st_size + chunk_size - 1) / chunk_size;
+
+  SharedChunkCache cache;
+  if (cache.create_anonymous(slots, chunk_size) == -1) {
+    perror("Error creating cache");
+    return 1;
+  }
+
+  fflush(stdout);
+  std::vector<pid_t> children;
+  for (long worker = 0; worker < workers; ++worker) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      perror("fork");
+      break;
+    }
+    if (pid == 0) {
+      int status = shared_cache_worker(worker, path, cache.fd(), rounds);
+      fflush(stdout);
+      _exit(status);
+    }
+    children.push_back(pid);
+  }
+  int failed = 0;
+  for (pid_t pid : children) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) ++failed;
   }
 
-  size_t chunk_size = file_size / 100;
-  std::vector<size_t> chunk_indices(100);
-  std::iota(chunk_indices.begin(), chunk_indices.end(), 0);
+  SharedChunkCache::Stats stats = cache.stats();
+  printf("cache: %zu slots x %zu KB = %.1f MB shared, vs %.1f MB for %ld "
+         "private copies\n",
+         cache.slot_count(), cache.chunk_size() >> 10,
+         cache.segment_size() / 1048576.0,
+         workers * (sb.st_size / 1048576.0), workers);
+  printf("cache: %llu hits, %llu misses, %llu inserts, %llu evictions\n",
+         static_cast<unsigned long long>(stats.hits),
+         static_cast<unsigned long long>(stats.misses),
+         static_cast<unsigned long long>(stats.inserts),
+         static_cast<unsigned long long>(stats.evictions));
+  return failed == 0 ? 0 : 1;
+}
 
-  std::random_device rd;
-  std::mt19937 g(rd());
-  std::shuffle(chunk_indices.begin(), chunk_indices.end(), g);
+// Same as init() in the Android app: the asset is already mapped
+// (AAsset_getBuffer) and is written out through stdio in one fwrite.
+static bool extract_with_fwrite(const char* src_path, const char* dst_path) {
+  int fd = open(src_path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
 
-  std::vector<char> buffer(chunk_size);
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+
+  void* file_data = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (file_data == MAP_FAILED) {
+    perror("Error mapping file");
+    close(fd);
+    return false;
+  }
 
-  for (size_t i : chunk_indices) {
-    size_t offset = i * chunk_size;
-    size_t bytes_to_read = (i == 99) ? (file_size - offset) : chunk_size;
-    std::copy(file_data + offset, file_data + offset + bytes_to_read, buffer.begin());
-    // Process the buffer as needed
+  bool ok = false;
+  FILE* out_file = fopen(dst_path, "wb");
+  if (out_file) {
+    ok = fwrite(file_data, 1, file_size, out_file) == file_size;
+    ok = fclose(out_file) == 0 && ok;
   }
+  if (!ok) perror("Error writing file");
 
   munmap(file_data, file_size);
   close(fd);
+  return ok;
+}
+
+static bool extract_with_method(const char* src_path, const char* dst_path,
+                                CopyMethod method, CopyMethod* used) {
+  int fd = open(src_path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+
+  bool ok = extract_to_file(fd, 0, sb.st_size, dst_path, method, used) == 0;
+  if (!ok) perror(copy_method_name(method));
+  close(fd);
+  return ok;
+}
+
+// Compares the current fwrite extraction against the kernel-side copy
+// methods. The destination is removed before each run so every method pays
+// for allocating a fresh file, as on first launch.
+static int run_extract(int argc, char* argv[]) {
+  if (argc < 2) return -1;
+  const char* src_path = argv[0];
+  const char* dst_path = argv[1];
+
+  static const CopyMethod kMethods[] = {
+      CopyMethod::kCopyFileRange, CopyMethod::kSendfile, CopyMethod::kSplice,
+      CopyMethod::kReadWrite,     CopyMethod::kAuto,
+  };
+
+  unlink(dst_path);
+  auto start = std::chrono::high_resolution_clock::now();
+  if (extract_with_fwrite(src_path, dst_path)) {
+    printf("%-24s %10.3f ms\n", "fwrite", elapsed_ms(start));
+  }
+
+  for (CopyMethod method : kMethods) {
+    unlink(dst_path);
+    CopyMethod used = method;
+    start = std::chrono::high_resolution_clock::now();
+    if (!extract_with_method(src_path, dst_path, method, &used)) continue;
+    double ms = elapsed_ms(start);
+    if (method == CopyMethod::kAuto) {
+      std::string name = std::string("auto (") + copy_method_name(used) + ")";
+      printf("%-24s %10.3f ms\n", name.c_str(), ms);
+    } else {
+      printf("%-24s %10.3f ms\n", copy_method_name(method), ms);
+    }
+  }
+  return 0;
+}
+
+// Printable ASCII, like the content generate-file.py produces.
+static std::vector<char> generate_content(size_t size) {
+  static const char kCharacters[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+      "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~";
+  std::mt19937 g(42);
+  std::uniform_int_distribution<size_t> pick(0, sizeof(kCharacters) - 2);
+  std::vector<char> content(size);
+  for (char& c : content) c = kCharacters[pick(g)];
+  return content;
+}
+
+// Writes a generated blob with every write strategy, reporting when the data
+// reached the page cache and when fsync made it durable.
+static int run_write(int argc, char* argv[]) {
+  if (argc < 1) return -1;
+  const char* dst_path = argv[0];
+  size_t size_mb = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+  WriteOptions options;
+  if (argc > 2) options.chunk_size = strtoul(argv[2], nullptr, 10) << 10;
+  if (size_mb == 0 || options.chunk_size == 0) return -1;
+
+  static const WriteStrategy kStrategies[] = {
+      WriteStrategy::kFwrite,     WriteStrategy::kWrite,
+      WriteStrategy::kPwriteChunks, WriteStrategy::kMmapMsync,
+      WriteStrategy::kDirect,     WriteStrategy::kFallocate,
+      WriteStrategy::kSyncFileRange,
+  };
+
+  std::vector<char> content = generate_content(size_mb << 20);
+  printf("%-24s %13s %13s\n", "strategy", "buffered", "durable");
+  for (WriteStrategy strategy : kStrategies) {
+    unlink(dst_path);
+    WriteTiming timing;
+    if (write_file(dst_path, content.data(), content.size(), strategy,
+                   options, &timing) == -1) {
+      perror(write_strategy_name(strategy));
+      continue;
+    }
+    printf("%-24s %10.3f ms %10.3f ms\n", write_strategy_name(strategy),
+           timing.buffered_ms, timing.durable_ms);
+  }
+  unlink(dst_path);
+  return 0;
+}
+
+static double mb(size_t bytes) { return bytes / 1048576.0; }
+
+// Growth from `before` to `after` in MB; negative when memory was released.
+static double mb_delta(size_t after, size_t before) {
+  return (static_cast<double>(after) - static_cast<double>(before)) /
+         1048576.0;
+}
+
+// Runs each strategy and reports its memory cost relative to the process
+// before the run: the kernel's peak RSS, sampled peaks of PSS and of
+// anonymous and file-backed pages, what is still resident while the caller
+// holds the returned buffer, and the heap allocations it made.
+static int run_memory(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 1);
+  double sample_ms = args.number("sample-ms", 1);
+  if (pieces <= 0 || runs <= 0 || sample_ms <= 0) return -1;
+  std::vector<ReadStrategy> strategies;
+  if (!select_strategies(args, &strategies)) return 1;
+
+  MemoryUsage usage;
+  if (read_memory_usage(&usage) == -1) {
+    perror("Error reading memory usage");
+    return 1;
+  }
+  bool peak_resets = reset_peak_rss() == 0;
+  if (!peak_resets) {
+    printf("Peak RSS can't be reset here; it covers the whole process.\n");
+  }
+
+  int width = strategy_column_width(strategies);
+  printf("%-*s %3s %10s %9s %9s %9s %9s %9s %8s %9s %9s\n", width, "strategy",
+         "run", "time ms", "peak RSS", "peak PSS", "peak anon", "peak file",
+         "held", "allocs", "alloc MB", "peak heap");
+  for (const ReadStrategy& strategy : strategies) {
+    for (long run = 1; run <= runs; ++run) {
+      MemoryUsage before;
+      read_memory_usage(&before);
+      MemorySampler sampler;
+      sampler.start(sample_ms);
+      if (peak_resets) reset_peak_rss();
+      reset_allocation_peak();
+      AllocationCounts allocations_before = allocation_counts();
+
+      FileBuffer buffer;
+      auto start = std::chrono::high_resolution_clock::now();
+      bool ok = strategy.read(path, pieces, &buffer);
+      double ms = elapsed_ms(start);
+      AllocationCounts allocations = allocation_counts();
+      sampler.stop();
+      if (!ok) return 1;
+
+      size_t peak_rss = 0;
+      read_peak_rss(&peak_rss);
+      MemoryUsage after;
+      read_memory_usage(&after);
+      const MemoryUsage& peak = sampler.peak();
+      printf("%-*s %3ld %10.3f %9.1f %9.1f %9.1f %9.1f %9.1f %8llu %9.1f "
+             "%9.1f\n",
+             width, strategy.name, run, ms, mb_delta(peak_rss, before.rss),
+             mb_delta(peak.pss, before.pss),
+             mb_delta(peak.anonymous, before.anonymous),
+             mb_delta(peak.file_backed, before.file_backed),
+             mb_delta(after.rss, before.rss),
+             static_cast<unsigned long long>(allocations.count -
+                                             allocations_before.count),
+             mb(allocations.bytes - allocations_before.bytes),
+             mb_delta(allocations.peak_live_bytes,
+                      allocations_before.live_bytes));
+    }
+  }
+  printf("Sizes in MB. Peaks other than RSS are sampled every %.0f ms; "
+         "allocations count operator new only.\n",
+         sample_ms);
+  return 0;
+}
+
+// Runs `processor` over `data` in `pieces` chunks, like the multiple-go
+// strategies hand them out (in order here; the kernels don't care).
+static void process_in_pieces(ChunkProcessor* processor, const char* data,
+                              size_t size, int pieces) {
+  for (const FileExtent& chunk :
+       make_fixed_planner(pieces)->plan(nullptr, size)) {
+    processor->process(data + chunk.offset, chunk.length);
+  }
+}
+
+// Attaches a processing kernel to every strategy and compares the time of
+// reading with the kernel attached against reading alone plus computing
+// alone. What the combination saves is overlap: the kernel working on a chunk
+// while it is still in the CPU cache, or while readahead fetches the next
+// one. One-go strategies can't overlap anything; they hand the kernel the
+// whole file at the end.
+static int run_process(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 3);
+  auto kernel = args.flags.find("kernel");
+  std::unique_ptr<ChunkProcessor> processor = make_chunk_processor(
+      kernel == args.flags.end() ? "ascii" : kernel->second.c_str());
+  if (!processor) {
+    std::cerr << "Unknown kernel, expected one of:";
+    for (const char* name : chunk_processor_names()) std::cerr << " " << name;
+    std::cerr << std::endl;
+    return -1;
+  }
+  if (pieces <= 0 || runs <= 0) return -1;
+  std::vector<ReadStrategy> strategies;
+  if (!select_strategies(args, &strategies)) return 1;
+
+  // The compute-only pass works on this copy, the same for every strategy.
+  FileBuffer reference;
+  if (!find_read_strategy("openOneGo")->read(path, 0, &reference)) return 1;
+  processor->reset();
+  process_in_pieces(processor.get(), reference.data(), reference.size(),
+                    pieces);
+  std::string expected = processor->result();
+  printf("kernel %s (%s): %s\n", processor->name(), chunk_kernel_isa(),
+         expected.c_str());
+
+  int width = strategy_column_width(strategies);
+  printf("%-*s %10s %10s %10s %10s %8s\n", width, "strategy", "read ms",
+         "compute ms", "both ms", "overlap ms", "hidden");
+  int failures = 0;
+  for (const ReadStrategy& strategy : strategies) {
+    std::vector<double> read_ms, compute_ms, both_ms;
+    for (long run = 0; run < runs; ++run) {
+      if (args.has("evict")) evict_from_page_cache(path);
+      auto start = std::chrono::high_resolution_clock::now();
+      {
+        FileBuffer buffer;
+        if (!strategy.read(path, pieces, &buffer)) return 1;
+      }
+      read_ms.push_back(elapsed_ms(start));
+
+      processor->reset();
+      start = std::chrono::high_resolution_clock::now();
+      process_in_pieces(processor.get(), reference.data(), reference.size(),
+                        pieces);
+      compute_ms.push_back(elapsed_ms(start));
+
+      if (args.has("evict")) evict_from_page_cache(path);
+      processor->reset();
+      ChunkProcessor* stage = processor.get();
+      start = std::chrono::high_resolution_clock::now();
+      {
+        FileBuffer buffer;
+        if (!strategy.read(path, pieces, &buffer,
+                           [stage](const char* data, size_t size) {
+                             stage->process(data, size);
+                           })) {
+          return 1;
+        }
+      }
+      both_ms.push_back(elapsed_ms(start));
+      if (processor->result() != expected) {
+        fprintf(stderr, "%s: kernel saw %s, expected %s\n", strategy.name,
+                processor->result().c_str(), expected.c_str());
+        ++failures;
+      }
+    }
+    double read = summarize_runs(strategy.name, read_ms).median_ms;
+    double compute = summarize_runs(strategy.name, compute_ms).median_ms;
+    double both = summarize_runs(strategy.name, both_ms).median_ms;
+    double overlap = read + compute - both;
+    printf("%-*s %10.3f %10.3f %10.3f %10.3f %7.0f%%\n", width, strategy.name,
+           read, compute, both, overlap,
+           compute > 0 ? overlap / compute * 100 : 0);
+  }
+  printf("Medians of %ld runs. Overlap is read + compute - both; hidden is "
+         "the share of the compute time it covers.\n",
+         runs);
+  return failures == 0 ? 0 : 1;
+}
+
+// Streams the file through decode -> verify -> parse stages, each with its
+// own thread count, and reports where the time went. There is no compressed
+// input here, so "decode" stands in for a decompressor by writing every
+// chunk into a fresh output buffer.
+static int run_pipeline_command(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  PipelineOptions options;
+  options.chunk_size = args.number("chunk-kb", 1024) << 10;
+  options.read_threads = args.number("read-threads", 1);
+  options.queue_capacity = args.number("queue", 16);
+  options.reorder_window = args.number("window", 64);
+  size_t threads[3] = {1, 1, 1};
+  auto thread_list = args.flags.find("threads");
+  if (thread_list != args.flags.end()) {
+    std::stringstream counts(thread_list->second);
+    std::string count;
+    for (size_t i = 0; i < 3 && std::getline(counts, count, ','); ++i) {
+      threads[i] = strtoul(count.c_str(), nullptr, 10);
+    }
+  }
+
+  std::atomic<size_t> non_printable{0};
+  std::atomic<size_t> newlines{0};
+  std::vector<PipelineStage> stages = {
+      {"decode", threads[0],
+       [](PipelineChunk* chunk) {
+         std::vector<char> output(chunk->data.begin(), chunk->data.end());
+         chunk->data.swap(output);
+         return 0;
+       }},
+      {"verify", threads[1],
+       [&non_printable](PipelineChunk* chunk) {
+         non_printable += count_non_printable(chunk->data.data(),
+                                              chunk->data.size());
+         return 0;
+       }},
+      {"parse", threads[2],
+       [&newlines](PipelineChunk* chunk) {
+         newlines += count_newlines(chunk->data.data(), chunk->data.size());
+         return 0;
+       }},
+  };
+
+  off_t expected_offset = 0;
+  PipelineStats stats;
+  int result = run_pipeline(
+      path, stages, options,
+      [&expected_offset](const PipelineChunk& chunk) {
+        if (chunk.offset != expected_offset) {
+          errno = EIO;
+          return -1;
+        }
+        expected_offset += chunk.data.size();
+        return 0;
+      },
+      &stats);
+  if (result == -1) {
+    bool bad_options = errno == EINVAL;
+    perror("Error running pipeline");
+    if (stats.stages.empty()) return bad_options ? -1 : 1;
+  }
+
+  printf("%-8s %3s %7s %9s %9s %10s %10s %10s  %s\n", "stage", "thr",
+         "chunks", "MB", "MB/s", "busy ms", "starved ms", "blocked ms",
+         "input queue (avg/max of capacity)");
+  for (const PipelineStageStats& stage : stats.stages) {
+    printf("%-8s %3zu %7llu %9.1f %9.1f %10.3f %10.3f %10.3f",
+           stage.name.c_str(), stage.threads,
+           static_cast<unsigned long long>(stage.chunks),
+           stage.bytes_in / 1048576.0, stage.mb_per_s(), stage.busy_ms,
+           stage.starved_ms, stage.blocked_ms);
+    if (stage.queue_capacity > 0) {
+      printf("  %s %.1f/%zu of %zu", stage.queue_kind, stage.queue_average,
+             stage.queue_max, stage.queue_capacity);
+    }
+    printf("\n");
+  }
+  const PipelineStageStats* bottleneck = stats.bottleneck();
+  double mb_per_s = expected_offset / 1048576.0 / (stats.elapsed_ms / 1000);
+  printf("%.3f ms, %.1f MB/s, bottleneck %s, reorder buffer peak %zu of "
+         "%zu chunks\n",
+         stats.elapsed_ms, mb_per_s,
+         bottleneck ? bottleneck->name.c_str() : "-", stats.reorder_peak,
+         stats.reorder_window - 1);
+  printf("verify: %zu non-printable bytes, parse: %zu newlines\n",
+         non_printable.load(), newlines.load());
+  return result == 0 ? 0 : 1;
+}
+
+// Reads one byte per page of `data`, so a load pays for its page faults.
+static uint64_t touch_pages(const char* data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t offset = 0; offset < size; offset += 4096) sum += data[offset];
+  return sum;
+}
+
+// Maps and touches `path` from scratch, the way every load works without
+// the registry.
+static bool load_without_registry(const char* path, uint64_t* sum) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) return false;
+  struct stat sb;
+  size_t size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &size) == -1) {
+    close(fd);
+    return false;
+  }
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+  *sum += touch_pages(static_cast<const char*>(data), size);
+  munmap(data, size);
+  return true;
+}
+
+// Writes `text` to a temporary file and renames it over `path`, the way
+// asset updates usually land.
+static bool replace_file(const std::string& path, const char* text) {
+  std::string temporary = path + ".new";
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) return false;
+  bool ok = write(fd, text, strlen(text)) == static_cast<ssize_t>(strlen(text));
+  close(fd);
+  return ok && rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// Loads the same file repeatedly, mapping it from scratch every time and
+// then through a FileRegistry, and checks that the registry notices when a
+// cached file is replaced.
+static int run_registry(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  long loads = args.number("loads", 100);
+  if (loads <= 0) return -1;
+
+  RegistryOptions options;
+  options.revalidation =
+      args.has("inotify") ? Revalidation::kInotify : Revalidation::kStat;
+  FileRegistry registry(options);
+
+  uint64_t sum = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (long i = 0; i < loads; ++i) {
+    if (!load_without_registry(path, &sum)) {
+      perror(path);
+      return 1;
+    }
+  }
+  double plain_ms = elapsed_ms(start);
+
+  double first_ms = 0;
+  start = std::chrono::high_resolution_clock::now();
+  for (long i = 0; i < loads; ++i) {
+    FileHandle file;
+    if (registry.acquire(path, true, &file) == -1) {
+      perror(path);
+      return 1;
+    }
+    sum += touch_pages(file.data(), file.size());
+    if (i == 0) first_ms = elapsed_ms(start);
+  }
+  double registry_ms = elapsed_ms(start);
+
+  const char* mode = registry.stats().inotify ? "inotify" : "statx";
+  printf("%-24s %10.3f ms per load\n", "open+mmap every time",
+         plain_ms / loads);
+  printf("%-24s %10.3f ms first load, %.3f ms per later load (%s)\n",
+         "registry", first_ms,
+         loads > 1 ? (registry_ms - first_ms) / (loads - 1) : 0.0, mode);
+  printf("(checksum %lu)\n", static_cast<unsigned long>(sum));
+
+  // Replace a small cached file and wait for the registry to hand out the
+  // new contents; with inotify that takes as long as the event does.
+  char directory[] = "/tmp/read-file-registry-XXXXXX";
+  if (!mkdtemp(directory)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  std::string asset = std::string(directory) + "/asset";
+  bool replaced = false;
+  double detect_ms = 0;
+  FileHandle file;
+  if (replace_file(asset, "old") &&
+      registry.acquire(asset.c_str(), true, &file) == 0) {
+    file.reset();
+    start = std::chrono::high_resolution_clock::now();
+    if (replace_file(asset, "new!")) {
+      while (elapsed_ms(start) < 1000) {
+        if (registry.acquire(asset.c_str(), true, &file) == -1) break;
+        replaced = file.size() == 4 && memcmp(file.data(), "new!", 4) == 0;
+        file.reset();
+        if (replaced) break;
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+      detect_ms = elapsed_ms(start);
+    }
+  }
+  unlink(asset.c_str());
+  rmdir(directory);
+  if (replaced) {
+    printf("Replaced file picked up after %.3f ms\n", detect_ms);
+  } else {
+    printf("Replaced file not picked up\n");
+  }
+
+  FileRegistry::Stats stats = registry.stats();
+  printf("%llu hits, %llu misses, %llu statx checks, %llu stale, "
+         "%llu evictions, %zu open files, %.1f MB mapped\n",
+         static_cast<unsigned long long>(stats.hits),
+         static_cast<unsigned long long>(stats.misses),
+         static_cast<unsigned long long>(stats.revalidations),
+         static_cast<unsigned long long>(stats.stale),
+         static_cast<unsigned long long>(stats.evictions), stats.open_files,
+         mb(stats.mapped_bytes));
+  return replaced ? 0 : 1;
+}
+
+// Serves a series of requests for the same file through a StrategySelector
+// and prints every decision with its reason, then the learned model.
+// --evict-every drops the file from the page cache before every Nth request
+// so the selector sees both cold and cached reads.
+static int run_adaptive(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  std::string pattern_name =
+      args.has("pattern") ? args.flags.at("pattern") : "whole";
+  long requests = args.number("requests", 40);
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long evict_every = args.number("evict-every", 0);
+  SelectorOptions options;
+  options.exploration = args.real("exploration", options.exploration);
+  if (requests <= 0 || pieces <= 0 || evict_every < 0 ||
+      options.exploration < 0 || options.exploration > 1) {
+    return -1;
+  }
+  AccessPattern pattern;
+  if (pattern_name == "whole") {
+    pattern = AccessPattern::kWholeFile;
+  } else if (pattern_name == "chunks") {
+    pattern = AccessPattern::kChunks;
+  } else {
+    return -1;
+  }
+  // Every strategy unless --strategies narrows the candidates.
+  std::vector<ReadStrategy> strategies;
+  if (!select_strategies(args, &strategies)) return 1;
+  if (args.has("strategies")) {
+    for (const ReadStrategy& strategy : strategies) {
+      options.candidates.push_back(strategy.name);
+    }
+  }
+  int width = strategy_column_width(strategies);
+
+  StrategySelector selector(options);
+  printf("%4s %-*s %10s %9s  %s\n", "#", width, "strategy", "time ms",
+         "cached", "reason");
+  for (long request = 1; request <= requests; ++request) {
+    if (evict_every > 0 && request % evict_every == 1 % evict_every &&
+        evict_from_page_cache(path) == -1) {
+      perror("Error evicting file");
+    }
+    FileBuffer buffer;
+    StrategyDecision decision;
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!selector.read(path, pattern, pieces, &buffer, &decision)) return 1;
+    printf("%4ld %-*s %10.3f %8.1f%%  %s\n", request, width,
+           decision.strategy->name, elapsed_ms(start),
+           decision.resident_percent, decision.reason.c_str());
+  }
+
+  SelectorStats stats = selector.stats();
+  printf("\n%llu decisions, %llu spent exploring\n",
+         static_cast<unsigned long long>(stats.decisions),
+         static_cast<unsigned long long>(stats.explorations));
+  std::string context;
+  for (const SelectorArmStats& arm : stats.arms) {
+    if (arm.context != context) {
+      context = arm.context;
+      printf("%s:\n", context.c_str());
+    }
+    printf("  %c %-*s %5llu runs", arm.best ? '*' : ' ', width, arm.strategy,
+           static_cast<unsigned long long>(arm.runs));
+    if (arm.runs > 0) printf(" %10.3f ms/MB", arm.ms_per_mb);
+    printf("\n");
+  }
+  return 0;
+}
+
+// Creates a sparse file of `size_mb` MB at `path` in which every
+// `stride`th MB holds data and the rest is holes.
+static bool create_sparse_file(const char* path, size_t size_mb,
+                               size_t stride) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) return false;
+  std::vector<char> block = generate_content(1 << 20);
+  bool ok = ftruncate(fd, size_mb << 20) == 0;
+  for (size_t mb = 0; ok && mb < size_mb; mb += stride) {
+    ok = pwrite(fd, block.data(), block.size(), mb << 20) ==
+         static_cast<ssize_t>(block.size());
+  }
+  close(fd);
+  return ok;
+}
+
+// Shows the data extents of a (possibly sparse) file and compares reading
+// every byte with reading only the data.
+static int run_sparse(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  long create_mb = args.number("create-mb", 0);
+  long data_percent = args.number("data-percent", 10);
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  std::string method_name =
+      args.has("method") ? args.flags.at("method") : "auto";
+  if (create_mb < 0 || data_percent <= 0 || data_percent > 100 ||
+      pieces <= 0) {
+    return -1;
+  }
+  ExtentMethod method;
+  if (method_name == "auto") {
+    method = ExtentMethod::kAuto;
+  } else if (method_name == "seek") {
+    method = ExtentMethod::kSeekHole;
+  } else if (method_name == "fiemap") {
+    method = ExtentMethod::kFiemap;
+  } else if (method_name == "none") {
+    method = ExtentMethod::kWholeFile;
+  } else {
+    return -1;
+  }
+
+  if (create_mb > 0 && !create_sparse_file(path, create_mb,
+                                           100 / data_percent)) {
+    perror("Error creating sparse file");
+    return 1;
+  }
+
+  int fd = open(path, O_RDONLY);
+  struct stat sb;
+  size_t file_size;
+  if (fd == -1 || fstat(fd, &sb) == -1 ||
+      buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror(path);
+    if (fd != -1) close(fd);
+    return 1;
+  }
+  std::vector<FileExtent> extents;
+  ExtentMethod used;
+  auto start = std::chrono::high_resolution_clock::now();
+  int found = find_data_extents(fd, file_size, method, &extents, &used);
+  double find_ms = elapsed_ms(start);
+  if (found == -1) {
+    perror("Error finding data extents");
+    close(fd);
+    return 1;
+  }
+  size_t data_bytes = 0;
+  for (const FileExtent& extent : extents) data_bytes += extent.length;
+  printf("%zu data extents, %.1f MB data, %.1f MB holes, %.1f MB allocated "
+         "(%s, %.3f ms)\n",
+         extents.size(), mb(data_bytes), mb(file_size - data_bytes),
+         mb(static_cast<size_t>(sb.st_blocks) * 512), extent_method_name(used),
+         find_ms);
+
+  FileBuffer reference;
+  std::vector<ReadStrategy> strategies;
+  for (const char* name :
+       {"openOneGo", "preadMultipleGo", "sparsePreadMultipleGo"}) {
+    strategies.push_back(*find_read_strategy(name));
+  }
+  bool matches = true;
+  for (const ReadStrategy& strategy : strategies) {
+    if (args.has("evict") && evict_from_page_cache(path) == -1) {
+      perror("Error evicting file");
+    }
+    FileBuffer buffer;
+    start = std::chrono::high_resolution_clock::now();
+    if (!strategy.read(path, pieces, &buffer)) {
+      close(fd);
+      return 1;
+    }
+    printf("%-24s %10.3f ms\n", strategy.name, elapsed_ms(start));
+    if (!reference.data()) {
+      reference = std::move(buffer);
+    } else {
+      matches &= memcmp(reference.data(), buffer.data(),
+                        file_size) == 0;
+    }
+  }
+
+  // The same extents read in one pass, with the requested method.
+  if (args.has("evict") && evict_from_page_cache(path) == -1) {
+    perror("Error evicting file");
+  }
+  std::unique_ptr<char[]> buffer(new char[file_size]);
+  SparseReadStats stats;
+  start = std::chrono::high_resolution_clock::now();
+  if (read_sparse(fd, file_size, buffer.get(), 1 << 20, method, &stats) ==
+      -1) {
+    perror("Error reading file");
+    close(fd);
+    return 1;
+  }
+  printf("%-24s %10.3f ms  %zu preads, %.1f MB zero-filled\n", "read_sparse",
+         elapsed_ms(start), stats.reads, mb(stats.hole_bytes));
+  matches &= memcmp(reference.data(), buffer.get(), file_size) == 0;
+  close(fd);
+
+  printf("%s\n", matches ? "All reads match." : "Reads differ!");
+  return matches ? 0 : 1;
+}
+
+static uint64_t checksum(const char* data, size_t size) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < size; ++i) sum = sum * 31 + data[i];
+  return sum;
+}
+
+// Reassembles `src` with one strategy into each output sink. The heap
+// result has to be written out afterwards; the mapped file sink already is
+// the output file, and the memfd is mapped by a child process without a
+// copy.
+static int run_output(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.size() < 2) return -1;
+  const char* src = args.positional[0];
+  const char* dst = args.positional[1];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  if (pieces <= 0) return -1;
+  ReadStrategy strategy;
+  if (!find_strategy(
+          args.has("strategy") ? args.flags.at("strategy").c_str()
+                               : "preadMultipleGo",
+          &strategy)) {
+    return 1;
+  }
+
+  printf("%-12s %10s %10s %10s\n", "sink", "read ms", "output ms",
+         "durable ms");
+
+  FileBuffer heap;
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!strategy.read(src, pieces, &heap)) return 1;
+  double read_ms = elapsed_ms(start);
+  WriteTiming timing;
+  if (write_file(dst, heap.data(), heap.size(), WriteStrategy::kWrite,
+                 WriteOptions(), &timing) == -1) {
+    perror("Error writing output");
+    return 1;
+  }
+  printf("%-12s %10.3f %10.3f %10.3f\n", "heap", read_ms,
+         read_ms + timing.buffered_ms, read_ms + timing.durable_ms);
+  uint64_t expected = checksum(heap.data(), heap.size());
+
+  std::unique_ptr<OutputSink> file_sink = make_mapped_file_sink(dst, true);
+  if (!file_sink) {
+    perror(dst);
+    return 1;
+  }
+  FileBuffer mapped(std::move(file_sink));
+  start = std::chrono::high_resolution_clock::now();
+  if (!strategy.read(src, pieces, &mapped)) return 1;
+  read_ms = elapsed_ms(start);
+  if (mapped.sink().finish() == -1) {
+    perror("Error syncing output");
+    return 1;
+  }
+  printf("%-12s %10.3f %10.3f %10.3f\n", "mapped file", read_ms, read_ms,
+         elapsed_ms(start));
+  bool matches = checksum(mapped.data(), mapped.size()) == expected;
+
+  std::unique_ptr<OutputSink> memfd_sink = make_memfd_sink("read-file");
+  if (!memfd_sink) {
+    perror("Error creating memfd");
+    return 1;
+  }
+  FileBuffer shared(std::move(memfd_sink));
+  start = std::chrono::high_resolution_clock::now();
+  if (!strategy.read(src, pieces, &shared)) return 1;
+  read_ms = elapsed_ms(start);
+  if (shared.sink().finish() == -1) {
+    perror("Error sealing memfd");
+    return 1;
+  }
+  printf("%-12s %10.3f %10s %10s\n", "memfd", read_ms, "-", "-");
+
+  // The child only inherits the fd; it sees the parent's pages through its
+  // own mapping.
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    perror("fork");
+    return 1;
+  }
+  if (pid == 0) {
+    size_t size = shared.size();
+    void* memory = size ? mmap(nullptr, size, PROT_READ, MAP_SHARED,
+                               shared.sink().fd(), 0)
+                        : nullptr;
+    if (memory == MAP_FAILED) _exit(2);
+    _exit(checksum(static_cast<const char*>(memory), size) == expected ? 0
+                                                                        : 1);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  bool child_matches = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  printf("Mapped file %s, memfd seen by child process %s.\n",
+         matches ? "matches" : "differs",
+         child_matches ? "matches" : "differs");
+  return matches && child_matches ? 0 : 1;
+}
+
+// Identities of `chunks` of `data`, for counting how many an edited copy
+// shares with the original.
+static std::vector<size_t> chunk_hashes(const char* data,
+                                        const std::vector<FileExtent>& chunks) {
+  std::vector<size_t> hashes;
+  for (const FileExtent& chunk : chunks) {
+    hashes.push_back(std::hash<std::string_view>()(
+        std::string_view(data + chunk.offset, chunk.length)));
+  }
+  std::sort(hashes.begin(), hashes.end());
+  return hashes;
+}
+
+// Runs every chunk planner over the file and prints the chunk sizes they
+// produce and how fast they plan. Then inserts one byte in the middle of a
+// copy of the file and counts how many of the copy's chunks each planner
+// would still find in the original.
+static int run_chunk(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long average_kb = args.number("avg-kb", 64);
+  long threads = args.number("threads", 0);
+  if (pieces <= 0 || average_kb <= 0 || threads < 0) return -1;
+
+  FileBuffer file;
+  if (!find_read_strategy("openOneGo")->read(path, 0, &file)) return 1;
+  size_t size = file.size();
+  CdcOptions cdc;
+  cdc.average_size = average_kb << 10;
+  cdc.min_size = cdc.average_size / 4;
+  cdc.max_size = cdc.average_size * 4;
+
+  struct Variant {
+    std::string label;
+    std::unique_ptr<ChunkPlanner> planner;
+  };
+  std::vector<Variant> variants;
+  variants.push_back({"fixed", make_fixed_planner(pieces)});
+  variants.push_back({"page", make_page_aligned_planner(cdc.average_size)});
+  for (int variant = 0; variant < 3; ++variant) {
+    CdcOptions options = cdc;
+    options.vectorized = variant > 0;
+    options.threads = variant == 2 ? threads : 1;
+    std::string label = std::string("cdc ") + cdc_kernel_name(options);
+    if (variant == 2) label += " threads";
+    variants.push_back({label, make_cdc_planner(options)});
+  }
+
+  printf("%-20s %8s %10s %10s %10s %10s %9s\n", "planner", "chunks",
+         "min KB", "avg KB", "max KB", "time ms", "MB/s");
+  std::vector<FileExtent> reference;
+  bool cdc_agrees = true;
+  for (const Variant& variant : variants) {
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<FileExtent> chunks = variant.planner->plan(file.data(), size);
+    double ms = elapsed_ms(start);
+    size_t smallest = size;
+    size_t largest = 0;
+    for (const FileExtent& chunk : chunks) {
+      smallest = std::min(smallest, chunk.length);
+      largest = std::max(largest, chunk.length);
+    }
+    printf("%-20s %8zu %10.1f %10.1f %10.1f %10.3f %9.0f\n",
+           variant.label.c_str(), chunks.size(), smallest / 1024.0,
+           chunks.empty() ? 0.0 : size / 1024.0 / chunks.size(),
+           largest / 1024.0, ms, mb(size) / (ms / 1000));
+    if (strcmp(variant.planner->name(), "cdc") != 0) continue;
+    if (reference.empty()) {
+      reference = chunks;
+    } else {
+      cdc_agrees &= chunks.size() == reference.size() &&
+                    std::equal(chunks.begin(), chunks.end(), reference.begin(),
+                               [](const FileExtent& a, const FileExtent& b) {
+                                 return a.offset == b.offset &&
+                                        a.length == b.length;
+                               });
+    }
+  }
+  printf("CDC variants %s.\n", cdc_agrees ? "agree" : "DISAGREE");
+
+  std::vector<char> edited(file.data(), file.data() + size);
+  edited.insert(edited.begin() + size / 2, '!');
+  printf("After inserting one byte in the middle:\n");
+  for (size_t i = 0; i < 3; ++i) {
+    const ChunkPlanner& planner = *variants[i].planner;
+    std::vector<size_t> before =
+        chunk_hashes(file.data(), planner.plan(file.data(), size));
+    std::vector<size_t> after = chunk_hashes(
+        edited.data(), planner.plan(edited.data(), edited.size()));
+    std::vector<size_t> shared;
+    std::set_intersection(before.begin(), before.end(), after.begin(),
+                          after.end(), std::back_inserter(shared));
+    printf("  %-8s %zu of %zu chunks unchanged\n", planner.name(),
+           shared.size(), after.size());
+  }
+  return cdc_agrees ? 0 : 1;
+}
+
+// Times read_fully over the file with request sizes from `--min-kb` to
+// `--max-mb`, after the single read() the one-go strategies used to issue.
+// `--create-gb` first makes `file_path` a sparse file of that size, which
+// is enough to go past the 2GB per-call limit without writing anything.
+static int run_loop(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  long create_gb = args.number("create-gb", 0);
+  long min_kb = args.number("min-kb", 128);
+  long max_mb = args.number("max-mb", 64);
+  int runs = static_cast<int>(args.number("runs", 5));
+  if (create_gb < 0 || min_kb <= 0 || max_mb <= 0 || runs <= 0) return -1;
+
+  if (create_gb > 0) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || ftruncate(fd, static_cast<off_t>(create_gb) << 30) == -1) {
+      perror("Error creating file");
+      if (fd != -1) close(fd);
+      return 1;
+    }
+    close(fd);
+  }
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return 1;
+  }
+  struct stat sb;
+  size_t size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return 1;
+  }
+  // Touched up front, so only the reads are timed and not first-touch
+  // faults on the destination.
+  std::unique_ptr<char[]> buffer(new char[size]);
+  memset(buffer.get(), 0, size);
+
+  ssize_t single = read(fd, buffer.get(), size);
+  printf("One read() call: %zd of %zu bytes\n", single, size);
+
+  printf("%10s %8s %10s %9s %8s\n", "request KB", "calls", "best ms", "MB/s",
+         "short");
+  size_t fastest = 0;
+  double fastest_ms = 0;
+  for (size_t request = static_cast<size_t>(min_kb) << 10;
+       request <= static_cast<size_t>(max_mb) << 20; request *= 2) {
+    double best = 0;
+    ReadLoopStats stats;
+    for (int run = 0; run < runs; ++run) {
+      stats = ReadLoopStats();
+      lseek(fd, 0, SEEK_SET);
+      auto start = std::chrono::high_resolution_clock::now();
+      if (read_fully(fd, buffer.get(), size, request, &stats) == -1) {
+        perror("Error reading file");
+        close(fd);
+        return 1;
+      }
+      double ms = elapsed_ms(start);
+      if (run == 0 || ms < best) best = ms;
+    }
+    printf("%10zu %8zu %10.3f %9.0f %8zu\n", request >> 10, stats.calls, best,
+           mb(size) / (best / 1000), stats.short_reads);
+    if (fastest == 0 || best < fastest_ms) {
+      fastest = request;
+      fastest_ms = best;
+    }
+  }
+  close(fd);
+  printf("Fastest request: %zu KB (default %zu KB)\n", fastest >> 10,
+         kDefaultReadRequest >> 10);
+  return 0;
+}
+
+// Maps `path` shared and touches every page, then calls `loaded` with the
+// mapping still in place: the zero-copy way of holding a file, in which
+// every process uses the same page cache pages.
+static bool hold_mapped(const char* path, const std::function<void()>& loaded) {
+  int fd = open(path, O_RDONLY);
+  struct stat sb;
+  size_t size;
+  if (fd == -1 || fstat(fd, &sb) == -1 ||
+      buffer_size_for(sb.st_size, &size) == -1) {
+    perror("Error opening file");
+    if (fd != -1) close(fd);
+    return false;
+  }
+  void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    perror("Error mapping file");
+    return false;
+  }
+  const volatile char* data = static_cast<const char*>(memory);
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  char sum = 0;
+  for (size_t offset = 0; offset < size; offset += page) sum += data[offset];
+  (void)sum;
+  loaded();
+  munmap(memory, size);
+  return true;
+}
+
+// Runs `--workers` processes holding the file at once, first mapped and
+// shared, then each with its own heap copy from `--strategy`, and compares
+// their RSS and PSS, the host memory in use and the aggregate throughput.
+static int run_processes(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int workers = static_cast<int>(args.number("workers", 4));
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  if (workers <= 0 || pieces <= 0) return -1;
+  ReadStrategy strategy;
+  if (!find_strategy(args.has("strategy") ? args.flags.at("strategy").c_str()
+                                          : "openOneGo",
+                     &strategy)) {
+    return 1;
+  }
+  struct stat sb;
+  size_t file_size;
+  if (stat(path, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    return 1;
+  }
+
+  struct Mode {
+    std::string label;
+    ProcessTask task;
+  };
+  std::vector<Mode> modes;
+  modes.push_back({"mmap shared", [path](const std::function<void()>& loaded) {
+                     return hold_mapped(path, loaded);
+                   }});
+  modes.push_back({std::string(strategy.name) + " heap",
+                   [path, pieces, &strategy](
+                       const std::function<void()>& loaded) {
+                     FileBuffer buffer;
+                     if (!strategy.read(path, pieces, &buffer)) return false;
+                     loaded();
+                     return true;
+                   }});
+
+  printf("%d workers, file %.1f MB. Sizes in MB.\n", workers, mb(file_size));
+  printf("%-24s %6s %10s %9s %9s %9s %9s\n", "mode", "worker", "load ms",
+         "RSS", "PSS", "anon", "file");
+  std::vector<double> total_pss;
+  for (const Mode& mode : modes) {
+    MultiProcessResult result;
+    if (run_in_processes(workers, mode.task, &result) == -1) {
+      perror("Error running workers");
+      return 1;
+    }
+    MemoryUsage total;
+    for (size_t i = 0; i < result.workers.size(); ++i) {
+      const WorkerResult& worker = result.workers[i];
+      if (!worker.ok) {
+        fprintf(stderr, "Worker %zu failed\n", i);
+        return 1;
+      }
+      printf("%-24s %6zu %10.3f %9.1f %9.1f %9.1f %9.1f\n",
+             mode.label.c_str(), i, worker.ms, mb(worker.usage.rss),
+             mb(worker.usage.pss), mb(worker.usage.anonymous),
+             mb(worker.usage.file_backed));
+      total.rss += worker.usage.rss;
+      total.pss += worker.usage.pss;
+    }
+    size_t used_before = result.before.total - result.before.available;
+    size_t used_during = result.during.total - result.during.available;
+    printf("%-24s %6s %10.3f %9.1f %9.1f   host in use %+.1f MB, "
+           "%.0f MB/s aggregate\n",
+           mode.label.c_str(), "all", result.wall_ms, mb(total.rss),
+           mb(total.pss), (mb(used_during) - mb(used_before)),
+           mb(file_size) * workers / (result.wall_ms / 1000));
+    total_pss.push_back(mb(total.pss));
+  }
+  printf("Mapping instead of copying saves %.1f MB of PSS across %d "
+         "workers.\n",
+         total_pss[1] - total_pss[0], workers);
+  return 0;
+}
+
+// Reads the file cold in its shuffled chunk order with and without the
+// lookahead prefetcher, against reading the same chunks in file order, and
+// shows how the adaptive depth settled.
+static int run_prefetch(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 400));
+  PrefetchOptions options;
+  options.initial_depth = args.number("depth", options.initial_depth);
+  options.max_depth = args.number("max-depth", options.max_depth);
+  options.fixed = args.has("fixed");
+  if (pieces <= 0 || options.initial_depth == 0) return -1;
+
+  int fd = open(path, O_RDONLY);
+  struct stat sb;
+  size_t file_size;
+  if (fd == -1 || fstat(fd, &sb) == -1 ||
+      buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error opening file");
+    if (fd != -1) close(fd);
+    return 1;
+  }
+  std::unique_ptr<char[]> buffer(new char[file_size]);
+  memset(buffer.get(), 0, file_size);
+  std::vector<int> sequential(pieces);
+  std::iota(sequential.begin(), sequential.end(), 0);
+  std::vector<int> shuffled = create_random_read_sequence(pieces);
+
+  printf("%-28s %10s %9s %7s %7s %9s\n", "order", "ms", "MB/s", "hints",
+         "stalls", "depth");
+  struct Run {
+    const char* label;
+    const std::vector<int>* order;
+    bool prefetch;
+  };
+  for (const Run& run : {Run{"file order", &sequential, false},
+                         Run{"shuffled", &shuffled, false},
+                         Run{"shuffled + prefetch", &shuffled, true}}) {
+    if (evict_from_page_cache(path) == -1) perror("Error evicting file");
+    std::vector<ChunkRequest> chunks = chunk_requests(
+        make_fixed_planner(pieces)->plan(nullptr, file_size), *run.order,
+        buffer.get());
+    PrefetchStats stats;
+    auto start = std::chrono::high_resolution_clock::now();
+    int result = run.prefetch ? read_chunks_prefetched(fd, chunks, options,
+                                                       nullptr, &stats)
+                              : read_chunks_pread(fd, chunks, nullptr);
+    double ms = elapsed_ms(start);
+    if (result == -1) {
+      perror("Error reading file");
+      close(fd);
+      return 1;
+    }
+    printf("%-28s %10.3f %9.0f", run.label, ms, mb(file_size) / (ms / 1000));
+    if (run.prefetch) {
+      printf(" %7zu %7zu %4zu/%-4zu", stats.hints, stats.stalls,
+             stats.final_depth, stats.max_depth);
+    }
+    printf("\n");
+  }
+  close(fd);
+  printf("Depth is final/max chunks ahead. Every run starts with the file "
+         "evicted.\n");
+  return 0;
+}
+
+// Runs each strategy under a PhaseRecorder and prints the mean time of
+// every phase, once as the strategy normally runs and once with the
+// destination touched before the copy, which moves its first-touch faults
+// out of "read" and into "fault".
+static int run_phases(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 5);
+  if (pieces <= 0 || runs <= 0) return -1;
+  std::vector<ReadStrategy> strategies;
+  if (!select_strategies(args, &strategies)) return 1;
+
+  printf("%-40s %9s", "strategy", "total");
+  for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+    printf(" %9s", phase_name(static_cast<Phase>(phase)));
+  }
+  printf(" %9s %9s\n", "read flt", "fault flt");
+  for (const ReadStrategy& strategy : strategies) {
+    for (bool prefault : {false, true}) {
+      PhaseBreakdown mean;
+      double total_ms = 0;
+      for (long run = 0; run < runs; ++run) {
+        if (args.has("evict") && evict_from_page_cache(path) == -1) {
+          perror("Error evicting file");
+        }
+        FileBuffer buffer;
+        PhaseRecorder recorder(prefault);
+        auto start = std::chrono::high_resolution_clock::now();
+        if (!strategy.read(path, pieces, &buffer)) return 1;
+        double ms = elapsed_ms(start);
+        const PhaseBreakdown& phases = recorder.breakdown();
+        total_ms += ms;
+        for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+          mean.ms[phase] += phases.ms[phase];
+          mean.minor_faults[phase] += phases.minor_faults[phase];
+          mean.major_faults[phase] += phases.major_faults[phase];
+        }
+        // Whatever the strategy didn't mark (destructors after the last
+        // mark, the return) counts as other.
+        mean.ms[static_cast<size_t>(Phase::kOther)] +=
+            std::max(0.0, ms - phases.total_ms());
+      }
+      std::string label = strategy.name;
+      if (prefault) label += " +prefault";
+      printf("%-40s %9.3f", label.c_str(), total_ms / runs);
+      for (size_t phase = 0; phase < kPhaseCount; ++phase) {
+        printf(" %9.3f", mean.ms[phase] / runs);
+      }
+      auto faults = [&mean, runs](Phase phase) {
+        size_t index = static_cast<size_t>(phase);
+        return (mean.minor_faults[index] + mean.major_faults[index]) / runs;
+      };
+      printf(" %9llu %9llu\n",
+             static_cast<unsigned long long>(faults(Phase::kRead)),
+             static_cast<unsigned long long>(faults(Phase::kFault)));
+    }
+  }
+  printf("Mean ms per run over %ld runs; flt columns are page faults per "
+         "run.\n",
+         runs);
+  return 0;
+}
+
+// Compares ways of getting a mapping's page faults out of the way: none
+// (the copy takes them), MAP_POPULATE, and touching or MADV_POPULATE_READ
+// on one thread or split across `--threads`, either before the copy or
+// while it runs. The destination is prefaulted once, so the copy column
+// is the source side only.
+static int run_populate(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  long threads = args.number("threads", 4);
+  long runs = args.number("runs", 3);
+  if (threads <= 0 || runs <= 0) return -1;
+
+  int fd = open(path, O_RDONLY);
+  struct stat sb;
+  size_t file_size;
+  if (fd == -1 || fstat(fd, &sb) == -1 ||
+      buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error opening file");
+    if (fd != -1) close(fd);
+    return 1;
+  }
+  std::unique_ptr<char[]> buffer(new char[file_size]);
+  memset(buffer.get(), 0, file_size);
+
+  struct Variant {
+    PopulateMethod method;
+    size_t threads;
+    bool during;
+  };
+  size_t many = threads;
+  std::vector<Variant> variants = {
+      {PopulateMethod::kNone, 0, false},
+      {PopulateMethod::kMapPopulate, 1, false},
+      {PopulateMethod::kTouch, 1, false},
+      {PopulateMethod::kTouch, many, false},
+      {PopulateMethod::kMadvise, 1, false},
+      {PopulateMethod::kMadvise, many, false},
+      {PopulateMethod::kTouch, many, true},
+      {PopulateMethod::kMadvise, many, true},
+  };
+  printf("%-20s %7s %7s %11s %9s %9s\n", "method", "threads", "when",
+         "populate ms", "copy ms", "total ms");
+  for (const Variant& variant : variants) {
+    double populate_ms = 0;
+    double copy_ms = 0;
+    double total_ms = 0;
+    PopulateMethod used = variant.method;
+    for (long run = 0; run < runs; ++run) {
+      if (args.has("evict") && evict_from_page_cache(path) == -1) {
+        perror("Error evicting file");
+      }
+      auto start = std::chrono::high_resolution_clock::now();
+      // MAP_POPULATE is applied by mmap; the others by the Populator.
+      void* memory = mmap(nullptr, file_size, PROT_READ,
+                          variant.method == PopulateMethod::kMapPopulate
+                              ? MAP_PRIVATE | MAP_POPULATE
+                              : MAP_PRIVATE,
+                          fd, 0);
+      if (memory == MAP_FAILED) {
+        perror("Error mapping file");
+        close(fd);
+        return 1;
+      }
+      const char* data = static_cast<const char*>(memory);
+      Populator populator;
+      populator.start(data, file_size, variant.method, variant.threads);
+      if (!variant.during) used = populator.wait();
+      double populated = elapsed_ms(start);
+      memcpy(buffer.get(), data, file_size);
+      if (variant.during) used = populator.wait();
+      double ms = elapsed_ms(start);
+      munmap(memory, file_size);
+      populate_ms += populated;
+      copy_ms += ms - populated;
+      total_ms += ms;
+    }
+    if (variant.during) {
+      // Populating and copying overlap, so only the total means anything.
+      printf("%-20s %7zu %7s %11s %9s %9.3f\n", populate_method_name(used),
+             variant.threads, "during", "-", "-", total_ms / runs);
+    } else {
+      printf("%-20s %7zu %7s %11.3f %9.3f %9.3f\n",
+             populate_method_name(used), variant.threads, "before",
+             populate_ms / runs, copy_ms / runs, total_ms / runs);
+    }
+  }
+  close(fd);
+  printf("Mean of %ld runs.\n", runs);
+  return 0;
+}
+
+// CRC-32 as zip stores it (reflected, polynomial 0xedb88320).
+static uint32_t zip_crc32(const char* data, size_t size) {
+  static const std::vector<uint32_t> kTable = [] {
+    std::vector<uint32_t> table(256);
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320 : 0);
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; ++i) {
+    crc = kTable[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^
+          (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void put_le(std::string* out, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) out->push_back((value >> (8 * i)) & 0xff);
+}
+
+// A local file header, or with `central` a central directory entry
+// pointing at a local header at offset 0, followed by `name` and `extra`
+// zero bytes of padding.
+static std::string zip_header(bool central, uint16_t method, uint32_t crc,
+                              uint32_t compressed_size, uint32_t size,
+                              const std::string& name, size_t extra) {
+  std::string header;
+  put_le(&header, central ? 0x02014b50 : 0x04034b50, 4);
+  if (central) put_le(&header, 20, 2);  // Version made by.
+  put_le(&header, 20, 2);               // Version needed to extract.
+  put_le(&header, 0, 2);                // Flags.
+  put_le(&header, method, 2);
+  put_le(&header, 0, 4);                // Modification time and date.
+  put_le(&header, crc, 4);
+  put_le(&header, compressed_size, 4);
+  put_le(&header, size, 4);
+  put_le(&header, name.size(), 2);
+  put_le(&header, extra, 2);
+  if (central) {
+    // Comment length, disk, internal and external attributes, offset.
+    put_le(&header, 0, 2);
+    put_le(&header, 0, 2);
+    put_le(&header, 0, 2);
+    put_le(&header, 0, 4);
+    put_le(&header, 0, 4);
+  }
+  header += name;
+  header.append(extra, '\0');
+  return header;
+}
+
+// Writes an APK at `apk_path` whose only entry is `src_path` as
+// assets/<kAssetFileName>: stored, with the data padded to an `align` byte
+// boundary like zipalign does (4, or 4096 with -p), or with `compress`
+// deflated.
+static bool create_test_apk(const char* src_path, const char* apk_path,
+                            size_t align, bool compress) {
+  int fd = open(src_path, O_RDONLY);
+  struct stat sb;
+  size_t size;
+  if (fd == -1 || fstat(fd, &sb) == -1 ||
+      buffer_size_for(sb.st_size, &size) == -1) {
+    if (fd != -1) close(fd);
+    return false;
+  }
+  if (size == 0 || size >= 0xffffffff) {
+    // Empty files can't be mapped; bigger ones need zip64.
+    close(fd);
+    errno = size == 0 ? EINVAL : EFBIG;
+    return false;
+  }
+  void* memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) return false;
+  const char* data = static_cast<const char*>(memory);
+
+  std::string name = std::string("assets/") + kAssetFileName;
+  uint16_t method = compress ? 8 : 0;
+  uint32_t crc = zip_crc32(data, size);
+  size_t extra = 0;
+  if (!compress && align > 1) {
+    extra = (align - (30 + name.size()) % align) % align;
+  }
+  std::string local = zip_header(false, method, crc, size, size, name, extra);
+
+  FILE* out = fopen(apk_path, "wb");
+  bool ok = out && fwrite(local.data(), 1, local.size(), out) == local.size();
+  uint64_t compressed_size = size;
+  if (ok && !compress) {
+    ok = fwrite(data, 1, size, out) == size;
+  } else if (ok) {
+#ifdef FILEREAD_HAVE_ZLIB
+    z_stream stream = z_stream();
+    ok = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
+                      8, Z_DEFAULT_STRATEGY) == Z_OK;
+    std::vector<unsigned char> chunk(1 << 20);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = size;
+    int result = Z_OK;
+    while (ok && result != Z_STREAM_END) {
+      stream.next_out = chunk.data();
+      stream.avail_out = chunk.size();
+      result = deflate(&stream, Z_FINISH);
+      size_t produced = chunk.size() - stream.avail_out;
+      ok = (result == Z_OK || result == Z_STREAM_END) &&
+           fwrite(chunk.data(), 1, produced, out) == produced;
+    }
+    compressed_size = stream.total_out;
+    deflateEnd(&stream);
+#else
+    errno = ENOTSUP;
+    ok = false;
+#endif
+    if (ok && compressed_size >= 0xffffffff) {
+      errno = EFBIG;
+      ok = false;
+    }
+  }
+  munmap(memory, size);
+
+  if (ok) {
+    std::string central =
+        zip_header(true, method, crc, compressed_size, size, name, 0);
+    std::string end;
+    put_le(&end, 0x06054b50, 4);
+    put_le(&end, 0, 2);  // This disk.
+    put_le(&end, 0, 2);  // Disk with the central directory.
+    put_le(&end, 1, 2);  // Entries on this disk.
+    put_le(&end, 1, 2);  // Entries.
+    put_le(&end, central.size(), 4);
+    put_le(&end, local.size() + compressed_size, 4);
+    put_le(&end, 0, 2);  // Comment length.
+    central += end;
+    ok = fwrite(central.data(), 1, central.size(), out) == central.size();
+  }
+  if (ok && compress) {
+    // The compressed size wasn't known when the local header went out.
+    std::string patched = zip_header(false, method, crc, compressed_size,
+                                     size, name, extra);
+    ok = fseeko(out, 0, SEEK_SET) == 0 &&
+         fwrite(patched.data(), 1, patched.size(), out) == patched.size();
+  }
+  if (out) ok = fclose(out) == 0 && ok;
+  return ok;
+}
+
+// init() in the Android app: copies the asset out of the APK to a plain
+// file, with the kernel when the asset is stored and through getBuffer and
+// fwrite otherwise. `method` receives how.
+static bool extract_asset(AAssetManager* mgr, const char* dst_path,
+                          std::string* method) {
+  AAsset* asset = AAssetManager_open(mgr, kAssetFileName, AASSET_MODE_BUFFER);
+  if (!asset) return false;
+  off64_t start = 0;
+  off64_t length = 0;
+  int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+  if (fd >= 0) {
+    CopyMethod used = CopyMethod::kAuto;
+    int result = extract_to_file(fd, start, length, dst_path,
+                                 CopyMethod::kAuto, &used);
+    close(fd);
+    if (result == 0) {
+      AAsset_close(asset);
+      *method = copy_method_name(used);
+      return true;
+    }
+  }
+
+  bool ok = false;
+  const void* buffer = AAsset_getBuffer(asset);
+  FILE* out_file = buffer ? fopen(dst_path, "wb") : nullptr;
+  if (out_file) {
+    size_t size = AAsset_getLength64(asset);
+    ok = fwrite(buffer, 1, size, out_file) == size;
+    ok = fclose(out_file) == 0 && ok;
+  }
+  AAsset_close(asset);
+  *method = "getBuffer + fwrite";
+  return ok;
+}
+
+// Packs the file into an APK and compares reading it as an asset (the
+// Android app's AAsset strategies, on the Linux stand-in) with extracting
+// it first, as init() does, and reading the extracted copy with the file
+// strategies. Every read is checked against the original on its first run.
+static int run_asset(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  if (args.positional.empty()) return -1;
+  const char* path = args.positional[0];
+  std::string apk_path = args.has("apk") ? args.flags.at("apk")
+                                         : std::string(path) + ".apk";
+  std::string extracted_path = std::string(path) + ".extracted";
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 3);
+  long align = args.number("align", 4);
+  if (pieces <= 0 || runs <= 0 || align <= 0) return -1;
+  std::vector<ReadStrategy> file_strategies;
+  if (args.has("strategies")) {
+    if (!select_strategies(args, &file_strategies)) return 1;
+  } else {
+    file_strategies = {*find_read_strategy("openOneGo"),
+                       *find_read_strategy("openWithMmapOneGo")};
+  }
+
+  FileBuffer original;
+  if (!find_read_strategy("openOneGo")->read(path, 1, &original)) return 1;
+  uint64_t expected = checksum(original.data(), original.size());
+
+  bool compress = args.has("deflate");
+  auto start = std::chrono::high_resolution_clock::now();
+  if (!create_test_apk(path, apk_path.c_str(), align, compress)) {
+    perror("Error creating APK");
+    return 1;
+  }
+  printf("Packed %s into %s (%s) in %.3f ms\n", path, apk_path.c_str(),
+         compress ? "deflated" : "stored", elapsed_ms(start));
+  ZipArchive archive;
+  const ZipEntry* entry = nullptr;
+  if (archive.open(apk_path.c_str()) == 0) {
+    entry = archive.find(std::string("assets/") + kAssetFileName);
+  }
+  if (!entry) {
+    perror("Error reading APK");
+    return 1;
+  }
+  printf("Asset data at offset %lld, %s\n",
+         static_cast<long long>(entry->data_offset),
+         entry->page_aligned() ? "page aligned" : "not page aligned");
+
+  AAssetManager* mgr = asset_manager_open(apk_path.c_str());
+  if (!mgr) {
+    perror("Error opening APK");
+    return 1;
+  }
+  unlink(extracted_path.c_str());
+  std::string method;
+  start = std::chrono::high_resolution_clock::now();
+  bool extracted = extract_asset(mgr, extracted_path.c_str(), &method);
+  double init_ms = elapsed_ms(start);
+  asset_manager_close(mgr);
+  if (!extracted) {
+    perror("Error extracting asset");
+    return 1;
+  }
+  struct stat extracted_sb;
+  stat(extracted_path.c_str(), &extracted_sb);
+  // What apkMmapOneGo and the fd strategies don't need.
+  printf("init (extract with %s): %.3f ms, %.1f MB more on disk\n",
+         method.c_str(), init_ms, extracted_sb.st_blocks * 512 / 1048576.0);
+
+  struct Source {
+    const std::vector<ReadStrategy>* strategies;
+    const char* label;
+    std::string path;
+  };
+  Source sources[] = {
+      {&asset_strategies(), "apk", apk_path},
+      {&file_strategies, "extracted", extracted_path},
+  };
+  bool all_match = true;
+  printf("%-32s %-10s %10s %6s\n", "strategy", "source", "mean ms", "check");
+  for (const Source& source : sources) {
+    for (const ReadStrategy& strategy : *source.strategies) {
+      double total_ms = 0;
+      bool ok = true;
+      bool match = true;
+      for (long run = 0; run < runs && ok; ++run) {
+        if (args.has("evict") &&
+            evict_from_page_cache(source.path.c_str()) == -1) {
+          perror("Error evicting file");
+        }
+        FileBuffer buffer;
+        start = std::chrono::high_resolution_clock::now();
+        ok = strategy.read(source.path.c_str(), pieces, &buffer);
+        total_ms += elapsed_ms(start);
+        if (ok && run == 0) {
+          match = buffer.size() == original.size() &&
+                  checksum(buffer.data(), buffer.size()) == expected;
+        }
+      }
+      if (!ok) {
+        // E.g. the fd strategies on a deflated asset.
+        printf("%-32s %-10s %10s %6s\n", strategy.name, source.label, "-",
+               "failed");
+        continue;
+      }
+      all_match = all_match && match;
+      printf("%-32s %-10s %10.3f %6s\n", strategy.name, source.label,
+             total_ms / runs, match ? "ok" : "DIFFERS");
+    }
+  }
+  printf("Mean of %ld runs.\n", runs);
+  return all_match ? 0 : 1;
+}
+
+// Exit status of the bench command when the machine class has no baseline,
+// which CTest reports as skipped rather than passed or failed.
+constexpr int kBenchSkipped = 77;
+
+// Writes `size_mb` of generated content to `path` unless it already has
+// that size, so repeated bench runs reuse (and keep cached) the same file.
+static bool ensure_bench_file(const char* path, size_t size_mb) {
+  struct stat sb;
+  size_t size = size_mb << 20;
+  if (stat(path, &sb) == 0 && static_cast<size_t>(sb.st_size) == size) {
+    return true;
+  }
+  std::vector<char> content = generate_content(size);
+  if (write_file(path, content.data(), content.size(), WriteStrategy::kWrite,
+                 WriteOptions(), nullptr) == -1) {
+    perror("Error generating file");
+    return false;
+  }
+  return true;
+}
+
+// Runs the strategy matrix and compares the median times with the stored
+// baseline for this machine class. Every round runs each strategy once, so
+// drift over the run (thermal, other load) hits all of them alike.
+static int run_bench(int argc, char* argv[]) {
+  Args args = parse_args(argc, argv);
+  auto baseline_dir = args.flags.find("baseline-dir");
+  if (args.positional.empty() || baseline_dir == args.flags.end()) return -1;
+  const char* path = args.positional[0];
+  int pieces = static_cast<int>(args.number("pieces", 100));
+  long runs = args.number("runs", 5);
+  long generate_mb = args.number("generate-mb", 0);
+  BenchThresholds thresholds;
+  thresholds.slowdown_pct = args.real("threshold", thresholds.slowdown_pct);
+  thresholds.noise_factor = args.real("noise-factor", thresholds.noise_factor);
+  thresholds.min_delta_ms = args.real("min-delta-ms", thresholds.min_delta_ms);
+  if (pieces <= 0 || runs <= 0 || generate_mb < 0) return -1;
+
+  std::string machine =
+      args.has("machine") ? args.flags["machine"] : machine_class();
+  std::string baseline_path = baseline_dir->second + "/" + machine + ".txt";
+  Baseline baseline;
+  bool have_baseline = load_baseline(baseline_path.c_str(), &baseline) == 0;
+  if (!have_baseline && errno != ENOENT) {
+    perror(baseline_path.c_str());
+    return 1;
+  }
+  if (!have_baseline && !args.has("update")) {
+    printf("No baseline for machine class %s (%s); record one with "
+           "--update.\n",
+           machine.c_str(), baseline_path.c_str());
+    return kBenchSkipped;
+  }
+
+  if (generate_mb > 0 && !ensure_bench_file(path, generate_mb)) return 1;
+  struct stat sb;
+  size_t file_size;
+  if (stat(path, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    return 1;
+  }
+  if (have_baseline && !args.has("update") &&
+      (baseline.file_size != file_size || baseline.pieces != pieces)) {
+    fprintf(stderr,
+            "Baseline %s was recorded with a %zu byte file and %d pieces, "
+            "this run has %zu bytes and %d pieces.\n",
+            baseline_path.c_str(), baseline.file_size, baseline.pieces,
+            file_size, pieces);
+    return 1;
+  }
+
+  std::vector<ReadStrategy> strategies;
+  if (!select_strategies(args, &strategies)) return 1;
+
+  // One untimed round first, so the file is in the page cache and every
+  // strategy is measured warm.
+  std::vector<std::vector<double>> times(strategies.size());
+  for (long round = 0; round <= runs; ++round) {
+    for (size_t i = 0; i < strategies.size(); ++i) {
+      FileBuffer buffer;
+      auto start = std::chrono::high_resolution_clock::now();
+      if (!strategies[i].read(path, pieces, &buffer)) return 1;
+      double ms = elapsed_ms(start);
+      if (round > 0) times[i].push_back(ms);
+    }
+  }
+  std::vector<BaselineEntry> current;
+  for (size_t i = 0; i < strategies.size(); ++i) {
+    current.push_back(summarize_runs(strategies[i].name, times[i]));
+  }
+
+  printf("machine class %s, %zu bytes, %d pieces, median of %ld runs\n",
+         machine.c_str(), file_size, pieces, runs);
+  if (args.has("update")) {
+    Baseline updated;
+    updated.file_size = file_size;
+    updated.pieces = pieces;
+    // Keep hand-tuned thresholds.
+    updated.threshold_pct = baseline.threshold_pct;
+    int width = strategy_column_width(strategies);
+    for (BaselineEntry entry : current) {
+      const BaselineEntry* old = baseline.find(entry.name);
+      if (old) entry.threshold_pct = old->threshold_pct;
+      updated.entries.push_back(entry);
+      printf("%-*s %10.3f ms  noise %5.1f%%\n", width, entry.name.c_str(),
+             entry.median_ms, entry.noise_pct);
+    }
+    if (save_baseline(baseline_path.c_str(), machine, updated) == -1) {
+      perror(baseline_path.c_str());
+      return 1;
+    }
+    printf("Wrote %s\n", baseline_path.c_str());
+    return 0;
+  }
+
+  std::vector<BenchComparison> comparisons =
+      compare_to_baseline(baseline, current, thresholds);
+  printf("%s", format_bench_report(comparisons).c_str());
+  if (has_regression(comparisons)) {
+    printf("Performance regression against %s. If the slowdown is "
+           "intended, rerun with --update and commit the new baseline.\n",
+           baseline_path.c_str());
+    return 1;
+  }
+  return 0;
+}
+
+struct Command {
+  const char* name;
+  const char* args;
+  int (*run)(int argc, char* argv[]);
+};
+
+static const Command kCommands[] = {
+    {"run",
+     "<strategy> <file_path> [--pieces=N] [--runs=N] [--evict] "
+     "[--sample-ms=N] [--bitmap-chunks=N]",
+     run_strategy},
+    {"vectored",
+     "<file_path> [--pieces=N] [--window=N] [--no-nowait] [--evict]",
+     run_vectored},
+    {"async", "<file_path> [--loads=N] [--threads=N] [--cancel-after-ms=N]",
+     run_async},
+    {"parallel",
+     "<file_path> [--threads=N] [--numa=none|local|interleave] [--runs=N] "
+     "[--evict]",
+     run_parallel},
+    {"lazy",
+     "<file_path> [--percent=N] [--chunk-kb=N] [--span-kb=N] [--evict] "
+     "[--bitmap]",
+     run_lazy},
+    {"fault",
+     "<file_path> [--percent=N] [--span-kb=N] [--prefetch=N] [--xor=KEY] "
+     "[--eager] [--evict]",
+     run_fault},
+    {"shared-cache",
+     "<file_path> [--workers=N] [--rounds=N] [--chunk-kb=N] [--slots=N]",
+     run_shared_cache},
+    {"extract", "<src_path> <dst_path>", run_extract},
+    {"asset",
+     "<file_path> [--apk=PATH] [--deflate] [--align=N] [--pieces=N] "
+     "[--runs=N] [--evict] [--strategies=a,b,...]",
+     run_asset},
+    {"write", "<dst_path> [size_mb] [chunk_kb]", run_write},
+    {"process",
+     "<file_path> [--kernel=histogram|newlines|ascii] [--pieces=N] "
+     "[--runs=N] [--evict] [--strategies=a,b,...]",
+     run_process},
+    {"pipeline",
+     "<file_path> [--chunk-kb=N] [--queue=N] [--read-threads=N] "
+     "[--window=N] [--threads=DECODE,VERIFY,PARSE]",
+     run_pipeline_command},
+    {"adaptive",
+     "<file_path> [--pattern=whole|chunks] [--requests=N] [--pieces=N] "
+     "[--evict-every=N] [--exploration=F] [--strategies=a,b,...]",
+     run_adaptive},
+    {"registry", "<file_path> [--loads=N] [--inotify]", run_registry},
+    {"sparse",
+     "<file_path> [--create-mb=N] [--data-percent=N] "
+     "[--method=auto|seek|fiemap|none] [--pieces=N] [--evict]",
+     run_sparse},
+    {"output",
+     "<src_path> <dst_path> [--strategy=NAME] [--pieces=N]", run_output},
+    {"chunk", "<file_path> [--pieces=N] [--avg-kb=N] [--threads=N]",
+     run_chunk},
+    {"loop", "<file_path> [--create-gb=N] [--min-kb=N] [--max-mb=N] [--runs=N]",
+     run_loop},
+    {"prefetch",
+     "<file_path> [--pieces=N] [--depth=N] [--max-depth=N] [--fixed]",
+     run_prefetch},
+    {"populate", "<file_path> [--threads=N] [--runs=N] [--evict]",
+     run_populate},
+    {"processes",
+     "<file_path> [--workers=N] [--strategy=NAME] [--pieces=N]",
+     run_processes},
+    {"phases", "<file_path> [--pieces=N] [--runs=N] [--evict] "
+     "[--strategies=a,b,...]",
+     run_phases},
+    {"memory",
+     "<file_path> [--pieces=N] [--runs=N] [--sample-ms=N] "
+     "[--strategies=a,b,...]",
+     run_memory},
+    {"bench",
+     "<file_path> --baseline-dir=DIR [--machine=CLASS] [--generate-mb=N] "
+     "[--runs=N] [--pieces=N] [--strategies=a,b,...] [--threshold=PCT] "
+     "[--noise-factor=N] [--min-delta-ms=N] [--update]",
+     run_bench},
+};
+
+static void print_usage(const char* program) {
+  std::cerr << "Usage: " << program << " <file_path>" << std::endl;
+  for (const Command& command : kCommands) {
+    std::cerr << "       " << program << " " << command.name << " "
+              << command.args << std::endl;
+  }
+  std::cerr << "Strategies:";
+  for (const ReadStrategy& strategy : all_read_strategies()) {
+    std::cerr << " " << strategy.name;
+  }
+  std::cerr << std::endl;
 }
 
 int main(int argc, char* argv[]) {
   if (argc < 2) {
-    std::cerr << "Usage: " << argv[0] << " <file_path>" << std::endl;
+    print_usage(argv[0]);
     return 1;
   }
+  for (const Command& command : kCommands) {
+    if (strcmp(argv[1], command.name) == 0) {
+      int result = command.run(argc - 2, argv + 2);
+      if (result == -1) {
+        print_usage(argv[0]);
+        return 1;
+      }
+      return result;
+    }
+  }
   const char* filename = argv[1];
   read_file_chunks(filename);
   return 0;
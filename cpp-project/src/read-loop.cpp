@@ -0,0 +1,71 @@
+#include "read-loop.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace {
+
+// `offset` < 0 reads from the file position.
+int read_loop(int fd, char* buffer, size_t size, off_t offset,
+              size_t request_size, ReadLoopStats* stats) {
+  ReadLoopStats local;
+  if (!stats) stats = &local;
+  if (request_size == 0) request_size = kDefaultReadRequest;
+  request_size = std::min(request_size, kMaxTransfer);
+
+  size_t done = 0;
+  while (done < size) {
+    size_t request = std::min(request_size, size - done);
+    ssize_t n = offset < 0
+                    ? read(fd, buffer + done, request)
+                    : pread(fd, buffer + done, request,
+                            offset + static_cast<off_t>(done));
+    ++stats->calls;
+    if (n == -1) {
+      if (errno == EINTR) {
+        ++stats->interrupted;
+        continue;
+      }
+      return -1;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+    if (static_cast<size_t>(n) < request) ++stats->short_reads;
+    done += n;
+  }
+  return 0;
+}
+
+}  // namespace
+
+int read_fully(int fd, char* buffer, size_t size, size_t request_size,
+               ReadLoopStats* stats) {
+  return read_loop(fd, buffer, size, -1, request_size, stats);
+}
+
+int pread_fully(int fd, char* buffer, size_t size, off_t offset,
+                size_t request_size, ReadLoopStats* stats) {
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return read_loop(fd, buffer, size, offset, request_size, stats);
+}
+
+int buffer_size_for(off_t file_size, size_t* out) {
+  if (file_size < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (static_cast<uintmax_t>(file_size) > PTRDIFF_MAX) {
+    errno = EFBIG;
+    return -1;
+  }
+  *out = static_cast<size_t>(file_size);
+  return 0;
+}
@@ -0,0 +1,49 @@
+// Reading a whole range of a file with read(2)/pread(2). One call isn't
+// enough: Linux transfers at most 0x7ffff000 bytes (just under 2GB) per
+// call, a signal can interrupt it with EINTR or a partial count, and FUSE
+// and network file systems return short reads whenever they like. The loop
+// here issues requests of a fixed size until the range is full.
+//
+// Offsets are off_t throughout, which the build makes 64-bit on 32-bit
+// targets too (_FILE_OFFSET_BITS=64), so files past 4GB work there as well
+// as long as they fit in the address space.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+
+// Linux transfers at most this many bytes per read/write style call; larger
+// requests are clamped to it here, and file-copy/file-write clamp theirs.
+constexpr size_t kMaxTransfer = 0x7ffff000;
+
+// Request size used when none is given. `read-file loop` sweeps 128KB to
+// 64MB: past a few hundred KB the syscall overhead is gone and larger
+// requests only add cache misses on the copy.
+constexpr size_t kDefaultReadRequest = 1 << 20;
+
+struct ReadLoopStats {
+  size_t calls = 0;
+  // Calls that failed with EINTR and were retried.
+  size_t interrupted = 0;
+  // Calls that returned less than requested, without reaching the end.
+  size_t short_reads = 0;
+};
+
+// Reads `size` bytes from the file position of `fd` into `buffer`, in
+// requests of at most `request_size` bytes (0 means kDefaultReadRequest;
+// anything over kMaxTransfer is clamped to it).
+// Returns 0 on success, -1 with errno set (EIO when the file ended first).
+int read_fully(int fd, char* buffer, size_t size, size_t request_size = 0,
+               ReadLoopStats* stats = nullptr);
+
+// Same as read_fully, from `offset` with pread(2); the file position is
+// left alone.
+int pread_fully(int fd, char* buffer, size_t size, off_t offset,
+                size_t request_size = 0, ReadLoopStats* stats = nullptr);
+
+// Stores a file size from st_size or lseek in `out`. Returns 0 on success,
+// -1 with errno set: EINVAL when negative, EFBIG when the whole file can't
+// be held in one buffer by this process (a 6GB file on a 32-bit ABI).
+int buffer_size_for(off_t file_size, size_t* out);
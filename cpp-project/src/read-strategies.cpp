@@ -0,0 +1,585 @@
+// The strategies here follow native-lib.cpp line for line where they can;
+// only the logging and the JNI plumbing are gone.
+
+#include "read-strategies.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <random>
+
+#include "chunk-planner.h"
+#include "file-registry.h"
+#include "phase-timing.h"
+#include "populate.h"
+#include "prefetcher.h"
+#include "read-loop.h"
+#include "sparse-file.h"
+#include "vectored-read.h"
+
+int allocate_output(FileBuffer* out, size_t size) {
+  if (out->allocate(size) == -1) return -1;
+  phase_end(Phase::kAllocate);
+  if (phase_prefault_output()) prefault_pages(out->data(), size);
+  return 0;
+}
+
+namespace {
+
+bool open_one_go(const char* path, int, FileBuffer* out,
+                 const ChunkReady& ready) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  size_t file_size;
+  if (buffer_size_for(sb.st_size, &file_size) == -1 ||
+      allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    close(fd);
+    return false;
+  }
+
+  if (read_fully(fd, out->data(), file_size) == -1) {
+    perror("Error reading file");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), file_size);
+  phase_end(Phase::kCallback);
+
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool open_no_stat_one_go(const char* path, int, FileBuffer* out,
+                         const ChunkReady& ready) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  off_t end = lseek(fd, 0, SEEK_END);
+  if (end == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+  lseek(fd, 0, SEEK_SET);
+  phase_end(Phase::kSize);
+
+  size_t file_size;
+  if (buffer_size_for(end, &file_size) == -1 ||
+      allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    close(fd);
+    return false;
+  }
+
+  if (read_fully(fd, out->data(), file_size) == -1) {
+    perror("Error reading file");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), file_size);
+  phase_end(Phase::kCallback);
+
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool fopen_one_go(const char* path, int, FileBuffer* out,
+                  const ChunkReady& ready) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  // ftello rather than ftell: a long is 32 bits on 32-bit ABIs.
+  fseeko(file, 0, SEEK_END);
+  off_t end = ftello(file);
+  fseeko(file, 0, SEEK_SET);
+  if (end < 0) {
+    perror("Error getting file size");
+    fclose(file);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  size_t file_size;
+  if (buffer_size_for(end, &file_size) == -1 ||
+      allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    fclose(file);
+    return false;
+  }
+
+  // fread loops over short reads and EINTR itself.
+  if (fread(out->data(), 1, file_size, file) != file_size) {
+    perror("Error reading file");
+    fclose(file);
+    return false;
+  }
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), file_size);
+  phase_end(Phase::kCallback);
+
+  fclose(file);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool ifstream_one_go(const char* path, int, FileBuffer* out,
+                     const ChunkReady& ready) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  std::streamoff end = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (end < 0) {
+    perror("Error getting file size");
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  size_t file_size;
+  if (buffer_size_for(end, &file_size) == -1 ||
+      allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    return false;
+  }
+
+  if (!file.read(out->data(), file_size)) {
+    perror("Error reading file");
+    return false;
+  }
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), file_size);
+  phase_end(Phase::kCallback);
+  return true;
+}
+
+bool ifstream_multiple_go(const char* path, int n, FileBuffer* out,
+                          const ChunkReady& ready) {
+  std::vector<int> indices = create_random_read_sequence(n);
+  phase_end(Phase::kOther);
+
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  std::streamoff end = file.tellg();
+  file.seekg(0, std::ios::beg);
+  if (end < 0) {
+    perror("Error getting file size");
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  size_t file_size;
+  if (buffer_size_for(end, &file_size) == -1 ||
+      allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    return false;
+  }
+  std::vector<ChunkRequest> chunks = chunk_requests(
+      make_fixed_planner(n)->plan(nullptr, file_size), indices, out->data());
+
+  for (const ChunkRequest& chunk : chunks) {
+    file.seekg(chunk.offset, std::ios::beg);
+    if (!file.read(chunk.dest, chunk.size)) {
+      perror("Error reading file");
+      return false;
+    }
+    phase_end(Phase::kRead);
+    if (ready) ready(chunk.dest, chunk.size);
+    phase_end(Phase::kCallback);
+  }
+  return true;
+}
+
+// Shared by both mmap strategies: maps `path` and hands the mapping to
+// `copy`, which fills `out`.
+template <typename Copy>
+bool with_mapped_file(const char* path, FileBuffer* out, Copy copy) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  // mmap() rejects a zero length; an empty file has nothing to copy anyway.
+  if (file_size == 0) {
+    bool ok = allocate_output(out, 0) == 0;
+    if (!ok) perror("Error allocating output");
+    close(fd);
+    phase_end(Phase::kClose);
+    return ok;
+  }
+
+  void* file_memory = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (file_memory == MAP_FAILED) {
+    perror("Error mapping file");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kMap);
+
+  if (allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    munmap(file_memory, file_size);
+    close(fd);
+    return false;
+  }
+  copy(static_cast<const char*>(file_memory), file_size);
+
+  munmap(file_memory, file_size);
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool open_with_mmap_one_go(const char* path, int, FileBuffer* out,
+                           const ChunkReady& ready) {
+  return with_mapped_file(
+      path, out, [out, &ready](const char* file_memory, size_t file_size) {
+        memcpy(out->data(), file_memory, file_size);
+        phase_end(Phase::kRead);
+        if (ready) ready(out->data(), file_size);
+        phase_end(Phase::kCallback);
+      });
+}
+
+bool open_with_mmap_multiple_go(const char* path, int n, FileBuffer* out,
+                                const ChunkReady& ready) {
+  std::vector<int> indices = create_random_read_sequence(n);
+  phase_end(Phase::kOther);
+  return with_mapped_file(
+      path, out,
+      [out, n, &indices, &ready](const char* file_memory, size_t file_size) {
+        std::vector<ChunkRequest> chunks =
+            chunk_requests(make_fixed_planner(n)->plan(nullptr, file_size),
+                           indices, out->data());
+        for (const ChunkRequest& chunk : chunks) {
+          memcpy(chunk.dest, file_memory + chunk.offset, chunk.size);
+          phase_end(Phase::kRead);
+          if (ready) ready(chunk.dest, chunk.size);
+          phase_end(Phase::kCallback);
+        }
+      });
+}
+
+// openWithMmapOneGo with one thread per CPU populating the mapping
+// (MADV_POPULATE_READ) while the memcpy walks it, so the source page
+// faults are taken in parallel instead of one by one by the copy.
+bool open_with_mmap_populate_one_go(const char* path, int, FileBuffer* out,
+                                    const ChunkReady& ready) {
+  return with_mapped_file(
+      path, out, [out, &ready](const char* file_memory, size_t file_size) {
+        Populator populator;
+        populator.start(file_memory, file_size, PopulateMethod::kMadvise, 0);
+        memcpy(out->data(), file_memory, file_size);
+        populator.wait();
+        phase_end(Phase::kRead);
+        if (ready) ready(out->data(), file_size);
+        phase_end(Phase::kCallback);
+      });
+}
+
+// openWithMmapMultipleGo with MADV_WILLNEED for the chunks coming up next
+// in the shuffled order, so they are read in while earlier ones are copied.
+bool open_with_mmap_prefetch_multiple_go(const char* path, int n,
+                                         FileBuffer* out,
+                                         const ChunkReady& ready) {
+  std::vector<int> indices = create_random_read_sequence(n);
+  phase_end(Phase::kOther);
+  return with_mapped_file(
+      path, out,
+      [out, n, &indices, &ready](const char* file_memory, size_t file_size) {
+        std::vector<FileExtent> plan =
+            make_fixed_planner(n)->plan(nullptr, file_size);
+        std::vector<FileExtent> order;
+        for (int index : indices) order.push_back(plan[index]);
+        LookaheadPrefetcher prefetcher(-1, file_memory, order);
+        phase_end(Phase::kOther);
+        for (size_t i = 0; i < order.size(); ++i) {
+          const FileExtent& chunk = order[i];
+          prefetcher.begin(i);
+          memcpy(out->data() + chunk.offset, file_memory + chunk.offset,
+                 chunk.length);
+          prefetcher.end(i);
+          phase_end(Phase::kRead);
+          if (ready) ready(out->data() + chunk.offset, chunk.length);
+          phase_end(Phase::kCallback);
+        }
+      });
+}
+
+// openWithMmapOneGo through the process-wide registry: after the first call
+// the file stays open and mapped, so only the copy is left.
+bool registry_mmap_one_go(const char* path, int, FileBuffer* out,
+                          const ChunkReady& ready) {
+  FileHandle file;
+  if (FileRegistry::global().acquire(path, true, &file) == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  // Open, size and map all at once, or a cache hit.
+  phase_end(Phase::kOpen);
+
+  size_t file_size = file.size();
+  if (allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    return false;
+  }
+  memcpy(out->data(), file.data(), file_size);
+  phase_end(Phase::kRead);
+  if (ready) ready(out->data(), file_size);
+  phase_end(Phase::kCallback);
+  return true;
+}
+
+// Shared by the pread/preadv strategies: opens `path`, allocates `out` and
+// reads the shuffled chunk plan with `read_chunks`.
+template <typename ReadChunks>
+bool with_chunk_plan(const char* path, int n, FileBuffer* out,
+                     ReadChunks read_chunks) {
+  std::vector<int> indices = create_random_read_sequence(n);
+  phase_end(Phase::kOther);
+
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  if (allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    close(fd);
+    return false;
+  }
+
+  std::vector<ChunkRequest> chunks = chunk_requests(
+      make_fixed_planner(n)->plan(nullptr, file_size), indices, out->data());
+  phase_end(Phase::kOther);
+  if (read_chunks(fd, chunks) == -1) {
+    perror("Error reading file");
+    close(fd);
+    return false;
+  }
+
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+bool pread_multiple_go(const char* path, int n, FileBuffer* out,
+                       const ChunkReady& ready) {
+  return with_chunk_plan(
+      path, n, out, [&ready](int fd, const std::vector<ChunkRequest>& chunks) {
+        if (!ready) {
+          int result = read_chunks_pread(fd, chunks, nullptr);
+          phase_end(Phase::kRead);
+          return result;
+        }
+        // One chunk at a time, so each can be processed as soon as it is in.
+        for (const ChunkRequest& chunk : chunks) {
+          if (read_chunks_pread(fd, {chunk}, nullptr) == -1) return -1;
+          phase_end(Phase::kRead);
+          ready(chunk.dest, chunk.size);
+          phase_end(Phase::kCallback);
+        }
+        return 0;
+      });
+}
+
+// preadMultipleGo with readahead(2) for the chunks coming up next.
+bool pread_prefetch_multiple_go(const char* path, int n, FileBuffer* out,
+                                const ChunkReady& ready) {
+  return with_chunk_plan(
+      path, n, out, [&ready](int fd, const std::vector<ChunkRequest>& chunks) {
+        return read_chunks_prefetched(
+            fd, chunks, PrefetchOptions(),
+            [&ready](const ChunkRequest& chunk) {
+              phase_end(Phase::kRead);
+              if (ready) ready(chunk.dest, chunk.size);
+              phase_end(Phase::kCallback);
+            },
+            nullptr);
+      });
+}
+
+bool preadv_multiple_go(const char* path, int n, FileBuffer* out,
+                        const ChunkReady& ready) {
+  return with_chunk_plan(
+      path, n, out, [&ready](int fd, const std::vector<ChunkRequest>& chunks) {
+        // The plan is coalesced into a few large preadv calls, so the chunks
+        // only become available once they all have been read.
+        if (read_chunks_vectored(fd, chunks, VectoredReadOptions(), nullptr) ==
+            -1) {
+          return -1;
+        }
+        phase_end(Phase::kRead);
+        if (ready) {
+          for (const ChunkRequest& chunk : chunks) {
+            ready(chunk.dest, chunk.size);
+          }
+        }
+        phase_end(Phase::kCallback);
+        return 0;
+      });
+}
+
+// preadMultipleGo that only reads the file's data extents: holes are
+// zero-filled in memory, and the shuffled chunks never span one.
+bool sparse_pread_multiple_go(const char* path, int n, FileBuffer* out,
+                              const ChunkReady& ready) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("Error opening file");
+    return false;
+  }
+  phase_end(Phase::kOpen);
+
+  struct stat sb;
+  size_t file_size;
+  if (fstat(fd, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    perror("Error getting file size");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  std::vector<FileExtent> extents;
+  if (find_data_extents(fd, file_size, ExtentMethod::kAuto, &extents,
+                        nullptr) == -1) {
+    perror("Error finding data extents");
+    close(fd);
+    return false;
+  }
+  phase_end(Phase::kSize);
+
+  if (allocate_output(out, file_size) == -1) {
+    perror("Error allocating output");
+    close(fd);
+    return false;
+  }
+  for (const FileExtent& hole : hole_ranges(extents, file_size)) {
+    memset(out->data() + hole.offset, 0, hole.length);
+    phase_end(Phase::kRead);
+    if (ready) ready(out->data() + hole.offset, hole.length);
+    phase_end(Phase::kCallback);
+  }
+
+  std::vector<ChunkRequest> chunks =
+      plan_data_chunks(extents, file_size / n, out->data());
+  std::vector<int> order = create_random_read_sequence(chunks.size());
+  phase_end(Phase::kOther);
+  for (int index : order) {
+    const ChunkRequest& chunk = chunks[index];
+    if (read_chunks_pread(fd, {chunk}, nullptr) == -1) {
+      perror("Error reading file");
+      close(fd);
+      return false;
+    }
+    phase_end(Phase::kRead);
+    if (ready) ready(chunk.dest, chunk.size);
+    phase_end(Phase::kCallback);
+  }
+
+  close(fd);
+  phase_end(Phase::kClose);
+  return true;
+}
+
+}  // namespace
+
+const std::vector<ReadStrategy>& read_strategies() {
+  static const std::vector<ReadStrategy> kStrategies = {
+      {"openOneGo", false, open_one_go},
+      {"openNoStatOneGo", false, open_no_stat_one_go},
+      {"fopenOneGo", false, fopen_one_go},
+      {"ifstreamOneGo", false, ifstream_one_go},
+      {"ifstreamMultipleGo", true, ifstream_multiple_go},
+      {"openWithMmapOneGo", false, open_with_mmap_one_go},
+      {"openWithMmapPopulateOneGo", false, open_with_mmap_populate_one_go},
+      {"openWithMmapMultipleGo", true, open_with_mmap_multiple_go},
+      {"openWithMmapPrefetchMultipleGo", true,
+       open_with_mmap_prefetch_multiple_go},
+      {"registryMmapOneGo", false, registry_mmap_one_go},
+      {"preadMultipleGo", true, pread_multiple_go},
+      {"preadPrefetchMultipleGo", true, pread_prefetch_multiple_go},
+      {"preadvMultipleGo", true, preadv_multiple_go},
+      {"sparsePreadMultipleGo", true, sparse_pread_multiple_go},
+  };
+  return kStrategies;
+}
+
+const ReadStrategy* find_read_strategy(const char* name) {
+  for (const ReadStrategy& strategy : read_strategies()) {
+    if (strcmp(strategy.name, name) == 0) return &strategy;
+  }
+  return nullptr;
+}
+
+std::vector<int> create_random_read_sequence(int n) {
+  std::vector<int> indices(n);
+  std::iota(indices.begin(), indices.end(), 0);
+  std::random_device rd;
+  std::mt19937 g(rd());
+  std::shuffle(indices.begin(), indices.end(), g);
+  return indices;
+}
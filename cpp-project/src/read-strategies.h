@@ -0,0 +1,69 @@
+// Linux ports of the read strategies in the Android app's native-lib.cpp, so
+// the same code paths can be benchmarked on a desktop or server.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "output-sink.h"
+
+// Destination of a read. By default allocated with new char[] like the
+// Android code, so first-touch page faults on the destination are part of
+// the measurement; constructed with another sink, strategies reassemble the
+// file into shared memory or straight into an output file instead.
+class FileBuffer {
+ public:
+  FileBuffer() : sink_(make_heap_sink()) {}
+  explicit FileBuffer(std::unique_ptr<OutputSink> sink)
+      : sink_(std::move(sink)) {}
+
+  // Returns 0 on success, -1 with errno set.
+  int allocate(size_t size) { return sink_->allocate(size); }
+  char* data() const { return sink_->data(); }
+  size_t size() const { return sink_->size(); }
+  OutputSink& sink() const { return *sink_; }
+
+ private:
+  std::unique_ptr<OutputSink> sink_;
+};
+
+// Called on the reading thread each time a strategy has a piece of the file
+// in memory, so it can be processed while the rest is still being read. The
+// one-go strategies report the whole file at once. `data` is only valid
+// until the callback returns.
+using ChunkReady = std::function<void(const char* data, size_t size)>;
+
+struct ReadStrategy {
+  // Matches the JNI entry point name in the Android app.
+  const char* name;
+  // True for strategies that copy the file in `pieces` shuffled chunks.
+  bool multiple_go;
+  bool (*read_file)(const char* path, int pieces, FileBuffer* out,
+                    const ChunkReady& ready);
+
+  // Reads the whole file at `path` into `out`, calling `ready` (if set) for
+  // every piece as it lands. `pieces` is ignored by the one-go strategies.
+  // Returns false after reporting the error via perror.
+  bool read(const char* path, int pieces, FileBuffer* out,
+            const ChunkReady& ready = ChunkReady()) const {
+    return read_file(path, pieces, out, ready);
+  }
+};
+
+const std::vector<ReadStrategy>& read_strategies();
+
+// Returns nullptr when there is no strategy called `name`.
+const ReadStrategy* find_read_strategy(const char* name);
+
+// out->allocate as a phase of its own, for strategies to size their output
+// with. When the phase recorder asks for it, the destination is also touched
+// here, so its first-touch faults are timed apart from the copy. Returns 0
+// on success, -1 with errno set.
+int allocate_output(FileBuffer* out, size_t size);
+
+// Shuffled 0..n-1, the order the multiple-go strategies copy chunks in.
+std::vector<int> create_random_read_sequence(int n);
@@ -0,0 +1,177 @@
+#include "residency.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#include "read-loop.h"
+
+namespace {
+
+size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+// mincore() over an existing mapping. Mapping with PROT_READ and never
+// touching it doesn't fault pages in, so the snapshot doesn't disturb the
+// cache it's measuring.
+int mincore_pages(void* map, size_t size, std::vector<unsigned char>* pages) {
+  size_t page = page_size();
+  pages->assign((size + page - 1) / page, 0);
+  if (size == 0) return 0;
+#ifdef __APPLE__
+  return mincore(map, size, reinterpret_cast<char*>(pages->data()));
+#else
+  return mincore(map, size, pages->data());
+#endif
+}
+
+}  // namespace
+
+size_t Residency::resident_pages() const {
+  size_t resident = 0;
+  for (unsigned char page : pages) resident += page & 1;
+  return resident;
+}
+
+double Residency::resident_percent() const {
+  if (pages.empty()) return 100.0;
+  return 100.0 * resident_pages() / pages.size();
+}
+
+std::string Residency::bitmap(size_t chunks) const {
+  if (pages.empty() || chunks == 0) return std::string();
+  if (chunks > pages.size()) chunks = pages.size();
+
+  std::string bitmap(chunks, '.');
+  for (size_t chunk = 0; chunk < chunks; ++chunk) {
+    size_t begin = chunk * pages.size() / chunks;
+    size_t end = (chunk + 1) * pages.size() / chunks;
+    size_t resident = 0;
+    for (size_t i = begin; i < end; ++i) resident += pages[i] & 1;
+
+    if (resident == end - begin) {
+      bitmap[chunk] = '#';
+    } else if (resident * 2 >= end - begin) {
+      bitmap[chunk] = '+';
+    } else if (resident > 0) {
+      bitmap[chunk] = '-';
+    }
+  }
+  return bitmap;
+}
+
+int snapshot_residency(int fd, size_t size, Residency* out) {
+  out->page_size = page_size();
+  if (size == 0) {
+    out->pages.clear();
+    return 0;
+  }
+
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) return -1;
+  int result = mincore_pages(map, size, &out->pages);
+  int saved_errno = errno;
+  munmap(map, size);
+  errno = saved_errno;
+  return result;
+}
+
+int snapshot_residency(const char* path, Residency* out) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+
+  struct stat sb;
+  int result = fstat(fd, &sb);
+  if (result == 0) result = snapshot_residency(fd, sb.st_size, out);
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return result;
+}
+
+int evict_from_page_cache(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1) return -1;
+
+  int result = 0;
+#ifdef POSIX_FADV_DONTNEED
+  // Dirty pages aren't dropped, so flush them first.
+  fdatasync(fd);
+  int err = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  if (err != 0) {
+    errno = err;
+    result = -1;
+  }
+#else
+  errno = ENOSYS;
+  result = -1;
+#endif
+
+  int saved_errno = errno;
+  close(fd);
+  errno = saved_errno;
+  return result;
+}
+
+ResidencySampler::~ResidencySampler() { stop(); }
+
+int ResidencySampler::start(const char* path, double interval_ms) {
+  stop();
+  samples_.clear();
+
+  fd_ = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) return -1;
+
+  struct stat sb;
+  if (fstat(fd_, &sb) == -1 || buffer_size_for(sb.st_size, &size_) == -1) {
+    int saved_errno = errno;
+    close(fd_);
+    fd_ = -1;
+    errno = saved_errno;
+    return -1;
+  }
+
+  if (size_ > 0) {
+    map_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    if (map_ == MAP_FAILED) {
+      int saved_errno = errno;
+      map_ = nullptr;
+      close(fd_);
+      fd_ = -1;
+      errno = saved_errno;
+      return -1;
+    }
+  }
+
+  stopping_ = false;
+  thread_ = std::thread(&ResidencySampler::run, this, interval_ms);
+  return 0;
+}
+
+void ResidencySampler::stop() {
+  stopping_ = true;
+  if (thread_.joinable()) thread_.join();
+  if (map_) munmap(map_, size_);
+  if (fd_ != -1) close(fd_);
+  map_ = nullptr;
+  fd_ = -1;
+}
+
+void ResidencySampler::run(double interval_ms) {
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start = Clock::now();
+  std::chrono::duration<double, std::milli> interval(interval_ms);
+
+  Residency residency;
+  while (!stopping_) {
+    if (mincore_pages(map_, size_, &residency.pages) == 0) {
+      std::chrono::duration<double, std::milli> elapsed = Clock::now() - start;
+      samples_.push_back({elapsed.count(), residency.resident_percent()});
+    }
+    std::this_thread::sleep_for(interval);
+  }
+}
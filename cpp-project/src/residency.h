@@ -0,0 +1,62 @@
+// Page cache residency of a file, from mincore(2). Tells whether a benchmark
+// run was served from RAM or had to go to the disk.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Residency {
+  size_t page_size = 0;
+  // One entry per page of the file; bit 0 is set when the page is resident.
+  std::vector<unsigned char> pages;
+
+  size_t resident_pages() const;
+  double resident_percent() const;
+  // One character per chunk of the file: '#' fully resident, '+' at least
+  // half, '-' partly, '.' not at all.
+  std::string bitmap(size_t chunks) const;
+};
+
+// Takes a snapshot of `path` (or of the first `size` bytes of `fd`) without
+// faulting anything in. Returns 0 on success, -1 with errno set.
+int snapshot_residency(int fd, size_t size, Residency* out);
+int snapshot_residency(const char* path, Residency* out);
+
+// Asks the kernel to drop the file's clean pages from the page cache, so the
+// next run starts cold. Returns 0 on success, -1 with errno set.
+int evict_from_page_cache(const char* path);
+
+struct ResidencySample {
+  double elapsed_ms;
+  double resident_percent;
+};
+
+// Snapshots a file every `interval_ms` on a background thread until stopped,
+// to see how residency evolves while a strategy runs.
+class ResidencySampler {
+ public:
+  ResidencySampler() = default;
+  ~ResidencySampler();
+  ResidencySampler(const ResidencySampler&) = delete;
+  ResidencySampler& operator=(const ResidencySampler&) = delete;
+
+  // Returns 0 on success, -1 with errno set when the file can't be mapped.
+  int start(const char* path, double interval_ms);
+  void stop();
+
+  const std::vector<ResidencySample>& samples() const { return samples_; }
+
+ private:
+  void run(double interval_ms);
+
+  int fd_ = -1;
+  void* map_ = nullptr;
+  size_t size_ = 0;
+  std::atomic<bool> stopping_{false};
+  std::thread thread_;
+  std::vector<ResidencySample> samples_;
+};
@@ -0,0 +1,161 @@
+// Bounded lock-free ring queues. Both are non-blocking (try_push/try_pop
+// fail instead of waiting) and round the capacity up to a power of two.
+//
+// SpscQueue: one producer thread and one consumer thread. Each side keeps a
+// cached copy of the other side's index, so it only touches the shared
+// cache line when the queue looks full (or empty).
+//
+// MpmcQueue: any number of producers and consumers. Every slot carries a
+// sequence number telling whose turn it is (D. Vyukov's bounded queue), so a
+// push or pop is one CAS on the shared index plus a release store.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace detail {
+
+// Keeps the producer's and the consumer's indices off each other's line.
+constexpr size_t kCacheLine = 64;
+
+inline size_t round_up_to_power_of_two(size_t value) {
+  size_t power = 1;
+  while (power < value) power <<= 1;
+  return power;
+}
+
+}  // namespace detail
+
+template <typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(size_t capacity)
+      : capacity_(detail::round_up_to_power_of_two(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new T[capacity_]) {}
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Producer only.
+  bool try_push(T&& value) {
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == capacity_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == capacity_) return false;
+    }
+    slots_[tail & mask_] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only.
+  bool try_pop(T* out) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+    *out = std::move(slots_[head & mask_]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Approximate when called while the other side is running.
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    return tail_.load(std::memory_order_acquire) - head;
+  }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<T[]> slots_;
+  alignas(detail::kCacheLine) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;  // Consumer's view of tail_.
+  alignas(detail::kCacheLine) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;  // Producer's view of head_.
+};
+
+template <typename T>
+class MpmcQueue {
+ public:
+  explicit MpmcQueue(size_t capacity)
+      : capacity_(detail::round_up_to_power_of_two(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new Slot[capacity_]) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpmcQueue(const MpmcQueue&) = delete;
+  MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+  bool try_push(T&& value) {
+    size_t position = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & mask_];
+      size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      intptr_t turn =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (turn == 0) {
+        if (tail_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          slot.value = std::move(value);
+          slot.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (turn < 0) {
+        return false;  // The slot still holds the value from a lap ago.
+      } else {
+        position = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T* out) {
+    size_t position = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[position & mask_];
+      size_t sequence = slot.sequence.load(std::memory_order_acquire);
+      intptr_t turn = static_cast<intptr_t>(sequence) -
+                      static_cast<intptr_t>(position + 1);
+      if (turn == 0) {
+        if (head_.compare_exchange_weak(position, position + 1,
+                                        std::memory_order_relaxed)) {
+          *out = std::move(slot.value);
+          slot.sequence.store(position + capacity_, std::memory_order_release);
+          return true;
+        }
+      } else if (turn < 0) {
+        return false;  // Nothing has been pushed to this slot yet.
+      } else {
+        position = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Approximate when called while other threads are running.
+  size_t size() const {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence{0};
+    T value;
+  };
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  alignas(detail::kCacheLine) std::atomic<size_t> head_{0};
+  alignas(detail::kCacheLine) std::atomic<size_t> tail_{0};
+};
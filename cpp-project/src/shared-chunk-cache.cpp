@@ -0,0 +1,457 @@
+#include "shared-chunk-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace detail {
+
+struct CacheHeader {
+  uint64_t magic;
+  uint32_t version;
+  // 0 while the creator sets the segment up, kHeaderReady afterwards.
+  std::atomic<uint32_t> state;
+  uint64_t slot_count;
+  uint64_t bucket_count;
+  uint64_t chunk_size;
+  uint64_t slots_offset;
+  uint64_t buckets_offset;
+  uint64_t data_offset;
+  std::atomic<uint64_t> clock_hand;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+  std::atomic<uint64_t> inserts;
+  std::atomic<uint64_t> evictions;
+};
+
+struct CacheSlot {
+  // kSlotFree, kSlotWriting, or kSlotReady + number of pins.
+  std::atomic<uint32_t> control;
+  // CLOCK second-chance bit, set on every hit.
+  std::atomic<uint32_t> referenced;
+  // Hash of `key`, readable without pinning; 0 while not ready.
+  std::atomic<uint64_t> key_hash;
+  // Only written while the slot is kSlotWriting, only read while pinned.
+  ChunkKey key;
+  uint64_t length;
+};
+
+}  // namespace detail
+
+using detail::CacheHeader;
+using detail::CacheSlot;
+
+namespace {
+
+constexpr uint64_t kMagic = 0x6b6e756863726873;  // "shrchunk"
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kHeaderReady = 2;
+
+constexpr uint32_t kSlotFree = 0;
+constexpr uint32_t kSlotWriting = 1;
+constexpr uint32_t kSlotReady = 2;
+
+// Buckets probed per key; entries further away are simply not found.
+constexpr uint64_t kProbeLength = 8;
+// How long attach() waits for the creator to finish initializing.
+constexpr auto kAttachTimeout = std::chrono::seconds(2);
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free &&
+                  std::atomic<uint64_t>::is_always_lock_free,
+              "atomics in shared memory must be lock free");
+
+size_t page_size() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+
+uint64_t align_up(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+uint64_t mix(uint64_t h, uint64_t value) {
+  h ^= value + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+  return h;
+}
+
+// Never 0, which marks slots without a key.
+uint64_t hash_key(const ChunkKey& key) {
+  uint64_t h = mix(0, key.dev);
+  h = mix(h, key.ino);
+  h = mix(h, static_cast<uint64_t>(key.mtime_ns));
+  h = mix(h, key.size);
+  h = mix(h, key.chunk);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  return h | 1;
+}
+
+bool same_key(const ChunkKey& a, const ChunkKey& b) {
+  return a.dev == b.dev && a.ino == b.ino && a.mtime_ns == b.mtime_ns &&
+         a.size == b.size && a.chunk == b.chunk;
+}
+
+struct Layout {
+  uint64_t slots_offset;
+  uint64_t buckets_offset;
+  uint64_t data_offset;
+  uint64_t total_size;
+};
+
+Layout layout_for(uint64_t slot_count, uint64_t chunk_size) {
+  Layout layout;
+  layout.slots_offset = align_up(sizeof(CacheHeader), 64);
+  layout.buckets_offset =
+      align_up(layout.slots_offset + slot_count * sizeof(CacheSlot), 64);
+  layout.data_offset = align_up(
+      layout.buckets_offset + 2 * slot_count * sizeof(uint32_t), page_size());
+  layout.total_size = layout.data_offset + slot_count * chunk_size;
+  return layout;
+}
+
+int memfd(const char* name) {
+#if defined(__linux__) && defined(SYS_memfd_create)
+  // Through syscall(2): the libc wrapper needs glibc 2.27 / Android API 30.
+  return static_cast<int>(syscall(SYS_memfd_create, name, 1u /* CLOEXEC */));
+#else
+  (void)name;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+}  // namespace
+
+int chunk_key_for(int fd, uint64_t chunk, ChunkKey* key) {
+  struct stat sb;
+  if (fstat(fd, &sb) == -1) return -1;
+  key->dev = sb.st_dev;
+  key->ino = sb.st_ino;
+#ifdef __APPLE__
+  key->mtime_ns = sb.st_mtimespec.tv_sec * 1000000000LL +
+                  sb.st_mtimespec.tv_nsec;
+#else
+  key->mtime_ns = sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+#endif
+  key->size = sb.st_size;
+  key->chunk = chunk;
+  return 0;
+}
+
+ChunkRef::ChunkRef(ChunkRef&& other) noexcept
+    : slot_(other.slot_), data_(other.data_), size_(other.size_) {
+  other.slot_ = nullptr;
+}
+
+ChunkRef& ChunkRef::operator=(ChunkRef&& other) noexcept {
+  if (this != &other) {
+    reset();
+    slot_ = other.slot_;
+    data_ = other.data_;
+    size_ = other.size_;
+    other.slot_ = nullptr;
+  }
+  return *this;
+}
+
+ChunkRef::~ChunkRef() { reset(); }
+
+void ChunkRef::reset() {
+  if (slot_) slot_->control.fetch_sub(1, std::memory_order_release);
+  slot_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+SharedChunkCache::~SharedChunkCache() { close(); }
+
+void SharedChunkCache::close() {
+  if (base_) munmap(base_, mapped_size_);
+  if (fd_ != -1) ::close(fd_);
+  base_ = nullptr;
+  fd_ = -1;
+  mapped_size_ = 0;
+  header_ = nullptr;
+}
+
+int SharedChunkCache::map_segment(int fd, bool initialize, size_t slot_count,
+                                  size_t chunk_size) {
+  size_t size = 0;
+  if (initialize) {
+    Layout layout = layout_for(slot_count, chunk_size);
+    if (ftruncate(fd, layout.total_size) == -1) return -1;
+    size = layout.total_size;
+  } else {
+    // The creator may not have sized the segment yet.
+    auto deadline = std::chrono::steady_clock::now() + kAttachTimeout;
+    for (;;) {
+      struct stat sb;
+      if (fstat(fd, &sb) == -1) return -1;
+      if (static_cast<size_t>(sb.st_size) >= sizeof(CacheHeader)) {
+        size = sb.st_size;
+        break;
+      }
+      if (std::chrono::steady_clock::now() > deadline) {
+        errno = ETIMEDOUT;
+        return -1;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  void* base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) return -1;
+  CacheHeader* header = static_cast<CacheHeader*>(base);
+
+  if (initialize) {
+    // A fresh segment is zero filled, which already means "free" for every
+    // slot and "empty" for every bucket.
+    Layout layout = layout_for(slot_count, chunk_size);
+    header->magic = kMagic;
+    header->version = kVersion;
+    header->slot_count = slot_count;
+    header->bucket_count = 2 * slot_count;
+    header->chunk_size = chunk_size;
+    header->slots_offset = layout.slots_offset;
+    header->buckets_offset = layout.buckets_offset;
+    header->data_offset = layout.data_offset;
+    header->state.store(kHeaderReady, std::memory_order_release);
+  } else {
+    auto deadline = std::chrono::steady_clock::now() + kAttachTimeout;
+    while (header->state.load(std::memory_order_acquire) != kHeaderReady) {
+      if (std::chrono::steady_clock::now() > deadline) {
+        munmap(base, size);
+        errno = ETIMEDOUT;
+        return -1;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (header->magic != kMagic || header->version != kVersion ||
+        layout_for(header->slot_count, header->chunk_size).total_size > size) {
+      munmap(base, size);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  close();
+  fd_ = fd;
+  base_ = base;
+  mapped_size_ = size;
+  header_ = header;
+  char* bytes = static_cast<char*>(base);
+  slots_ = reinterpret_cast<CacheSlot*>(bytes + header->slots_offset);
+  buckets_ =
+      reinterpret_cast<std::atomic<uint32_t>*>(bytes + header->buckets_offset);
+  data_ = bytes + header->data_offset;
+  return 0;
+}
+
+int SharedChunkCache::open_named(const char* name, size_t slot_count,
+                                 size_t chunk_size) {
+#ifdef __ANDROID__
+  (void)name;
+  (void)slot_count;
+  (void)chunk_size;
+  errno = ENOSYS;
+  return -1;
+#else
+  if (slot_count == 0 || chunk_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  bool initialize = true;
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd == -1 && errno == EEXIST) {
+    initialize = false;
+    fd = shm_open(name, O_RDWR | O_CLOEXEC, 0600);
+  }
+  if (fd == -1) return -1;
+  if (map_segment(fd, initialize, slot_count, chunk_size) == -1) {
+    int saved_errno = errno;
+    ::close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+#endif
+}
+
+int SharedChunkCache::unlink_named(const char* name) {
+#ifdef __ANDROID__
+  (void)name;
+  errno = ENOSYS;
+  return -1;
+#else
+  return shm_unlink(name);
+#endif
+}
+
+int SharedChunkCache::create_anonymous(size_t slot_count, size_t chunk_size) {
+  if (slot_count == 0 || chunk_size == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = memfd("shared-chunk-cache");
+  if (fd == -1) return -1;
+  if (map_segment(fd, true, slot_count, chunk_size) == -1) {
+    int saved_errno = errno;
+    ::close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+int SharedChunkCache::attach(int fd) {
+  int own_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+  if (own_fd == -1) return -1;
+  if (map_segment(own_fd, false, 0, 0) == -1) {
+    int saved_errno = errno;
+    ::close(own_fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+size_t SharedChunkCache::chunk_size() const {
+  return header_ ? header_->chunk_size : 0;
+}
+
+size_t SharedChunkCache::slot_count() const {
+  return header_ ? header_->slot_count : 0;
+}
+
+SharedChunkCache::Stats SharedChunkCache::stats() const {
+  Stats stats;
+  if (!header_) return stats;
+  stats.hits = header_->hits.load(std::memory_order_relaxed);
+  stats.misses = header_->misses.load(std::memory_order_relaxed);
+  stats.inserts = header_->inserts.load(std::memory_order_relaxed);
+  stats.evictions = header_->evictions.load(std::memory_order_relaxed);
+  return stats;
+}
+
+ChunkRef SharedChunkCache::lookup(const ChunkKey& key) {
+  if (!header_) return ChunkRef();
+  uint64_t hash = hash_key(key);
+  uint64_t buckets = header_->bucket_count;
+
+  for (uint64_t probe = 0; probe < kProbeLength; ++probe) {
+    uint32_t entry =
+        buckets_[(hash + probe) % buckets].load(std::memory_order_acquire);
+    if (entry == 0) continue;
+    CacheSlot& slot = slots_[entry - 1];
+    if (slot.key_hash.load(std::memory_order_acquire) != hash) continue;
+
+    // Pin, which only succeeds while the slot is ready; once pinned it
+    // can't be evicted, so its key can be checked safely.
+    uint32_t control = slot.control.load(std::memory_order_acquire);
+    while (control >= kSlotReady &&
+           !slot.control.compare_exchange_weak(control, control + 1,
+                                               std::memory_order_acq_rel)) {
+    }
+    if (control < kSlotReady) continue;
+    if (!same_key(slot.key, key)) {
+      slot.control.fetch_sub(1, std::memory_order_release);
+      continue;
+    }
+
+    slot.referenced.store(1, std::memory_order_relaxed);
+    header_->hits.fetch_add(1, std::memory_order_relaxed);
+    return ChunkRef(&slot, data_ + (entry - 1) * header_->chunk_size,
+                    slot.length);
+  }
+
+  header_->misses.fetch_add(1, std::memory_order_relaxed);
+  return ChunkRef();
+}
+
+CacheSlot* SharedChunkCache::claim_slot(char** dest) {
+  if (!header_) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  uint64_t slot_count = header_->slot_count;
+
+  // Two full sweeps give every referenced slot its second chance; beyond
+  // that everything is pinned or being written.
+  for (uint64_t attempt = 0; attempt < 3 * slot_count; ++attempt) {
+    uint64_t index =
+        header_->clock_hand.fetch_add(1, std::memory_order_relaxed) %
+        slot_count;
+    CacheSlot& slot = slots_[index];
+    uint32_t control = slot.control.load(std::memory_order_acquire);
+
+    bool evicting = false;
+    if (control == kSlotReady) {
+      if (slot.referenced.exchange(0, std::memory_order_relaxed)) continue;
+      evicting = true;
+    } else if (control != kSlotFree) {
+      continue;
+    }
+    if (!slot.control.compare_exchange_strong(control, kSlotWriting,
+                                              std::memory_order_acq_rel)) {
+      continue;
+    }
+
+    if (evicting) header_->evictions.fetch_add(1, std::memory_order_relaxed);
+    slot.key_hash.store(0, std::memory_order_release);
+    *dest = data_ + index * header_->chunk_size;
+    return &slot;
+  }
+
+  errno = EBUSY;
+  return nullptr;
+}
+
+ChunkRef SharedChunkCache::publish(CacheSlot* slot, const ChunkKey& key,
+                                   char* dest, ssize_t length) {
+  if (length < 0 || static_cast<uint64_t>(length) > header_->chunk_size) {
+    int saved_errno = length < 0 ? errno : EINVAL;
+    slot->control.store(kSlotFree, std::memory_order_release);
+    errno = saved_errno;
+    return ChunkRef();
+  }
+
+  uint64_t hash = hash_key(key);
+  slot->key = key;
+  slot->length = length;
+  slot->referenced.store(1, std::memory_order_relaxed);
+  slot->key_hash.store(hash, std::memory_order_release);
+  // Ready, and pinned once by the ref returned below.
+  slot->control.store(kSlotReady + 1, std::memory_order_release);
+  header_->inserts.fetch_add(1, std::memory_order_relaxed);
+
+  // Index it: take the first bucket in the probe window that is empty or
+  // stale (its slot now holds a key whose window doesn't cover the bucket),
+  // otherwise overwrite the home bucket.
+  uint32_t entry = static_cast<uint32_t>(slot - slots_) + 1;
+  uint64_t buckets = header_->bucket_count;
+  bool indexed = false;
+  for (uint64_t probe = 0; probe < kProbeLength && !indexed; ++probe) {
+    uint64_t bucket = (hash + probe) % buckets;
+    uint32_t current = buckets_[bucket].load(std::memory_order_acquire);
+    if (current != 0) {
+      uint64_t other = slots_[current - 1].key_hash.load(
+          std::memory_order_acquire);
+      uint64_t distance = (bucket + buckets - other % buckets) % buckets;
+      if (other != 0 && distance < kProbeLength) continue;
+    }
+    indexed = buckets_[bucket].compare_exchange_strong(
+        current, entry, std::memory_order_acq_rel);
+  }
+  if (!indexed) {
+    buckets_[hash % buckets].store(entry, std::memory_order_release);
+  }
+
+  return ChunkRef(slot, dest, length);
+}
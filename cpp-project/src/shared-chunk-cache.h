@@ -0,0 +1,144 @@
+// Chunk cache living in a shared memory segment, so several processes
+// reading (and decoding) the same files keep one copy of each chunk between
+// them instead of one per process.
+//
+// The segment holds a header, a fixed array of chunk slots and an open
+// addressing index from chunk key to slot. Everything is coordinated with
+// atomics inside the segment, so nobody ever waits on another process.
+// Slots are recycled with CLOCK (second chance): a hit sets the slot's
+// referenced bit and the clock hand clears it once before evicting.
+//
+// Lookups and inserts return a ChunkRef that pins the slot. Pinned slots are
+// never evicted, so the data can be used in place without copying.
+//
+// Nothing records which process holds a pin or is filling a slot, so a
+// process that dies with a ChunkRef alive, or inside insert()'s fill, leaks
+// that slot: its pin count never drops back (or it stays kSlotWriting), and
+// it can't be evicted or reused for the life of the segment. The other
+// processes carry on with one slot fewer; when enough have leaked, insert()
+// fails with EBUSY. Recreating the segment is the only way to get them back.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// Identifies a chunk of a specific version of a file: rewriting the file
+// changes its mtime or size and so its keys.
+struct ChunkKey {
+  uint64_t dev = 0;
+  uint64_t ino = 0;
+  int64_t mtime_ns = 0;
+  uint64_t size = 0;
+  uint64_t chunk = 0;
+};
+
+// Fills the file identity part of `key` from `fd`. Returns 0 on success,
+// -1 with errno set.
+int chunk_key_for(int fd, uint64_t chunk, ChunkKey* key);
+
+namespace detail {
+struct CacheHeader;
+struct CacheSlot;
+}  // namespace detail
+
+// Pinned chunk; unpinned when destroyed. Empty on a miss.
+class ChunkRef {
+ public:
+  ChunkRef() = default;
+  ChunkRef(ChunkRef&& other) noexcept;
+  ChunkRef& operator=(ChunkRef&& other) noexcept;
+  ~ChunkRef();
+  ChunkRef(const ChunkRef&) = delete;
+  ChunkRef& operator=(const ChunkRef&) = delete;
+
+  explicit operator bool() const { return slot_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  friend class SharedChunkCache;
+  ChunkRef(detail::CacheSlot* slot, const char* data, size_t size)
+      : slot_(slot), data_(data), size_(size) {}
+  void reset();
+
+  detail::CacheSlot* slot_ = nullptr;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+class SharedChunkCache {
+ public:
+  // Counters shared by every attached process.
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inserts = 0;
+    uint64_t evictions = 0;
+  };
+
+  SharedChunkCache() = default;
+  ~SharedChunkCache();
+  SharedChunkCache(const SharedChunkCache&) = delete;
+  SharedChunkCache& operator=(const SharedChunkCache&) = delete;
+
+  // Creates the named POSIX shared memory segment, or attaches to it if
+  // another process already did (the creator's geometry wins). Not
+  // available on Android, which has no shm_open.
+  int open_named(const char* name, size_t slot_count, size_t chunk_size);
+  // Creates an anonymous memfd segment. Share fd() with other processes by
+  // fork() or SCM_RIGHTS and attach() to it there.
+  int create_anonymous(size_t slot_count, size_t chunk_size);
+  int attach(int fd);
+  // Removes a named segment; attached processes keep their mapping.
+  static int unlink_named(const char* name);
+
+  int fd() const { return fd_; }
+  size_t chunk_size() const;
+  size_t slot_count() const;
+  size_t segment_size() const { return mapped_size_; }
+  Stats stats() const;
+
+  ChunkRef lookup(const ChunkKey& key);
+
+  // Claims a slot (evicting with CLOCK if needed), lets `fill` write up to
+  // chunk_size() bytes into it and publishes it. `fill(char* dest, size_t
+  // capacity)` returns the length written or -1 to abandon the insert.
+  // Returns an empty ref with errno set on failure (EBUSY when every slot
+  // is pinned).
+  template <typename Fill>
+  ChunkRef insert(const ChunkKey& key, Fill fill) {
+    char* dest = nullptr;
+    detail::CacheSlot* slot = claim_slot(&dest);
+    if (!slot) return ChunkRef();
+    ssize_t length = fill(dest, chunk_size());
+    return publish(slot, key, dest, length);
+  }
+
+  // lookup(), falling back to insert() with `fill` on a miss.
+  template <typename Fill>
+  ChunkRef get_or_insert(const ChunkKey& key, Fill fill) {
+    ChunkRef ref = lookup(key);
+    if (ref) return ref;
+    return insert(key, fill);
+  }
+
+ private:
+  int map_segment(int fd, bool initialize, size_t slot_count,
+                  size_t chunk_size);
+  detail::CacheSlot* claim_slot(char** dest);
+  ChunkRef publish(detail::CacheSlot* slot, const ChunkKey& key, char* dest,
+                   ssize_t length);
+  void close();
+
+  int fd_ = -1;
+  void* base_ = nullptr;
+  size_t mapped_size_ = 0;
+  detail::CacheHeader* header_ = nullptr;
+  detail::CacheSlot* slots_ = nullptr;
+  std::atomic<uint32_t>* buckets_ = nullptr;
+  char* data_ = nullptr;
+};
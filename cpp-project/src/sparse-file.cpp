@@ -0,0 +1,208 @@
+#include "sparse-file.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+namespace {
+
+// Extents come in file order; ones that touch are merged.
+void add_extent(off_t offset, size_t length, std::vector<FileExtent>* out) {
+  if (length == 0) return;
+  if (!out->empty()) {
+    FileExtent& last = out->back();
+    if (last.offset + static_cast<off_t>(last.length) >= offset) {
+      off_t end = std::max<off_t>(last.offset + last.length, offset + length);
+      last.length = end - last.offset;
+      return;
+    }
+  }
+  out->push_back({offset, length});
+}
+
+int find_with_seek(int fd, size_t size, std::vector<FileExtent>* out) {
+#ifdef SEEK_DATA
+  off_t end = size;
+  off_t position = 0;
+  while (position < end) {
+    off_t data = lseek(fd, position, SEEK_DATA);
+    if (data == -1) {
+      if (errno == ENXIO) break;  // Only a hole is left.
+      return -1;
+    }
+    if (data >= end) break;
+    off_t hole = lseek(fd, data, SEEK_HOLE);
+    if (hole == -1) return -1;
+    hole = std::min(hole, end);
+    add_extent(data, hole - data, out);
+    position = hole;
+  }
+  return 0;
+#else
+  (void)fd;
+  (void)size;
+  (void)out;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+int find_with_fiemap(int fd, size_t size, std::vector<FileExtent>* out) {
+#if defined(__linux__) && defined(FS_IOC_FIEMAP)
+  constexpr size_t kExtentsPerCall = 128;
+  size_t bytes =
+      sizeof(struct fiemap) + kExtentsPerCall * sizeof(struct fiemap_extent);
+  std::unique_ptr<uint64_t[]> storage(new uint64_t[bytes / 8 + 1]);
+  auto* map = reinterpret_cast<struct fiemap*>(storage.get());
+
+  uint64_t end = size;
+  uint64_t position = 0;
+  while (position < end) {
+    memset(map, 0, sizeof(struct fiemap));
+    map->fm_start = position;
+    map->fm_length = end - position;
+    // Flush delayed allocations first, or dirty data may not have an
+    // extent yet.
+    map->fm_flags = FIEMAP_FLAG_SYNC;
+    map->fm_extent_count = kExtentsPerCall;
+    if (ioctl(fd, FS_IOC_FIEMAP, map) == -1) return -1;
+    if (map->fm_mapped_extents == 0) break;
+
+    bool last = false;
+    for (uint32_t i = 0; i < map->fm_mapped_extents; ++i) {
+      const struct fiemap_extent& extent = map->fm_extents[i];
+      uint64_t start = std::max<uint64_t>(extent.fe_logical, position);
+      uint64_t stop = std::min<uint64_t>(extent.fe_logical + extent.fe_length,
+                                         end);
+      // Allocated but never written: reads as zeros, like a hole.
+      if (!(extent.fe_flags & FIEMAP_EXTENT_UNWRITTEN) && start < stop) {
+        add_extent(start, stop - start, out);
+      }
+      position = std::max(position, stop);
+      last = extent.fe_flags & FIEMAP_EXTENT_LAST;
+    }
+    if (last) break;
+  }
+  return 0;
+#else
+  (void)fd;
+  (void)size;
+  (void)out;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+bool unsupported(int error) {
+  return error == ENOSYS || error == EINVAL || error == EOPNOTSUPP ||
+         error == ENOTTY;
+}
+
+}  // namespace
+
+const char* extent_method_name(ExtentMethod method) {
+  switch (method) {
+    case ExtentMethod::kAuto:
+      return "auto";
+    case ExtentMethod::kSeekHole:
+      return "SEEK_DATA/SEEK_HOLE";
+    case ExtentMethod::kFiemap:
+      return "FIEMAP";
+    case ExtentMethod::kWholeFile:
+      return "none";
+  }
+  return "?";
+}
+
+int find_data_extents(int fd, size_t size, ExtentMethod method,
+                      std::vector<FileExtent>* extents, ExtentMethod* used) {
+  std::vector<FileExtent> found;
+  ExtentMethod answered = ExtentMethod::kWholeFile;
+  if (method == ExtentMethod::kAuto || method == ExtentMethod::kSeekHole) {
+    if (find_with_seek(fd, size, &found) == 0) {
+      answered = ExtentMethod::kSeekHole;
+    } else if (!unsupported(errno)) {
+      return -1;
+    }
+  }
+  if (answered == ExtentMethod::kWholeFile &&
+      (method == ExtentMethod::kAuto || method == ExtentMethod::kFiemap)) {
+    found.clear();
+    if (find_with_fiemap(fd, size, &found) == 0) {
+      answered = ExtentMethod::kFiemap;
+    } else if (!unsupported(errno)) {
+      return -1;
+    }
+  }
+  if (answered == ExtentMethod::kWholeFile) {
+    found.clear();
+    add_extent(0, size, &found);
+  }
+  *extents = std::move(found);
+  if (used) *used = answered;
+  return 0;
+}
+
+std::vector<FileExtent> hole_ranges(const std::vector<FileExtent>& extents,
+                                    size_t size) {
+  std::vector<FileExtent> holes;
+  off_t position = 0;
+  for (const FileExtent& extent : extents) {
+    if (extent.offset > position) {
+      holes.push_back(
+          {position, static_cast<size_t>(extent.offset - position)});
+    }
+    position = extent.offset + extent.length;
+  }
+  if (position < static_cast<off_t>(size)) {
+    holes.push_back({position, size - position});
+  }
+  return holes;
+}
+
+std::vector<ChunkRequest> plan_data_chunks(
+    const std::vector<FileExtent>& extents, size_t chunk_size, char* buffer) {
+  std::vector<ChunkRequest> chunks;
+  chunk_size = std::max<size_t>(chunk_size, 1);
+  for (const FileExtent& extent : extents) {
+    for (size_t done = 0; done < extent.length; done += chunk_size) {
+      off_t offset = extent.offset + done;
+      chunks.push_back({offset, std::min(chunk_size, extent.length - done),
+                        buffer + offset});
+    }
+  }
+  return chunks;
+}
+
+int read_sparse(int fd, size_t size, char* buffer, size_t chunk_size,
+                ExtentMethod method, SparseReadStats* stats) {
+  SparseReadStats local;
+  if (!stats) stats = &local;
+  *stats = SparseReadStats();
+
+  std::vector<FileExtent> extents;
+  if (find_data_extents(fd, size, method, &extents, &stats->method) == -1) {
+    return -1;
+  }
+  for (const FileExtent& hole : hole_ranges(extents, size)) {
+    memset(buffer + hole.offset, 0, hole.length);
+    stats->hole_bytes += hole.length;
+  }
+  std::vector<ChunkRequest> chunks =
+      plan_data_chunks(extents, chunk_size, buffer);
+  VectoredReadStats read_stats;
+  if (read_chunks_pread(fd, chunks, &read_stats) == -1) return -1;
+  stats->data_extents = extents.size();
+  stats->data_bytes = size - stats->hole_bytes;
+  stats->reads = read_stats.syscalls;
+  return 0;
+}
@@ -0,0 +1,55 @@
+// Hole-aware reading. A sparse file's holes read as zeros without being
+// stored anywhere, so there is nothing to fetch for them: the data extents
+// are found with lseek(SEEK_DATA/SEEK_HOLE) or the FIEMAP ioctl, only they
+// are read, and the holes are zero-filled in memory.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "vectored-read.h"
+
+enum class ExtentMethod {
+  // SEEK_DATA/SEEK_HOLE, then FIEMAP if lseek doesn't know them.
+  kAuto,
+  kSeekHole,
+  // Also treats preallocated but unwritten extents as holes.
+  kFiemap,
+  // No hole detection: the whole file is one data extent.
+  kWholeFile,
+};
+
+const char* extent_method_name(ExtentMethod method);
+
+// Finds the ranges of the first `size` bytes of `fd` that hold data, in file
+// order with neighbours merged. `used` (if set) gets the method that
+// answered; when the requested one isn't supported here, the whole file is
+// reported as data with kWholeFile. Returns 0 on success, -1 with errno set.
+int find_data_extents(int fd, size_t size, ExtentMethod method,
+                      std::vector<FileExtent>* extents, ExtentMethod* used);
+
+// The gaps between `extents` within [0, size).
+std::vector<FileExtent> hole_ranges(const std::vector<FileExtent>& extents,
+                                    size_t size);
+
+// Splits the data extents into chunks of at most `chunk_size` bytes, none
+// spanning a hole, each copied to the same offset of `buffer`.
+std::vector<ChunkRequest> plan_data_chunks(
+    const std::vector<FileExtent>& extents, size_t chunk_size, char* buffer);
+
+struct SparseReadStats {
+  ExtentMethod method = ExtentMethod::kWholeFile;
+  size_t data_extents = 0;
+  size_t data_bytes = 0;
+  size_t hole_bytes = 0;
+  size_t reads = 0;
+};
+
+// Reads the first `size` bytes of `fd` into `buffer`: data extents with one
+// pread per chunk of up to `chunk_size` bytes, holes with memset. Returns 0
+// on success, -1 with errno set.
+int read_sparse(int fd, size_t size, char* buffer, size_t chunk_size,
+                ExtentMethod method, SparseReadStats* stats);
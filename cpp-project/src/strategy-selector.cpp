@@ -0,0 +1,224 @@
+#include "strategy-selector.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "read-loop.h"
+#include "residency.h"
+
+namespace {
+
+// Upper bounds of the file size buckets; the last bucket is open ended.
+constexpr size_t kSizeBounds[] = {64 << 10, 1 << 20, 16 << 20, 256 << 20};
+constexpr const char* kSizeNames[] = {"<64 KB", "64 KB-1 MB", "1-16 MB",
+                                      "16-256 MB", ">=256 MB"};
+constexpr size_t kSizeBuckets = sizeof(kSizeNames) / sizeof(kSizeNames[0]);
+
+constexpr const char* kResidencyNames[] = {"cold", "partly cached", "cached"};
+constexpr size_t kResidencyBuckets = 3;
+constexpr size_t kPatterns = 2;
+
+size_t size_bucket(size_t size) {
+  size_t bucket = 0;
+  while (bucket < kSizeBuckets - 1 && size >= kSizeBounds[bucket]) ++bucket;
+  return bucket;
+}
+
+size_t residency_bucket(double resident_percent) {
+  if (resident_percent < 10) return 0;
+  if (resident_percent < 90) return 1;
+  return 2;
+}
+
+size_t context_id(size_t size, double resident_percent,
+                  AccessPattern pattern) {
+  return (size_bucket(size) * kResidencyBuckets +
+          residency_bucket(resident_percent)) *
+             kPatterns +
+         (pattern == AccessPattern::kChunks ? 1 : 0);
+}
+
+std::string context_name(size_t id) {
+  size_t pattern = id % kPatterns;
+  size_t residency = id / kPatterns % kResidencyBuckets;
+  size_t size = id / kPatterns / kResidencyBuckets;
+  return std::string(kSizeNames[size]) + ", " + kResidencyNames[residency] +
+         ", " + (pattern ? "chunks" : "whole file");
+}
+
+}  // namespace
+
+StrategySelector::StrategySelector(const SelectorOptions& options)
+    : options_(options),
+      random_(options.seed ? options.seed : std::random_device()()),
+      contexts_(kSizeBuckets * kResidencyBuckets * kPatterns) {}
+
+int StrategySelector::choose(const char* path, AccessPattern pattern,
+                             StrategyDecision* decision) {
+  struct stat sb;
+  size_t file_size;
+  if (stat(path, &sb) == -1 || buffer_size_for(sb.st_size, &file_size) == -1) {
+    return -1;
+  }
+  // An empty file has nothing to fault in. Files mincore can't look at are
+  // treated as cold.
+  double resident_percent = 100;
+  Residency residency;
+  if (file_size > 0) {
+    resident_percent = snapshot_residency(path, &residency) == 0
+                           ? residency.resident_percent()
+                           : 0;
+  }
+  size_t id = context_id(file_size, resident_percent, pattern);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  Context& context = contexts_[id];
+  if (context.arms.empty()) {
+    context.arms = candidates(pattern);
+    if (context.arms.empty()) {
+      errno = EINVAL;
+      return -1;
+    }
+    context.name = context_name(id);
+  }
+  ++decisions_;
+
+  *decision = StrategyDecision();
+  decision->context = id;
+  decision->file_size = file_size;
+  decision->resident_percent = resident_percent;
+
+  auto least_tried = std::min_element(
+      context.arms.begin(), context.arms.end(),
+      [](const Arm& a, const Arm& b) { return a.runs < b.runs; });
+  size_t best = best_arm(context);
+  const Arm& best_arm = context.arms[best];
+  std::uniform_real_distribution<double> coin(0, 1);
+  char reason[256];
+
+  if (least_tried->runs < static_cast<uint64_t>(options_.min_trials)) {
+    decision->strategy = least_tried->strategy;
+    decision->explored = true;
+    snprintf(reason, sizeof(reason), "trying %s (%llu runs so far) in %s",
+             least_tried->strategy->name,
+             static_cast<unsigned long long>(least_tried->runs),
+             context.name.c_str());
+  } else if (context.arms.size() > 1 &&
+             coin(random_) < options_.exploration) {
+    std::uniform_int_distribution<size_t> pick(0, context.arms.size() - 2);
+    size_t other = pick(random_);
+    if (other >= best) ++other;
+    const Arm& arm = context.arms[other];
+    decision->strategy = arm.strategy;
+    decision->explored = true;
+    snprintf(reason, sizeof(reason),
+             "re-measuring %s (%.2f ms/MB) instead of %s (%.2f ms/MB)",
+             arm.strategy->name, arm.ms_per_mb, best_arm.strategy->name,
+             best_arm.ms_per_mb);
+  } else {
+    decision->strategy = best_arm.strategy;
+    const Arm* runner_up = nullptr;
+    for (const Arm& arm : context.arms) {
+      if (&arm != &best_arm && arm.runs > 0 &&
+          (!runner_up || arm.ms_per_mb < runner_up->ms_per_mb)) {
+        runner_up = &arm;
+      }
+    }
+    if (runner_up) {
+      snprintf(reason, sizeof(reason),
+               "%s is cheapest here at %.2f ms/MB; next is %s at %.2f ms/MB",
+               best_arm.strategy->name, best_arm.ms_per_mb,
+               runner_up->strategy->name, runner_up->ms_per_mb);
+    } else {
+      snprintf(reason, sizeof(reason), "%s is the only candidate (%.2f ms/MB)",
+               best_arm.strategy->name, best_arm.ms_per_mb);
+    }
+  }
+  decision->reason = reason;
+  if (decision->explored) ++explorations_;
+  return 0;
+}
+
+void StrategySelector::record(const StrategyDecision& decision, double ms) {
+  double megabytes = std::max<size_t>(decision.file_size, 1) / 1048576.0;
+  double cost = ms / megabytes;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (Arm& arm : contexts_[decision.context].arms) {
+    if (arm.strategy != decision.strategy) continue;
+    arm.ms_per_mb = arm.runs == 0
+                        ? cost
+                        : arm.ms_per_mb +
+                              options_.smoothing * (cost - arm.ms_per_mb);
+    ++arm.runs;
+  }
+}
+
+bool StrategySelector::read(const char* path, AccessPattern pattern,
+                            int pieces, FileBuffer* out,
+                            StrategyDecision* decision,
+                            const ChunkReady& ready) {
+  StrategyDecision local;
+  if (!decision) decision = &local;
+  if (choose(path, pattern, decision) == -1) {
+    perror("Error choosing a strategy");
+    return false;
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (!decision->strategy->read(path, pieces, out, ready)) return false;
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  record(*decision, elapsed.count());
+  return true;
+}
+
+SelectorStats StrategySelector::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  SelectorStats stats;
+  stats.decisions = decisions_;
+  stats.explorations = explorations_;
+  for (const Context& context : contexts_) {
+    if (context.arms.empty()) continue;
+    size_t best = best_arm(context);
+    for (size_t i = 0; i < context.arms.size(); ++i) {
+      const Arm& arm = context.arms[i];
+      stats.arms.push_back({context.name, arm.strategy->name, arm.runs,
+                            arm.ms_per_mb, i == best && arm.runs > 0});
+    }
+  }
+  return stats;
+}
+
+std::vector<StrategySelector::Arm> StrategySelector::candidates(
+    AccessPattern pattern) const {
+  bool multiple_go = pattern == AccessPattern::kChunks;
+  std::vector<Arm> arms;
+  for (const ReadStrategy& strategy : read_strategies()) {
+    if (strategy.multiple_go != multiple_go) continue;
+    if (!options_.candidates.empty() &&
+        std::find(options_.candidates.begin(), options_.candidates.end(),
+                  strategy.name) == options_.candidates.end()) {
+      continue;
+    }
+    arms.push_back({&strategy});
+  }
+  return arms;
+}
+
+// Cheapest arm that has run; the first arm when none has.
+size_t StrategySelector::best_arm(const Context& context) const {
+  size_t best = 0;
+  for (size_t i = 0; i < context.arms.size(); ++i) {
+    const Arm& arm = context.arms[i];
+    const Arm& current = context.arms[best];
+    if (arm.runs > 0 &&
+        (current.runs == 0 || arm.ms_per_mb < current.ms_per_mb)) {
+      best = i;
+    }
+  }
+  return best;
+}
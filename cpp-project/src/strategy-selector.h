@@ -0,0 +1,115 @@
+// Picks a read strategy per request instead of hard-coding one.
+//
+// Every request falls into a context: file size bucket, how much of the file
+// is in the page cache (from mincore) and the access pattern the caller
+// declares. Within a context the selector keeps, per candidate strategy, an
+// exponentially weighted average of the observed cost in ms per MB, so old
+// measurements fade as the machine's conditions change. It is a bandit:
+// every candidate is tried a few times first, then the cheapest one is
+// picked, except for a small share of requests spent re-measuring a random
+// other candidate.
+//
+// Each decision carries a human-readable reason, and stats() dumps the model.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "read-strategies.h"
+
+enum class AccessPattern {
+  // The whole file at once: one-go strategies.
+  kWholeFile,
+  // The file in shuffled pieces: multiple-go strategies.
+  kChunks,
+};
+
+struct SelectorOptions {
+  // Share of decisions spent on a random candidate once all are tried.
+  double exploration = 0.1;
+  // Runs of every candidate in a context before exploiting.
+  int min_trials = 2;
+  // Weight of the newest measurement in the running average.
+  double smoothing = 0.3;
+  // Candidate strategy names; empty means every strategy that fits the
+  // pattern.
+  std::vector<std::string> candidates;
+  // 0 seeds from std::random_device.
+  uint64_t seed = 0;
+};
+
+struct StrategyDecision {
+  const ReadStrategy* strategy = nullptr;
+  size_t context = 0;
+  size_t file_size = 0;
+  double resident_percent = 0;
+  bool explored = false;
+  std::string reason;
+};
+
+struct SelectorArmStats {
+  std::string context;
+  const char* strategy = "";
+  uint64_t runs = 0;
+  // Running average; 0 until the first run.
+  double ms_per_mb = 0;
+  // The candidate the selector currently exploits in its context.
+  bool best = false;
+};
+
+struct SelectorStats {
+  uint64_t decisions = 0;
+  uint64_t explorations = 0;
+  // Contexts seen so far, each with all its candidates.
+  std::vector<SelectorArmStats> arms;
+};
+
+class StrategySelector {
+ public:
+  explicit StrategySelector(const SelectorOptions& options = SelectorOptions());
+  StrategySelector(const StrategySelector&) = delete;
+  StrategySelector& operator=(const StrategySelector&) = delete;
+
+  // Picks a strategy for reading `path` with `pattern`. Returns 0 on
+  // success, -1 with errno set when the file can't be examined (EINVAL when
+  // no candidate fits the pattern).
+  int choose(const char* path, AccessPattern pattern,
+             StrategyDecision* decision);
+  // Feeds the time the chosen strategy took back into the model.
+  void record(const StrategyDecision& decision, double ms);
+
+  // choose(), the read, and record(). Returns false after reporting the
+  // error via perror, like ReadStrategy::read.
+  bool read(const char* path, AccessPattern pattern, int pieces,
+            FileBuffer* out, StrategyDecision* decision = nullptr,
+            const ChunkReady& ready = ChunkReady());
+
+  SelectorStats stats() const;
+
+ private:
+  struct Arm {
+    const ReadStrategy* strategy;
+    uint64_t runs = 0;
+    double ms_per_mb = 0;
+  };
+  struct Context {
+    std::string name;
+    std::vector<Arm> arms;
+  };
+
+  std::vector<Arm> candidates(AccessPattern pattern) const;
+  size_t best_arm(const Context& context) const;
+
+  const SelectorOptions options_;
+  mutable std::mutex mutex_;
+  std::mt19937_64 random_;
+  // Indexed by context id; empty until the context is first seen.
+  std::vector<Context> contexts_;
+  uint64_t decisions_ = 0;
+  uint64_t explorations_ = 0;
+};
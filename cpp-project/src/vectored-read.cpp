@@ -0,0 +1,136 @@
+#include "vectored-read.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "read-loop.h"
+
+namespace {
+
+#ifdef IOV_MAX
+constexpr size_t kMaxIovecs = IOV_MAX;
+#else
+constexpr size_t kMaxIovecs = 1024;
+#endif
+
+// Drops `n` consumed bytes from the front of iov[*first, count).
+void advance_iovecs(std::vector<iovec>* iov, size_t* first, size_t n) {
+  while (n > 0 && *first < iov->size()) {
+    iovec& v = (*iov)[*first];
+    if (n < v.iov_len) {
+      v.iov_base = static_cast<char*>(v.iov_base) + n;
+      v.iov_len -= n;
+      return;
+    }
+    n -= v.iov_len;
+    ++*first;
+  }
+}
+
+// Reads one contiguous file range starting at `offset` into `iov`.
+// `*probe_nowait` is cleared when the kernel turns out not to support it.
+int read_run(int fd, std::vector<iovec> iov, off_t offset, size_t total,
+             bool* probe_nowait, VectoredReadStats* stats) {
+  size_t first = 0;
+  size_t done = 0;
+
+#if defined(__linux__) && defined(RWF_NOWAIT)
+  if (*probe_nowait) {
+    ssize_t n = preadv2(fd, iov.data(), iov.size(), offset, RWF_NOWAIT);
+    ++stats->syscalls;
+    if (n > 0) {
+      done += n;
+      stats->nowait_bytes += n;
+      advance_iovecs(&iov, &first, n);
+    } else if (n == -1 && errno != EAGAIN) {
+      // Old kernels or filesystems that can't honor RWF_NOWAIT.
+      *probe_nowait = false;
+    }
+  }
+#else
+  (void)probe_nowait;
+#endif
+
+  while (done < total) {
+    size_t count = iov.size() - first;
+    ssize_t n = preadv(fd, iov.data() + first, static_cast<int>(count),
+                       offset + done);
+    ++stats->syscalls;
+    if (n == -1) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) {
+      errno = EIO;
+      return -1;
+    }
+    done += n;
+    stats->blocking_bytes += n;
+    advance_iovecs(&iov, &first, n);
+  }
+  return 0;
+}
+
+bool by_offset(const ChunkRequest& a, const ChunkRequest& b) {
+  return a.offset < b.offset;
+}
+
+}  // namespace
+
+int read_chunks_vectored(int fd, const std::vector<ChunkRequest>& chunks,
+                         const VectoredReadOptions& options,
+                         VectoredReadStats* stats) {
+  VectoredReadStats local;
+  if (!stats) stats = &local;
+  bool probe_nowait = options.probe_nowait;
+  size_t window = options.window == 0 ? chunks.size() : options.window;
+
+  std::vector<ChunkRequest> batch;
+  std::vector<iovec> iov;
+  for (size_t begin = 0; begin < chunks.size(); begin += window) {
+    size_t end = std::min(chunks.size(), begin + window);
+    batch.assign(chunks.begin() + begin, chunks.begin() + end);
+    std::sort(batch.begin(), batch.end(), by_offset);
+
+    // Walk the sorted batch, extending the current run while the next chunk
+    // starts exactly where the previous one ended.
+    size_t i = 0;
+    while (i < batch.size()) {
+      off_t run_offset = batch[i].offset;
+      size_t run_size = 0;
+      iov.clear();
+      while (i < batch.size() && iov.size() < kMaxIovecs &&
+             batch[i].offset == run_offset + static_cast<off_t>(run_size)) {
+        iov.push_back({batch[i].dest, batch[i].size});
+        run_size += batch[i].size;
+        ++i;
+      }
+      if (read_run(fd, iov, run_offset, run_size, &probe_nowait, stats) ==
+          -1) {
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+int read_chunks_pread(int fd, const std::vector<ChunkRequest>& chunks,
+                      VectoredReadStats* stats) {
+  VectoredReadStats local;
+  if (!stats) stats = &local;
+
+  for (const ChunkRequest& chunk : chunks) {
+    // One request per chunk; read-loop only splits it on short reads.
+    ReadLoopStats reads;
+    int result = pread_fully(fd, chunk.dest, chunk.size, chunk.offset,
+                             chunk.size, &reads);
+    stats->syscalls += reads.calls;
+    if (result == -1) return -1;
+    stats->blocking_bytes += chunk.size;
+  }
+  return 0;
+}
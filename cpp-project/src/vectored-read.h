@@ -0,0 +1,47 @@
+// Batched chunk reads: chunks whose file ranges abut are read with a single
+// preadv(2) scattering into each chunk's own destination, so the syscall
+// count scales with the number of contiguous runs instead of chunks.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <vector>
+
+struct ChunkRequest {
+  off_t offset;
+  size_t size;
+  char* dest;
+};
+
+// A range of a file, without a destination.
+struct FileExtent {
+  off_t offset = 0;
+  size_t length = 0;
+};
+
+struct VectoredReadOptions {
+  // How many chunks of the planned order are reordered and coalesced
+  // together; 0 means the whole plan.
+  size_t window = 0;
+  // Try preadv2(RWF_NOWAIT) first so cached data is copied without ever
+  // blocking, then read whatever is left with a blocking preadv.
+  bool probe_nowait = true;
+};
+
+struct VectoredReadStats {
+  size_t syscalls = 0;
+  size_t nowait_bytes = 0;
+  size_t blocking_bytes = 0;
+};
+
+// Reads every chunk in `chunks`. Returns 0 on success, -1 with errno set
+// (EIO when the file ended before a chunk was filled).
+int read_chunks_vectored(int fd, const std::vector<ChunkRequest>& chunks,
+                         const VectoredReadOptions& options,
+                         VectoredReadStats* stats);
+
+// The baseline: one pread(2) per chunk, in the given order.
+int read_chunks_pread(int fd, const std::vector<ChunkRequest>& chunks,
+                      VectoredReadStats* stats);
@@ -0,0 +1,278 @@
+#include "zip-archive.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "read-loop.h"
+
+namespace {
+
+constexpr uint32_t kEndOfCentralDirectory = 0x06054b50;
+constexpr uint32_t kZip64EndOfCentralDirectory = 0x06064b50;
+constexpr uint32_t kZip64EndLocator = 0x07064b50;
+constexpr uint32_t kCentralDirectoryEntry = 0x02014b50;
+constexpr uint32_t kLocalFileHeader = 0x04034b50;
+constexpr size_t kEndOfCentralDirectorySize = 22;
+constexpr size_t kZip64EndOfCentralDirectorySize = 56;
+constexpr size_t kZip64EndLocatorSize = 20;
+constexpr size_t kCentralDirectoryEntrySize = 46;
+constexpr size_t kLocalFileHeaderSize = 30;
+constexpr size_t kMaxCommentSize = 0xffff;
+constexpr uint16_t kZip64ExtraField = 0x0001;
+
+off_t page_size() {
+  static const off_t kPage = sysconf(_SC_PAGESIZE);
+  return kPage;
+}
+
+uint16_t le16(const unsigned char* p) { return p[0] | p[1] << 8; }
+
+uint32_t le32(const unsigned char* p) {
+  return le16(p) | static_cast<uint32_t>(le16(p + 2)) << 16;
+}
+
+uint64_t le64(const unsigned char* p) {
+  return le32(p) | static_cast<uint64_t>(le32(p + 4)) << 32;
+}
+
+int read_at(int fd, std::vector<unsigned char>* out, size_t size,
+            off_t offset) {
+  out->resize(size);
+  return pread_fully(fd, reinterpret_cast<char*>(out->data()), size, offset);
+}
+
+int invalid() {
+  errno = EINVAL;
+  return -1;
+}
+
+struct Directory {
+  uint64_t count;
+  uint64_t size;
+  uint64_t offset;
+};
+
+// The end of central directory record is followed by a comment of up to
+// 64KB, so it is searched for backwards from the end. Fields that don't fit
+// are 0xffff(ffff), and the zip64 record (found through the locator right
+// before it) has them instead.
+int find_central_directory(int fd, off_t file_size, Directory* out) {
+  size_t tail_size = std::min<off_t>(
+      file_size, kEndOfCentralDirectorySize + kMaxCommentSize);
+  if (tail_size < kEndOfCentralDirectorySize) return invalid();
+  off_t tail_offset = file_size - tail_size;
+  std::vector<unsigned char> tail;
+  if (read_at(fd, &tail, tail_size, tail_offset) == -1) return -1;
+  const unsigned char* record = nullptr;
+  size_t end = tail_size - kEndOfCentralDirectorySize + 1;
+  while (end-- > 0) {
+    if (le32(&tail[end]) == kEndOfCentralDirectory) {
+      record = &tail[end];
+      break;
+    }
+  }
+  if (!record) return invalid();
+
+  *out = {le16(record + 10), le32(record + 12), le32(record + 16)};
+  if (out->count != 0xffff && out->size != 0xffffffff &&
+      out->offset != 0xffffffff) {
+    return 0;
+  }
+
+  off_t end_offset = tail_offset + end;
+  if (end_offset < static_cast<off_t>(kZip64EndLocatorSize)) return invalid();
+  std::vector<unsigned char> locator;
+  if (read_at(fd, &locator, kZip64EndLocatorSize,
+              end_offset - kZip64EndLocatorSize) == -1) {
+    return -1;
+  }
+  if (le32(locator.data()) != kZip64EndLocator) return invalid();
+  uint64_t zip64_offset = le64(locator.data() + 8);
+  if (zip64_offset + kZip64EndOfCentralDirectorySize >
+      static_cast<uint64_t>(end_offset)) {
+    return invalid();
+  }
+  std::vector<unsigned char> zip64;
+  if (read_at(fd, &zip64, kZip64EndOfCentralDirectorySize, zip64_offset) ==
+      -1) {
+    return -1;
+  }
+  if (le32(zip64.data()) != kZip64EndOfCentralDirectory) return invalid();
+  *out = {le64(zip64.data() + 32), le64(zip64.data() + 40),
+          le64(zip64.data() + 48)};
+  return 0;
+}
+
+// Replaces the 32-bit fields that overflowed with their values from the
+// zip64 extra field, which holds exactly those, in this order.
+int apply_zip64_extra(const unsigned char* extra, size_t extra_size,
+                      ZipEntry* entry, uint64_t* header_offset) {
+  uint64_t* fields[] = {&entry->size, &entry->compressed_size, header_offset};
+  while (extra_size >= 4) {
+    uint16_t id = le16(extra);
+    size_t size = le16(extra + 2);
+    if (size > extra_size - 4) return invalid();
+    if (id == kZip64ExtraField) {
+      const unsigned char* value = extra + 4;
+      for (uint64_t* field : fields) {
+        if (*field != 0xffffffff) continue;
+        if (value + 8 > extra + 4 + size) return invalid();
+        *field = le64(value);
+        value += 8;
+      }
+      return 0;
+    }
+    extra += 4 + size;
+    extra_size -= 4 + size;
+  }
+  return 0;
+}
+
+}  // namespace
+
+bool ZipEntry::page_aligned() const {
+  return stored() && data_offset % page_size() == 0;
+}
+
+int ZipArchive::open(const char* path) {
+  close();
+  fd_ = ::open(path, O_RDONLY | O_CLOEXEC);
+  if (fd_ == -1) return -1;
+  struct stat sb;
+  if (fstat(fd_, &sb) == -1 || read_directory(sb.st_size) == -1) {
+    int saved_errno = errno;
+    close();
+    errno = saved_errno;
+    return -1;
+  }
+  return 0;
+}
+
+int ZipArchive::read_directory(off_t archive_size) {
+  Directory directory;
+  if (find_central_directory(fd_, archive_size, &directory) == -1) return -1;
+  if (directory.offset + directory.size >
+      static_cast<uint64_t>(archive_size)) {
+    return invalid();
+  }
+  std::vector<unsigned char> records;
+  if (read_at(fd_, &records, directory.size, directory.offset) == -1) {
+    return -1;
+  }
+
+  size_t position = 0;
+  std::vector<unsigned char> local;
+  for (uint64_t i = 0; i < directory.count; ++i) {
+    const unsigned char* record = records.data() + position;
+    if (records.size() - position < kCentralDirectoryEntrySize ||
+        le32(record) != kCentralDirectoryEntry) {
+      return invalid();
+    }
+    size_t name_size = le16(record + 28);
+    size_t extra_size = le16(record + 30);
+    size_t record_size = kCentralDirectoryEntrySize + name_size + extra_size +
+                         le16(record + 32);
+    if (records.size() - position < record_size) return invalid();
+    ZipEntry entry;
+    const char* name =
+        reinterpret_cast<const char*>(record) + kCentralDirectoryEntrySize;
+    entry.name.assign(name, name_size);
+    entry.method = le16(record + 10);
+    entry.compressed_size = le32(record + 20);
+    entry.size = le32(record + 24);
+    uint64_t header_offset = le32(record + 42);
+    if (apply_zip64_extra(record + kCentralDirectoryEntrySize + name_size,
+                          extra_size, &entry, &header_offset) == -1) {
+      return -1;
+    }
+
+    // The local header's extra field (alignment padding, among others) can
+    // differ from the central directory's copy, so the data offset comes
+    // from the local header.
+    if (read_at(fd_, &local, kLocalFileHeaderSize, header_offset) == -1) {
+      return -1;
+    }
+    if (le32(local.data()) != kLocalFileHeader) return invalid();
+    entry.data_offset = header_offset + kLocalFileHeaderSize +
+                        le16(local.data() + 26) + le16(local.data() + 28);
+    if (entry.data_offset + entry.compressed_size >
+        static_cast<uint64_t>(archive_size)) {
+      return invalid();
+    }
+    // Stored entries are used as a plain range of `size` bytes, which has
+    // to be exactly what the archive holds for them.
+    if (entry.stored() && entry.size != entry.compressed_size) {
+      return invalid();
+    }
+
+    index_[entry.name] = entries_.size();
+    entries_.push_back(std::move(entry));
+    position += record_size;
+  }
+  return 0;
+}
+
+void ZipArchive::close() {
+  if (fd_ != -1) ::close(fd_);
+  fd_ = -1;
+  entries_.clear();
+  index_.clear();
+}
+
+const ZipEntry* ZipArchive::find(const std::string& name) const {
+  auto it = index_.find(name);
+  return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+int ZipArchive::open_range(const ZipEntry& entry, off_t* start,
+                           off_t* length) const {
+  if (!entry.stored()) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  int fd = fcntl(fd_, F_DUPFD_CLOEXEC, 0);
+  if (fd == -1) return -1;
+  *start = entry.data_offset;
+  *length = entry.size;
+  return fd;
+}
+
+int ZipSpan::map(const ZipArchive& archive, const ZipEntry& entry) {
+  unmap();
+  if (!entry.stored()) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  if (entry.size == 0) {
+    data_ = "";
+    return 0;
+  }
+  off_t aligned = entry.data_offset & ~(page_size() - 1);
+  size_t mapping_size = entry.size + (entry.data_offset - aligned);
+  void* mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE,
+                       archive.fd(), aligned);
+  if (mapping == MAP_FAILED) return -1;
+  mapping_ = mapping;
+  mapping_size_ = mapping_size;
+  data_ = static_cast<const char*>(mapping) + (entry.data_offset - aligned);
+  size_ = entry.size;
+  return 0;
+}
+
+void ZipSpan::unmap() {
+  if (mapping_) munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+int ZipSpan::advise(int advice) const {
+  if (!mapping_) return 0;
+  return madvise(mapping_, mapping_size_, advice);
+}
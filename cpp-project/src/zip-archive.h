@@ -0,0 +1,94 @@
+// Reading zip archives (APKs, asset pack splits) in place. The central
+// directory says where every entry is; a stored (uncompressed) entry is a
+// plain byte range of the archive, so it can be handed out as fd+offset,
+// like AAsset_openFileDescriptor64, or mapped straight from the archive,
+// with no extraction to a file of its own. That saves the copy on first
+// run and the duplicate of every asset on disk.
+//
+// Entries zipalign -p (or bundletool) placed on a page boundary map
+// exactly; other stored entries map from the page below, with a few bytes
+// of their neighbour in front of the span. Zip64 archives are supported.
+// Built into the Android app too.
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr uint16_t kZipStored = 0;
+constexpr uint16_t kZipDeflated = 8;
+
+struct ZipEntry {
+  std::string name;
+  uint16_t method = kZipStored;
+  uint64_t compressed_size = 0;
+  uint64_t size = 0;
+  // Start of the entry's data, past its local header.
+  off_t data_offset = 0;
+
+  bool stored() const { return method == kZipStored; }
+  // Stored and starting on a page boundary.
+  bool page_aligned() const;
+};
+
+class ZipArchive {
+ public:
+  ZipArchive() = default;
+  ~ZipArchive() { close(); }
+  ZipArchive(const ZipArchive&) = delete;
+  ZipArchive& operator=(const ZipArchive&) = delete;
+
+  // Reads the central directory and every entry's local header. Returns 0
+  // on success, -1 with errno set (EINVAL when `path` isn't a zip archive,
+  // or an entry runs past its end or is stored with two different sizes).
+  int open(const char* path);
+  void close();
+
+  int fd() const { return fd_; }
+  const std::vector<ZipEntry>& entries() const { return entries_; }
+  // Returns nullptr when there is no entry called `name`.
+  const ZipEntry* find(const std::string& name) const;
+
+  // A new fd on the archive (the caller closes it) plus the range of the
+  // stored entry in it. Returns -1 with errno set; ENOTSUP for compressed
+  // entries.
+  int open_range(const ZipEntry& entry, off_t* start, off_t* length) const;
+
+ private:
+  int read_directory(off_t archive_size);
+
+  int fd_ = -1;
+  std::vector<ZipEntry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+};
+
+// A stored entry mapped read-only from its archive. The archive can be
+// closed while the span is alive.
+class ZipSpan {
+ public:
+  ZipSpan() = default;
+  ~ZipSpan() { unmap(); }
+  ZipSpan(const ZipSpan&) = delete;
+  ZipSpan& operator=(const ZipSpan&) = delete;
+
+  // Returns 0 on success, -1 with errno set; ENOTSUP for compressed
+  // entries.
+  int map(const ZipArchive& archive, const ZipEntry& entry);
+  void unmap();
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  // madvise over the span's pages. Returns 0, or -1 with errno set.
+  int advise(int advice) const;
+
+ private:
+  void* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};